@@ -0,0 +1,70 @@
+/**
+ * The bump-pointer arena from arena.hpp.
+ */
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "arena.hpp"
+
+using namespace std;
+
+Arena::Arena(size_t block_size) : current(0), pos(NULL), end(NULL), block_size(block_size) {}
+
+Arena::~Arena(){
+    release();
+    for(Block& b : blocks){
+        free(b.start);
+    }
+}
+
+static inline char* align_up(char* p, size_t align){
+    return (char*)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+void* Arena::allocate(size_t size, size_t align){
+    char* p = align_up(pos, align);
+    if(pos == NULL || p + size > end){
+        next_block(size + align);
+        p = align_up(pos, align);
+    }
+    pos = p + size;
+    return p;
+}
+
+// Move on to the next block with at least min_size bytes, reusing the
+// blocks left over from before the last release where they are big enough
+void Arena::next_block(size_t min_size){
+    size_t next = pos == NULL ? 0 : current + 1;
+    if(next >= blocks.size() || blocks[next].size < min_size){
+        size_t size = min_size > block_size ? min_size : block_size;
+        Block b = {(char*)malloc(size), size};
+        if(b.start == NULL){
+            throw bad_alloc();
+        }
+        blocks.insert(blocks.begin() + next, b);
+    }
+    current = next;
+    pos = blocks[next].start;
+    end = pos + blocks[next].size;
+}
+
+Arena::Mark Arena::mark() const {
+    Mark m = {current, pos, finalizers.size()};
+    return m;
+}
+
+void Arena::release_to(const Mark& m){
+    while(finalizers.size() > m.finalizers){
+        finalizers.back().first(finalizers.back().second);
+        finalizers.pop_back();
+    }
+    current = m.block;
+    pos = m.pos;
+    end = pos == NULL ? NULL : blocks[current].start + blocks[current].size;
+}
+
+void Arena::release(){
+    Mark start = {0, NULL, 0};
+    release_to(start);
+}
@@ -0,0 +1,82 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <vector>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+
+using namespace std;
+
+// Types whose destructor frees nothing can skip the finalizer list; a
+// header can specialize this for node types that only hold pointers.
+template<class T>
+struct ArenaNoDestroy : is_trivially_destructible<T> {};
+
+/*
+ * A bump-pointer arena. Objects are carved out of large blocks and are
+ * never freed one by one: release() (or release_to() a mark) runs the
+ * destructors of everything made since, in reverse order, and rewinds
+ * the pointer. The blocks are kept and reused by later allocations.
+ */
+class Arena {
+public:
+    // A point to rewind to, see mark() and release_to()
+    struct Mark {
+        size_t block;
+        char* pos;
+        size_t finalizers;
+    };
+
+    explicit Arena(size_t block_size = 64 * 1024);
+    ~Arena();
+
+    void* allocate(size_t size, size_t align);
+
+    template<class T, class... Args>
+    T* make(Args&&... args){
+        T* t = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if(!ArenaNoDestroy<T>::value){
+            finalizers.push_back(make_pair(&destroy<T>, (void*)t));
+        }
+        return t;
+    }
+
+    Mark mark() const;
+    void release_to(const Mark& m);
+    void release();
+
+private:
+    struct Block {
+        char* start;
+        size_t size;
+    };
+
+    template<class T>
+    static void destroy(void* p){
+        static_cast<T*>(p)->~T();
+    }
+
+    void next_block(size_t min_size);
+
+    vector<Block> blocks;
+    size_t current;
+    char* pos;
+    char* end;
+    size_t block_size;
+    vector<pair<void (*)(void*), void*>> finalizers;
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+};
+
+// Releases everything made in the arena since the scope was entered
+struct ArenaScope {
+    Arena& arena;
+    Arena::Mark start;
+    explicit ArenaScope(Arena& a) : arena(a), start(a.mark()) {}
+    ~ArenaScope(){ arena.release_to(start); }
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <mutex>
 #include "ast.hpp"
 using namespace std;
 
@@ -20,34 +21,32 @@ string get_struct_name(Type* a){
   }
 }
 
-string Type::type_string(){
+// NULL stands for a missing type, as in a Fn without a return
+static string build_type_string(Type* t){
+  if(t == NULL){
+    return "_";
+  }
   string ret_str;
-  switch(type){
-    case Int:
+  switch(t->type){
+    case Type::Int:
       return "Int";
-    case Struct:
-      return "Struct(" + value.Struct.name + ")";
-    case Fn:
+    case Type::Struct:
+      return "Struct(" + t->value.Struct.name + ")";
+    case Type::Fn:
     //   (int, &int) -> int
       ret_str = "Fn([";
-      if(value.Fn.prms.size() != 0){
-        for(long unsigned int i = 0; i < value.Fn.prms.size()-1; i++){
-          ret_str += value.Fn.prms[i]->type_string();
-          if(i != value.Fn.prms.size() - 1)
-            ret_str += ", ";
-        }
-        ret_str += value.Fn.prms[value.Fn.prms.size()-1]->type_string();
+      for(size_t i = 0; i < t->value.Fn.prms.size(); i++){
+        if(i != 0)
+          ret_str += ", ";
+        ret_str += t->value.Fn.prms[i]->type_string();
       }
       ret_str += "], ";
-      if(value.Fn.ret != NULL)
-        ret_str += value.Fn.ret->type_string();
-      else
-        ret_str += "_";
+      ret_str += t->value.Fn.ret != NULL ? t->value.Fn.ret->type_string() : "_";
       ret_str += ")";
       return ret_str;
-    case Ptr:
-      return "Ptr(" + value.Ptr.ref->type_string() + ")";
-    case Any:
+    case Type::Ptr:
+      return "Ptr(" + (t->value.Ptr.ref != NULL ? t->value.Ptr.ref->type_string() : "_") + ")";
+    case Type::Any:
       return "_";
   }
   return "ERROR";
@@ -571,4 +570,186 @@ void Program::toString(){
 
   indent--;
   indent_print(")");
-}
\ No newline at end of file
+}
+thread_local Arena ast_arena;
+
+/*
+ * The interning table. A type is keyed by its kind, its struct name and
+ * its (already interned) children, so hashing never walks further than
+ * one level down.
+ */
+namespace {
+struct TypeKey {
+  int kind;
+  string name;
+  vector<Type*> parts;   // Ptr: ref; Fn: prms then ret
+
+  bool operator==(const TypeKey& o) const {
+    return kind == o.kind && name == o.name && parts == o.parts;
+  }
+};
+
+struct TypeKeyHash {
+  size_t operator()(const TypeKey& k) const {
+    size_t h = hash<string>()(k.name) * 31 + k.kind;
+    for(Type* p : k.parts){
+      h = h * 1000003 ^ hash<Type*>()(p);
+    }
+    return h;
+  }
+};
+}
+
+struct TypeTable {
+  Arena arena;
+  unordered_map<TypeKey, Type*, TypeKeyHash> types;
+  mutex lock;
+  int sharing = 0; // interning takes the lock while this is set
+};
+
+thread_local TypeTable own_types;
+thread_local TypeTable* borrowed_types = NULL;
+
+static Type* intern_type(TypeKey& key){
+  TypeTable& table = borrowed_types != NULL ? *borrowed_types : own_types;
+  unique_lock<mutex> guard(table.lock, defer_lock);
+  if(table.sharing > 0){
+    guard.lock();
+  }
+  auto it = table.types.find(key);
+  if(it != table.types.end()){
+    return it->second;
+  }
+  Type* t = table.arena.make<Type>((enum Type::type)key.kind);
+  switch(t->type){
+    case Type::Struct:
+      t->value.Struct.name = key.name;
+      break;
+    case Type::Ptr:
+      t->value.Ptr.ref = key.parts[0];
+      break;
+    case Type::Fn:
+      t->value.Fn.prms.assign(key.parts.begin(), key.parts.end() - 1);
+      t->value.Fn.ret = key.parts.back();
+      break;
+    default:
+      break;
+  }
+  t->str = build_type_string(t);
+  table.types.emplace(std::move(key), t);
+  return t;
+}
+
+Type* int_type(){
+  TypeKey key{Type::Int, "", {}};
+  return intern_type(key);
+}
+
+Type* any_type(){
+  TypeKey key{Type::Any, "", {}};
+  return intern_type(key);
+}
+
+Type* struct_type(const string& name){
+  TypeKey key{Type::Struct, name, {}};
+  return intern_type(key);
+}
+
+Type* ptr_type(Type* ref){
+  TypeKey key{Type::Ptr, "", {ref}};
+  return intern_type(key);
+}
+
+Type* fn_type(const vector<Type*>& prms, Type* ret){
+  TypeKey key{Type::Fn, "", prms};
+  key.parts.push_back(ret);
+  return intern_type(key);
+}
+
+// drop every interned type; nothing may still point at them
+void reset_types(){
+  own_types.types.clear();
+  own_types.arena.release();
+}
+
+TypeTable* share_types(){
+  own_types.sharing++;
+  return &own_types;
+}
+
+void unshare_types(TypeTable* table){
+  table->sharing--;
+}
+
+void borrow_types(TypeTable* table){
+  borrowed_types = table;
+}
+
+// interned types are unique, so equal types are the same object
+bool compare_recurse(Type* a, Type* b){
+  return a == b;
+}
+
+/*
+ * The unions do not know which member is live, so each node destroys the
+ * member that matches its type. Children are not touched, they are
+ * arena objects with their own destructors.
+ */
+Type::~Type(){
+  switch(type){
+    case Type::Struct:
+      value.Struct.name.~string();
+      break;
+    case Type::Fn:
+      value.Fn.prms.~vector();
+      break;
+    default:
+      break;
+  }
+}
+
+Exp::~Exp(){
+  switch(type){
+    case Exp::Id:
+      value.Id.name.~string();
+      break;
+    case Exp::FieldAccess:
+      value.FieldAccess.field.~string();
+      break;
+    case Exp::Call:
+      value.Call.args.~vector();
+      break;
+    default:
+      break;
+  }
+}
+
+Lval::~Lval(){
+  switch(type){
+    case Lval::Id:
+      value.Id.name.~string();
+      break;
+    case Lval::FieldAccess:
+      value.FieldAccess.field.~string();
+      break;
+    default:
+      break;
+  }
+}
+
+Stmt::~Stmt(){
+  switch(type){
+    case Stmt::Call:
+      value.Call.args.~vector();
+      break;
+    case Stmt::If:
+      value.If.tt.~vector();
+      value.If.ff.~vector();
+      break;
+    case Stmt::While:
+      value.While.body.~vector();
+      break;
+    default:
+      break;
+  }
+}
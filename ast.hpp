@@ -5,10 +5,16 @@
 #include <vector>
 #include <cstring>
 #include <unordered_map>
+#include <stdexcept>
+
+#include "arena.hpp"
 using namespace std;
 
+struct FunctionScope;
+
 struct AST{
   virtual void toString() = 0;
+  virtual ~AST(){};
 };
 
 void indent_print(string s, bool newline);
@@ -47,10 +53,14 @@ typedef struct Type:AST {
     ~Value(){}
   } value;
 
-  Type(){};
+  // filled in once when the type is interned, see type_string()
+  string str;
+
+  Type():type(Any){};
   Type(enum type t):type(t){};
+  ~Type();
   void toString();
-  string type_string();
+  const string& type_string() const { return str; }
 } Type;
 
 /*
@@ -173,8 +183,13 @@ typedef struct Exp : AST{
     ~Value(){}
 
   } value;
+  // the type to_type() found, read by lowering; NULL until checked
+  Type* typ = NULL;
+  Exp():type(Nil){};
+  ~Exp();
   void toString();
-  Type* to_type(string func_name, unordered_map<string, Type*> gamma);
+  Type* to_type(FunctionScope& scope);
+  Type* infer_type(FunctionScope& scope);
 } Exp;
 
 
@@ -199,7 +214,7 @@ typedef struct Rhs : AST{
 
   } value;
   void toString();
-  Type* to_type(string func_name, unordered_map<string, Type*> gamma);
+  Type* to_type(FunctionScope& scope);
 } Rhs;
 
 /*
@@ -240,8 +255,13 @@ typedef struct Lval : AST{
     ~Value(){}
 
   } value;
+  // the type to_type() found, read by lowering; NULL until checked
+  Type* typ = NULL;
+  Lval():type(Id){};
+  ~Lval();
   void toString();
-  Type* to_type(string func_name, unordered_map<string, Type*> gamma);
+  Type* to_type(FunctionScope& scope);
+  Type* infer_type(FunctionScope& scope);
 } Lval;
 
 /*
@@ -294,8 +314,10 @@ typedef struct Stmt: AST{
     ~Value(){}
 
   } value;
+  Stmt():type(Break){};
+  ~Stmt();
   void toString();
-  void to_verify(string func_name, unordered_map<string, Type*> gamma, Type* ret_type);
+  void to_verify(FunctionScope& scope);
 } Stmt;
 
 /*
@@ -335,10 +357,91 @@ typedef struct Program : AST{
   void toString();
 } Program;
 
-void validate(Program* prog);
+/*
+ * The names the type checker sees, in two layers. The global layer holds
+ * the globals, functions and externs and is built once per program; the
+ * function layer holds the parameters and locals of the function being
+ * checked and looks through to the global one. Both are passed by
+ * reference, nothing is copied per expression or statement.
+ */
+struct GlobalScope {
+  unordered_map<string, Type*> names;
+  unordered_map<string, unordered_map<string, Type*>> structs;
+};
+
+struct FunctionScope {
+  const GlobalScope& global;
+  unordered_map<string, Type*> names;
+  const string& func_name;
+  Type* ret_type;
+  int loops = 0; // enclosing whiles, for break and continue
+  vector<string>& errors;
+
+  FunctionScope(const GlobalScope& global, Function* func, vector<string>& errors);
+  Type* lookup(const string& name) const; // NULL if unbound
+  void error(const string& msg);
+};
+
+// Type checking, see typecheck.cpp. Each returns the diagnostics found,
+// in source order; an empty vector means the program is well typed.
+void build_global_scope(Program* prog, GlobalScope& global);
+void check_function(Function* func, const GlobalScope& global, vector<string>& errors);
+vector<string> validate(Program* prog);
+
+// Threads validate() checks function bodies on, 0 for one per core
+extern thread_local int check_jobs;
+
+// Thrown by compile() for a program that does not type check, what() has
+// one "type error ..." line per diagnostic
+struct type_error : runtime_error {
+  explicit type_error(const string& what) : runtime_error(what) {}
+};
+void throw_type_errors(const vector<string>& errors); // if there are any
+
+Program* read_ast(const char* data, size_t size);
 
 bool compare_recurse(Type* a, Type* b);
-bool compare_recurse(Exp* a, Exp* b, unordered_map<string, Type*> gamma, string func_name);
 string get_struct_name(Type* a);
 
+/*
+ * AST nodes live in a per-thread arena and are freed all at once when the
+ * compile that made them is done (see ArenaScope). Nodes are never deleted
+ * one by one. Types are the exception, see int_type() and friends.
+ */
+extern thread_local Arena ast_arena;
+
+template<class T, class... Args>
+T* ast_new(Args&&... args){
+  return ast_arena.make<T>(std::forward<Args>(args)...);
+}
+
+/*
+ * Types are hash-consed: every structurally distinct type is made once per
+ * thread by the functions below and never changed afterwards, so two types
+ * are equal exactly when their pointers are. They live in their own arena,
+ * outside any compile's ArenaScope, until reset_types().
+ */
+Type* int_type();
+Type* any_type();
+Type* struct_type(const string& name);
+Type* ptr_type(Type* ref);
+Type* fn_type(const vector<Type*>& prms, Type* ret);
+void reset_types();
+
+/*
+ * A thread that hands work on types to helper threads shares its table
+ * with them: share_types() before starting them, borrow_types(table) on
+ * each helper (NULL to go back to its own), unshare_types() once they are
+ * joined. Interning takes a lock while the table is shared.
+ */
+struct TypeTable;
+TypeTable* share_types();
+void unshare_types(TypeTable* table);
+void borrow_types(TypeTable* table);
+
+// these hold nothing but pointers and enums
+template<> struct ArenaNoDestroy<UnaryOp> : true_type {};
+template<> struct ArenaNoDestroy<BinaryOp> : true_type {};
+template<> struct ArenaNoDestroy<Rhs> : true_type {};
+
 #endif
\ No newline at end of file
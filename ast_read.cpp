@@ -0,0 +1,689 @@
+/**
+ * A reader for the AST JSON format (what `parse -json` prints, and what
+ * file_ast holds). It fills in the structures from ast.hpp directly, so
+ * lowering can start without the lexer and parser.
+ *
+ * This is a pull parser: the grammar functions below ask for the next
+ * value they expect and the text is consumed in one forward pass. No JSON
+ * tree is built in between. Keys are matched in place in the mapped
+ * buffer; only names and ids are copied into strings.
+ *
+ * Variants are objects with a single key naming the case, e.g.
+ * {"Ptr":"Int"} or {"UnOp":{"op":"Neg","operand":{"Num":1}}}; cases
+ * without a payload (Int, Nil, Break, Continue) are bare strings.
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include "ast.hpp"
+#include "parse.hpp"
+
+using namespace std;
+
+bool DEBUG_AST_READ = false;
+
+// Position in the mapped file
+struct JsonCursor {
+    const char* start;
+    const char* pos;
+    const char* end;
+};
+
+// A string in the buffer, not copied
+struct JsonKey {
+    const char* str;
+    size_t len;
+    bool operator==(const char* s) const {
+        return strlen(s) == len && memcmp(str, s, len) == 0;
+    }
+    string to_string() const {
+        return string(str, len);
+    }
+};
+
+static void json_error(JsonCursor& cur, string msg){
+    token_index = cur.pos - cur.start;
+    throw runtime_error{msg};
+}
+
+// A member the node cannot do without was absent from its object
+static void require_member(JsonCursor& cur, bool seen, const char* node, const char* key){
+    if(!seen){
+        json_error(cur, string("Missing member ") + key + " in " + node);
+    }
+}
+
+static inline void skip_ws(JsonCursor& cur){
+    while(cur.pos < cur.end && (*cur.pos == ' ' || *cur.pos == '\t' || *cur.pos == '\n' || *cur.pos == '\r')){
+        cur.pos++;
+    }
+}
+
+static inline char peek(JsonCursor& cur){
+    skip_ws(cur);
+    return cur.pos < cur.end ? *cur.pos : '\0';
+}
+
+static inline bool accept(JsonCursor& cur, char c){
+    if(peek(cur) == c){
+        cur.pos++;
+        return true;
+    }
+    return false;
+}
+
+static inline void expect(JsonCursor& cur, char c){
+    if(!accept(cur, c)){
+        json_error(cur, string("Expected ") + c);
+    }
+}
+
+static bool accept_null(JsonCursor& cur){
+    if(peek(cur) == 'n' && cur.end - cur.pos >= 4 && memcmp(cur.pos, "null", 4) == 0){
+        cur.pos += 4;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Read a string. The names in the AST never need escapes, so the result
+ * points into the buffer; a string with a backslash in it is rejected.
+ */
+static JsonKey read_key(JsonCursor& cur){
+    expect(cur, '"');
+    const char* start = cur.pos;
+    while(cur.pos < cur.end && *cur.pos != '"'){
+        if(*cur.pos == '\\'){
+            json_error(cur, "Escapes are not supported in names");
+        }
+        cur.pos++;
+    }
+    if(cur.pos >= cur.end){
+        json_error(cur, "Unterminated string");
+    }
+    JsonKey k = {start, (size_t)(cur.pos - start)};
+    cur.pos++;
+    return k;
+}
+
+// An id or field name; the parser never makes an empty one
+static string read_name(JsonCursor& cur){
+    JsonKey k = read_key(cur);
+    if(k.len == 0){
+        json_error(cur, "Empty name");
+    }
+    return k.to_string();
+}
+
+// `"key":` inside an object
+static JsonKey read_member(JsonCursor& cur){
+    JsonKey k = read_key(cur);
+    expect(cur, ':');
+    return k;
+}
+
+static int32_t read_int(JsonCursor& cur){
+    skip_ws(cur);
+    bool negative = accept(cur, '-');
+    if(cur.pos >= cur.end || *cur.pos < '0' || *cur.pos > '9'){
+        json_error(cur, "Expected a number");
+    }
+    int64_t num = 0;
+    while(cur.pos < cur.end && *cur.pos >= '0' && *cur.pos <= '9'){
+        num = num * 10 + (*cur.pos - '0');
+        if(num > (int64_t)INT32_MAX + 1){
+            json_error(cur, "Number out of range");
+        }
+        cur.pos++;
+    }
+    return (int32_t)(negative ? -num : num);
+}
+
+// Start of a {"Case": payload} variant; the caller reads the payload and then '}'
+static JsonKey read_tag(JsonCursor& cur){
+    expect(cur, '{');
+    return read_member(cur);
+}
+
+// Iterate over the members of an object, first is true for the first call
+static bool next_member(JsonCursor& cur, bool& first){
+    if(first){
+        first = false;
+        expect(cur, '{');
+        return !accept(cur, '}');
+    }
+    if(accept(cur, ',')){
+        return true;
+    }
+    expect(cur, '}');
+    return false;
+}
+
+// Iterate over the elements of an array, first is true for the first call
+static bool next_element(JsonCursor& cur, bool& first){
+    if(first){
+        first = false;
+        expect(cur, '[');
+        return !accept(cur, ']');
+    }
+    if(accept(cur, ',')){
+        return true;
+    }
+    expect(cur, ']');
+    return false;
+}
+
+// Skip a value of any shape, for members this reader does not use
+static void skip_value(JsonCursor& cur){
+    char c = peek(cur);
+    if(c == '"'){
+        read_key(cur);
+    }
+    else if(c == '{'){
+        bool first = true;
+        while(next_member(cur, first)){
+            read_member(cur);
+            skip_value(cur);
+        }
+    }
+    else if(c == '['){
+        bool first = true;
+        while(next_element(cur, first)){
+            skip_value(cur);
+        }
+    }
+    else{
+        while(cur.pos < cur.end && *cur.pos != ',' && *cur.pos != '}' && *cur.pos != ']'){
+            cur.pos++;
+        }
+    }
+}
+
+static Type* read_type(JsonCursor& cur);
+static Exp* read_exp(JsonCursor& cur);
+static Lval* read_lval(JsonCursor& cur);
+static vector<Stmt*> read_stmts(JsonCursor& cur);
+
+// rettyp ::= type | null
+static Type* read_rettyp(JsonCursor& cur){
+    if(accept_null(cur)){
+        return NULL;
+    }
+    return read_type(cur);
+}
+
+// Type ::= "Int" | {"Struct":name} | {"Fn":{"prms":[...],"ret":rettyp}} | {"Ptr":type}
+static Type* read_type(JsonCursor& cur){
+    if(peek(cur) == '"'){
+        JsonKey k = read_key(cur);
+        if(!(k == "Int")){
+            json_error(cur, "Unknown type " + k.to_string());
+        }
+        return int_type();
+    }
+    JsonKey tag = read_tag(cur);
+    Type* t;
+    if(tag == "Struct"){
+        t = struct_type(read_name(cur));
+    }
+    else if(tag == "Ptr"){
+        t = ptr_type(read_type(cur));
+    }
+    else if(tag == "Fn"){
+        vector<Type*> prms;
+        Type* ret = NULL;
+        bool first = true;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "prms"){
+                bool first_prm = true;
+                while(next_element(cur, first_prm)){
+                    prms.push_back(read_type(cur));
+                }
+            }
+            else if(k == "ret"){
+                ret = read_rettyp(cur);
+            }
+            else{
+                skip_value(cur);
+            }
+        }
+        t = fn_type(prms, ret);
+    }
+    else{
+        json_error(cur, "Unknown type " + tag.to_string());
+        return NULL;
+    }
+    expect(cur, '}');
+    return t;
+}
+
+// Decl ::= {"name":id,"typ":type}
+static Decl* read_decl(JsonCursor& cur){
+    Decl* d = ast_new<Decl>();
+    d->type = NULL;
+    bool has_name = false, has_typ = false;
+    bool first = true;
+    while(next_member(cur, first)){
+        JsonKey k = read_member(cur);
+        if(k == "name"){
+            d->name = read_name(cur);
+            has_name = true;
+        }
+        else if(k == "typ"){
+            d->type = read_type(cur);
+            has_typ = true;
+        }
+        else{
+            skip_value(cur);
+        }
+    }
+    require_member(cur, has_name, "Decl", "name");
+    require_member(cur, has_typ, "Decl", "typ");
+    return d;
+}
+
+static vector<Decl*> read_decls(JsonCursor& cur){
+    vector<Decl*> decls;
+    bool first = true;
+    while(next_element(cur, first)){
+        decls.push_back(read_decl(cur));
+    }
+    return decls;
+}
+
+static UnaryOp* read_unop(JsonCursor& cur){
+    JsonKey k = read_key(cur);
+    UnaryOp* u = ast_new<UnaryOp>();
+    if(k == "Neg") u->type = UnaryOp::Neg;
+    else if(k == "Deref") u->type = UnaryOp::Deref;
+    else json_error(cur, "Unknown unary op " + k.to_string());
+    return u;
+}
+
+static BinaryOp* read_binop(JsonCursor& cur){
+    JsonKey k = read_key(cur);
+    BinaryOp* b = ast_new<BinaryOp>();
+    if(k == "Add") b->type = BinaryOp::Add;
+    else if(k == "Sub") b->type = BinaryOp::Sub;
+    else if(k == "Mul") b->type = BinaryOp::Mul;
+    else if(k == "Div") b->type = BinaryOp::Div;
+    else if(k == "Equal") b->type = BinaryOp::Equal;
+    else if(k == "NotEq") b->type = BinaryOp::NotEq;
+    else if(k == "Lt") b->type = BinaryOp::Lt;
+    else if(k == "Lte") b->type = BinaryOp::Lte;
+    else if(k == "Gt") b->type = BinaryOp::Gt;
+    else if(k == "Gte") b->type = BinaryOp::Gte;
+    else json_error(cur, "Unknown binary op " + k.to_string());
+    return b;
+}
+
+static vector<Exp*> read_args(JsonCursor& cur){
+    vector<Exp*> args;
+    bool first = true;
+    while(next_element(cur, first)){
+        args.push_back(read_exp(cur));
+    }
+    return args;
+}
+
+/*
+Exp ::= "Nil" | {"Num":n} | {"Id":name} | {"UnOp":{op,operand}}
+      | {"BinOp":{op,left,right}} | {"ArrayAccess":{ptr,index}}
+      | {"FieldAccess":{ptr,field}} | {"Call":{callee,args}}
+*/
+static Exp* read_exp(JsonCursor& cur){
+    Exp* e = ast_new<Exp>();
+    if(peek(cur) == '"'){
+        JsonKey k = read_key(cur);
+        if(!(k == "Nil")){
+            json_error(cur, "Unknown exp " + k.to_string());
+        }
+        e->type = Exp::Nil;
+        return e;
+    }
+    JsonKey tag = read_tag(cur);
+    if(DEBUG_AST_READ) cout << "read_exp: " << tag.to_string() << endl;
+    if(tag == "Num"){
+        e->type = Exp::Num;
+        e->value.Num.n = read_int(cur);
+    }
+    else if(tag == "Id"){
+        e->type = Exp::Id;
+        string name = read_name(cur);
+        e->value.Id.name = name;
+    }
+    else{
+        bool first = true;
+        if(tag == "UnOp"){
+            e->type = Exp::UnOp;
+            bool has_op = false, has_operand = false;
+            while(next_member(cur, first)){
+                JsonKey k = read_member(cur);
+                if(k == "op"){ e->value.UnOp.op = read_unop(cur); has_op = true; }
+                else if(k == "operand"){ e->value.UnOp.operand = read_exp(cur); has_operand = true; }
+                else skip_value(cur);
+            }
+            require_member(cur, has_op, "UnOp", "op");
+            require_member(cur, has_operand, "UnOp", "operand");
+        }
+        else if(tag == "BinOp"){
+            e->type = Exp::BinOp;
+            bool has_op = false, has_left = false, has_right = false;
+            while(next_member(cur, first)){
+                JsonKey k = read_member(cur);
+                if(k == "op"){ e->value.BinOp.op = read_binop(cur); has_op = true; }
+                else if(k == "left"){ e->value.BinOp.left = read_exp(cur); has_left = true; }
+                else if(k == "right"){ e->value.BinOp.right = read_exp(cur); has_right = true; }
+                else skip_value(cur);
+            }
+            require_member(cur, has_op, "BinOp", "op");
+            require_member(cur, has_left, "BinOp", "left");
+            require_member(cur, has_right, "BinOp", "right");
+        }
+        else if(tag == "ArrayAccess"){
+            e->type = Exp::ArrayAccess;
+            bool has_ptr = false, has_index = false;
+            while(next_member(cur, first)){
+                JsonKey k = read_member(cur);
+                if(k == "ptr"){ e->value.ArrayAccess.ptr = read_exp(cur); has_ptr = true; }
+                else if(k == "index"){ e->value.ArrayAccess.index = read_exp(cur); has_index = true; }
+                else skip_value(cur);
+            }
+            require_member(cur, has_ptr, "ArrayAccess", "ptr");
+            require_member(cur, has_index, "ArrayAccess", "index");
+        }
+        else if(tag == "FieldAccess"){
+            e->type = Exp::FieldAccess;
+            bool has_ptr = false, has_field = false;
+            while(next_member(cur, first)){
+                JsonKey k = read_member(cur);
+                if(k == "ptr"){
+                    e->value.FieldAccess.ptr = read_exp(cur);
+                    has_ptr = true;
+                }
+                else if(k == "field"){
+                    string field = read_name(cur);
+                    e->value.FieldAccess.field = field;
+                    has_field = true;
+                }
+                else skip_value(cur);
+            }
+            require_member(cur, has_ptr, "FieldAccess", "ptr");
+            require_member(cur, has_field, "FieldAccess", "field");
+        }
+        else if(tag == "Call"){
+            e->type = Exp::Call;
+            bool has_callee = false, has_args = false;
+            while(next_member(cur, first)){
+                JsonKey k = read_member(cur);
+                if(k == "callee"){ e->value.Call.callee = read_exp(cur); has_callee = true; }
+                else if(k == "args"){ e->value.Call.args = read_args(cur); has_args = true; }
+                else skip_value(cur);
+            }
+            require_member(cur, has_callee, "Call", "callee");
+            require_member(cur, has_args, "Call", "args");
+        }
+        else{
+            json_error(cur, "Unknown exp " + tag.to_string());
+        }
+    }
+    expect(cur, '}');
+    return e;
+}
+
+/*
+Lval ::= {"Id":name} | {"Deref":lval} | {"ArrayAccess":{ptr,index}}
+       | {"FieldAccess":{ptr,field}}
+*/
+static Lval* read_lval(JsonCursor& cur){
+    Lval* l = ast_new<Lval>();
+    JsonKey tag = read_tag(cur);
+    bool first = true;
+    if(tag == "Id"){
+        l->type = Lval::Id;
+        string name = read_name(cur);
+        l->value.Id.name = name;
+    }
+    else if(tag == "Deref"){
+        l->type = Lval::Deref;
+        l->value.Deref.lval = read_lval(cur);
+    }
+    else if(tag == "ArrayAccess"){
+        l->type = Lval::ArrayAccess;
+        bool has_ptr = false, has_index = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "ptr"){ l->value.ArrayAccess.ptr = read_lval(cur); has_ptr = true; }
+            else if(k == "index"){ l->value.ArrayAccess.index = read_exp(cur); has_index = true; }
+            else skip_value(cur);
+        }
+        require_member(cur, has_ptr, "ArrayAccess", "ptr");
+        require_member(cur, has_index, "ArrayAccess", "index");
+    }
+    else if(tag == "FieldAccess"){
+        l->type = Lval::FieldAccess;
+        bool has_ptr = false, has_field = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "ptr"){
+                l->value.FieldAccess.ptr = read_lval(cur);
+                has_ptr = true;
+            }
+            else if(k == "field"){
+                string field = read_name(cur);
+                l->value.FieldAccess.field = field;
+                has_field = true;
+            }
+            else skip_value(cur);
+        }
+        require_member(cur, has_ptr, "FieldAccess", "ptr");
+        require_member(cur, has_field, "FieldAccess", "field");
+    }
+    else{
+        json_error(cur, "Unknown lval " + tag.to_string());
+    }
+    expect(cur, '}');
+    return l;
+}
+
+// Rhs ::= {"RhsExp":exp} | {"New":{"typ":type,"amount":exp}}
+static Rhs* read_rhs(JsonCursor& cur){
+    Rhs* r = ast_new<Rhs>();
+    JsonKey tag = read_tag(cur);
+    if(tag == "RhsExp"){
+        r->type = Rhs::RhsExp;
+        r->value.RhsExp.exp = read_exp(cur);
+    }
+    else if(tag == "New"){
+        r->type = Rhs::New;
+        r->value.New.type = NULL;
+        r->value.New.amount = NULL;
+        bool has_typ = false, has_amount = false;
+        bool first = true;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "typ"){ r->value.New.type = read_type(cur); has_typ = true; }
+            else if(k == "amount"){ r->value.New.amount = read_exp(cur); has_amount = true; }
+            else skip_value(cur);
+        }
+        require_member(cur, has_typ, "New", "typ");
+        require_member(cur, has_amount, "New", "amount");
+    }
+    else{
+        json_error(cur, "Unknown rhs " + tag.to_string());
+    }
+    expect(cur, '}');
+    return r;
+}
+
+/*
+Stmt ::= "Break" | "Continue" | {"Return":exp?} | {"Assign":{lhs,rhs}}
+       | {"Call":{callee,args}} | {"If":{guard,tt,ff}} | {"While":{guard,body}}
+*/
+static Stmt* read_stmt(JsonCursor& cur){
+    Stmt* s = ast_new<Stmt>();
+    if(peek(cur) == '"'){
+        JsonKey k = read_key(cur);
+        if(k == "Break") s->type = Stmt::Break;
+        else if(k == "Continue") s->type = Stmt::Continue;
+        else json_error(cur, "Unknown stmt " + k.to_string());
+        return s;
+    }
+    JsonKey tag = read_tag(cur);
+    if(DEBUG_AST_READ) cout << "read_stmt: " << tag.to_string() << endl;
+    bool first = true;
+    if(tag == "Return"){
+        s->type = Stmt::Return;
+        s->value.Return.exp = accept_null(cur) ? NULL : read_exp(cur);
+    }
+    else if(tag == "Assign"){
+        s->type = Stmt::Assign;
+        bool has_lhs = false, has_rhs = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "lhs"){ s->value.Assign.lhs = read_lval(cur); has_lhs = true; }
+            else if(k == "rhs"){ s->value.Assign.rhs = read_rhs(cur); has_rhs = true; }
+            else skip_value(cur);
+        }
+        require_member(cur, has_lhs, "Assign", "lhs");
+        require_member(cur, has_rhs, "Assign", "rhs");
+    }
+    else if(tag == "Call"){
+        s->type = Stmt::Call;
+        bool has_callee = false, has_args = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "callee"){ s->value.Call.callee = read_lval(cur); has_callee = true; }
+            else if(k == "args"){ s->value.Call.args = read_args(cur); has_args = true; }
+            else skip_value(cur);
+        }
+        require_member(cur, has_callee, "Call", "callee");
+        require_member(cur, has_args, "Call", "args");
+    }
+    else if(tag == "If"){
+        s->type = Stmt::If;
+        bool has_guard = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "guard"){ s->value.If.guard = read_exp(cur); has_guard = true; }
+            else if(k == "tt") s->value.If.tt = read_stmts(cur);
+            else if(k == "ff") s->value.If.ff = read_stmts(cur);
+            else skip_value(cur);
+        }
+        require_member(cur, has_guard, "If", "guard");
+    }
+    else if(tag == "While"){
+        s->type = Stmt::While;
+        bool has_guard = false;
+        while(next_member(cur, first)){
+            JsonKey k = read_member(cur);
+            if(k == "guard"){ s->value.While.guard = read_exp(cur); has_guard = true; }
+            else if(k == "body") s->value.While.body = read_stmts(cur);
+            else skip_value(cur);
+        }
+        require_member(cur, has_guard, "While", "guard");
+    }
+    else{
+        json_error(cur, "Unknown stmt " + tag.to_string());
+    }
+    expect(cur, '}');
+    return s;
+}
+
+static vector<Stmt*> read_stmts(JsonCursor& cur){
+    vector<Stmt*> stmts;
+    bool first = true;
+    while(next_element(cur, first)){
+        stmts.push_back(read_stmt(cur));
+    }
+    return stmts;
+}
+
+// locals ::= [[decl, exp?], ...]
+static vector<pair<Decl*, Exp*>> read_locals(JsonCursor& cur){
+    vector<pair<Decl*, Exp*>> locals;
+    bool first = true;
+    while(next_element(cur, first)){
+        expect(cur, '[');
+        Decl* d = read_decl(cur);
+        expect(cur, ',');
+        Exp* e = accept_null(cur) ? NULL : read_exp(cur);
+        expect(cur, ']');
+        locals.push_back(make_pair(d, e));
+    }
+    return locals;
+}
+
+static Function* read_function(JsonCursor& cur){
+    Function* f = ast_new<Function>();
+    bool first = true;
+    while(next_member(cur, first)){
+        JsonKey k = read_member(cur);
+        if(k == "name") f->name = read_name(cur);
+        else if(k == "params") f->params = read_decls(cur);
+        else if(k == "rettyp") f->rettyp = read_rettyp(cur);
+        else if(k == "locals") f->locals = read_locals(cur);
+        else if(k == "stmts") f->stmts = read_stmts(cur);
+        else skip_value(cur);
+    }
+    // the grammar has stmt+, lowering relies on a body ending somewhere
+    require_member(cur, !f->stmts.empty(), "Function", "stmts");
+    return f;
+}
+
+static Struct* read_struct(JsonCursor& cur){
+    Struct* s = ast_new<Struct>();
+    bool first = true;
+    while(next_member(cur, first)){
+        JsonKey k = read_member(cur);
+        if(k == "name") s->name = read_name(cur);
+        else if(k == "fields") s->fields = read_decls(cur);
+        else skip_value(cur);
+    }
+    return s;
+}
+
+/*
+ * Read a whole AST program. Throws a runtime error on malformed input,
+ * with token_index set to the byte offset it was found at.
+ */
+Program* read_ast(const char* data, size_t size){
+    JsonCursor cur = {data, data, data + size};
+    Program* p = ast_new<Program>();
+    bool first = true;
+    while(next_member(cur, first)){
+        JsonKey k = read_member(cur);
+        bool first_elem = true;
+        if(k == "globals"){
+            p->globals = read_decls(cur);
+        }
+        else if(k == "externs"){
+            p->externs = read_decls(cur);
+        }
+        else if(k == "structs"){
+            while(next_element(cur, first_elem)){
+                p->structs.push_back(read_struct(cur));
+            }
+        }
+        else if(k == "functions"){
+            while(next_element(cur, first_elem)){
+                p->functions.push_back(read_function(cur));
+            }
+        }
+        else{
+            skip_value(cur);
+        }
+    }
+    if(peek(cur) != '\0'){
+        json_error(cur, "Trailing data after the program");
+    }
+    token_index = 0;
+    return p;
+}
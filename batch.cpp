@@ -0,0 +1,142 @@
+/**
+ * Batch driver: compile many programs in one process on a pool of worker
+ * threads. The manifest has one `input output` pair per line; blank lines
+ * and lines starting with `#` are skipped.
+ *
+ * The parser, lowering and codegen state is thread_local, so each worker
+ * compiles its programs one after the other, resetting that state in
+ * between. Assembly goes to an in-memory buffer that is written to the
+ * output file once the program is done.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "parse.hpp"
+#include "lower.hpp"
+
+using namespace std;
+
+struct BatchJob {
+    string input;
+    string output;
+};
+
+static bool read_manifest(const char* manifest, vector<BatchJob>& jobs){
+    ifstream in(manifest);
+    if(!in){
+        return false;
+    }
+    string line;
+    while(getline(in, line)){
+        istringstream fields(line);
+        BatchJob job;
+        if(!(fields >> job.input) || job.input[0] == '#'){
+            continue;
+        }
+        if(!(fields >> job.output)){
+            cerr << manifest << ": no output file for " << job.input << endl;
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Compile one job on the calling thread, returns false if it failed
+static bool run_job(const BatchJob& job, bool from_source, bool streaming, const char* cache_dir, string& error){
+    const char* input;
+    size_t input_size;
+    if(!map_file(job.input.c_str(), input, input_size)){
+        error = job.input + ": could not open file";
+        return false;
+    }
+
+    reset_parser();
+    reset_lower();
+    reset_codegen();
+    ostringstream out;
+    asm_out = &out;
+    bool ok = true;
+    try{
+        compile(input, input_size, from_source, streaming, cache_dir);
+    }
+    catch(const type_error& e){
+        out.str("");
+        out << e.what();
+        error = job.input + ": type errors";
+        ok = false;
+    }
+    catch(const runtime_error& e){
+        // same message a single compile prints
+        out.str("");
+        out << "parse error at token " << token_index - 1 << endl;
+        error = job.input + ": parse error at token " + to_string(token_index - 1);
+        ok = false;
+    }
+    asm_out = &cout;
+    unmap_file(input, input_size);
+
+    ofstream file(job.output.c_str(), ios::binary);
+    string text = out.str();
+    file.write(text.data(), text.size());
+    if(!file){
+        error = job.output + ": could not write file";
+        return false;
+    }
+    return ok;
+}
+
+/*
+ * Compile every job in the manifest on jobs threads (0 means one per
+ * core). Returns 0 if every program compiled, 1 otherwise.
+ */
+int run_batch(const char* manifest, int jobs, bool from_source, bool streaming, const char* cache_dir){
+    vector<BatchJob> work;
+    if(!read_manifest(manifest, work)){
+        cerr << "Error: could not read manifest " << manifest << endl;
+        return 1;
+    }
+    if(jobs <= 0){
+        jobs = thread::hardware_concurrency();
+    }
+    if(jobs <= 0){
+        jobs = 1;
+    }
+    if((size_t)jobs > work.size()){
+        jobs = work.size();
+    }
+
+    // workers take the next job off a shared counter until none are left
+    atomic<size_t> next(0);
+    atomic<int> failed(0);
+    mutex report;
+    auto worker = [&](){
+        size_t i;
+        while((i = next++) < work.size()){
+            string error;
+            if(!run_job(work[i], from_source, streaming, cache_dir, error)){
+                failed++;
+                lock_guard<mutex> lock(report);
+                cerr << error << endl;
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for(int t = 1; t < jobs; t++){
+        pool.push_back(thread(worker));
+    }
+    worker();
+    for(thread& t : pool){
+        t.join();
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,618 @@
+/**
+ * Array bounds check elimination over a function in SSA form, and loop
+ * versioning for the checks that cannot be dropped outright.
+ *
+ * A range analysis gives every integer variable an interval. A variable
+ * read in a block is narrowed by the comparisons the branches on the way
+ * there must have taken: below the edge from `t = i < n; Branch(t, ..)`
+ * to its true side, i < n holds. Phis that keep growing are widened, so
+ * the analysis ends on loops.
+ *
+ * A Gep's length is only known when its array comes from an Alloc in the
+ * function, as the amount allocated. The check can go when the index is
+ * known to be at least 0 and either its interval is below the length, or
+ * a dominating comparison says it is less than the very same length.
+ *
+ * What is left is the typical loop over an array of some other bound m:
+ *
+ *     i = phi(init, i + 1); ... i < m ... Gep(a, i)
+ *
+ * With a and m unchanged in the loop and every increment of i under the
+ * same i < m, all the checks pass when init >= 0 and m <= len(a). Such a
+ * loop (an innermost one, not too big) is versioned once the function is
+ * out of SSA form: its blocks are cloned without the checks, and a block
+ * in front of the header tests the conditions once and picks the copy.
+ * This works for any array a, a parameter or one loaded from a field as
+ * well: the test reads len(a) from the array itself (Len), behind a test
+ * that a is not nil.
+ */
+
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+#include "opt.hpp"
+
+using namespace std;
+
+// bigger loops keep their checks rather than being cloned
+#define MAX_VERSIONED_INSTS 256
+
+struct Range {
+	int64_t lo;
+	int64_t hi;
+};
+
+static Range full_range(){
+	return Range{INT64_MIN, INT64_MAX};
+}
+
+static Range exactly(int64_t num){
+	return Range{num, num};
+}
+
+static Range join(Range a, Range b){
+	return Range{min(a.lo, b.lo), max(a.hi, b.hi)};
+}
+
+// [lo, hi], or every value if that might have wrapped
+static Range checked_range(__int128 lo, __int128 hi){
+	if(lo < INT64_MIN || hi > INT64_MAX){
+		return full_range();
+	}
+	return Range{(int64_t)lo, (int64_t)hi};
+}
+
+static Range arith_range(uint8_t op, Range a, Range b){
+	switch(op){
+		case ArithmeticOp::Add:
+			return checked_range((__int128)a.lo + b.lo, (__int128)a.hi + b.hi);
+		case ArithmeticOp::Sub:
+			return checked_range((__int128)a.lo - b.hi, (__int128)a.hi - b.lo);
+		case ArithmeticOp::Mul: {
+			__int128 corners[4] = {(__int128)a.lo * b.lo, (__int128)a.lo * b.hi, (__int128)a.hi * b.lo, (__int128)a.hi * b.hi};
+			return checked_range(*min_element(corners, corners + 4), *max_element(corners, corners + 4));
+		}
+		case ArithmeticOp::Div:
+			// truncating division by a constant keeps the order, or
+			// reverses it for a negative one
+			if(b.lo == b.hi && b.lo > 0){
+				return Range{a.lo / b.lo, a.hi / b.lo};
+			}
+			if(b.lo == b.hi && b.lo < -1){
+				return Range{a.hi / b.lo, a.lo / b.lo};
+			}
+			break;
+	}
+	return full_range();
+}
+
+// the comparison that holds when op does not
+static uint8_t opposite(uint8_t op){
+	switch(op){
+		case ComparisonOp::Equal: return ComparisonOp::NotEq;
+		case ComparisonOp::NotEq: return ComparisonOp::Equal;
+		case ComparisonOp::Lt: return ComparisonOp::Gte;
+		case ComparisonOp::Lte: return ComparisonOp::Gt;
+		case ComparisonOp::Gt: return ComparisonOp::Lte;
+		default: return ComparisonOp::Lt;
+	}
+}
+
+// the comparison with its operands swapped
+static uint8_t swapped(uint8_t op){
+	switch(op){
+		case ComparisonOp::Lt: return ComparisonOp::Gt;
+		case ComparisonOp::Lte: return ComparisonOp::Gte;
+		case ComparisonOp::Gt: return ComparisonOp::Lt;
+		case ComparisonOp::Gte: return ComparisonOp::Lte;
+		default: return op;
+	}
+}
+
+static bool same_slot(const LirInst& a, int i, const LirInst& b, int j){
+	return a.is_var(i) == b.is_var(j) && a.slot[i] == b.slot[j];
+}
+
+static void copy_slot(LirInst& to, int i, const LirInst& from, int j){
+	if(from.is_var(j)){
+		to.set_var(i, from.var(j));
+	}
+	else{
+		to.set_const(i, from.num(j));
+	}
+}
+
+// A comparison known to hold in the blocks below an edge, and the next
+// one up the dominator tree, -1 at the top
+struct Fact {
+	LirInst cmp;
+	int next;
+};
+
+// The blocks of the natural loop of header, all false if no edge back to
+// it makes one
+static vector<bool> natural_loop(const LIR_Function* func, const CFG& cfg, BlockId header){
+	vector<bool> in_loop(func->body.size(), false);
+	vector<BlockId> work;
+	for(BlockId pred : func->body[header]->preds){
+		if(cfg.reachable(pred) && cfg.dominates(header, pred)){
+			in_loop[header] = true;
+			if(!in_loop[pred]){
+				in_loop[pred] = true;
+				work.push_back(pred);
+			}
+		}
+	}
+	while(!work.empty()){
+		BlockId id = work.back();
+		work.pop_back();
+		for(BlockId pred : func->body[id]->preds){
+			if(cfg.reachable(pred) && !in_loop[pred]){
+				in_loop[pred] = true;
+				work.push_back(pred);
+			}
+		}
+	}
+	return in_loop;
+}
+
+void eliminate_bounds_checks(LIR_Function* func, const CFG& cfg, vector<LoopVersion>& versions){
+	VarId num_vars = func->vars.size();
+	size_t num_blocks = func->body.size();
+	auto stable = [&](VarId v){
+		return func->is_local(v) || func->is_param(v);
+	};
+
+	// where each local is assigned; def_inst is NULL for phis and calls
+	vector<BlockId> def_block(num_vars, NO_BLOCK);
+	vector<const LirInst*> def_inst(num_vars, NULL);
+	vector<const LirPhi*> def_phi(num_vars, NULL);
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		for(LirPhi& phi : bb->phis){
+			def_block[phi.lhs] = id;
+			def_phi[phi.lhs] = &phi;
+		}
+		for(LirInst& inst : bb->insts){
+			if(func->is_local(inst.lhs)){
+				def_block[inst.lhs] = id;
+				def_inst[inst.lhs] = &inst;
+			}
+		}
+		VarId* lhs = term_def(bb->term);
+		if(lhs != NULL && func->is_local(*lhs)){
+			def_block[*lhs] = id;
+		}
+	}
+
+	// the comparisons holding in each block, as a list up the dominator
+	// tree; a block only gets one of its own when it is the single target
+	// of a branch on a comparison of variables that cannot change
+	vector<Fact> facts;
+	vector<int> facts_at(num_blocks, -1);
+	for(BlockId id : cfg.dom_order){
+		BasicBlock* bb = func->body[id];
+		if(cfg.idom[id] != NO_BLOCK){
+			facts_at[id] = facts_at[cfg.idom[id]];
+		}
+		if(bb->preds.size() != 1){
+			continue;
+		}
+		Terminal* term = func->body[bb->preds[0]]->term;
+		if(term->type != Terminal::Branch || term->value.Branch.tt == term->value.Branch.ff || term->value.Branch.guard->type != Operand::Var){
+			continue;
+		}
+		const LirInst* cmp = def_inst[term->value.Branch.guard->value.Var.id];
+		if(cmp == NULL || cmp->type != LirInst::Cmp || (cmp->is_var(0) && !stable(cmp->var(0))) || (cmp->is_var(1) && !stable(cmp->var(1)))){
+			continue;
+		}
+		Fact fact{*cmp, facts_at[id]};
+		if(id == term->value.Branch.ff){
+			fact.cmp.op = opposite(cmp->op);
+		}
+		facts_at[id] = facts.size();
+		facts.push_back(fact);
+	}
+	// whether slot i of a < slot j of b is known to hold in block id
+	auto known_less = [&](BlockId id, const LirInst& a, int i, const LirInst& b, int j){
+		for(int k = facts_at[id]; k >= 0; k = facts[k].next){
+			const LirInst& cmp = facts[k].cmp;
+			if(cmp.op == ComparisonOp::Lt && same_slot(cmp, 0, a, i) && same_slot(cmp, 1, b, j)){
+				return true;
+			}
+			if(cmp.op == ComparisonOp::Gt && same_slot(cmp, 1, a, i) && same_slot(cmp, 0, b, j)){
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// the range analysis; variables that are never assigned hold their
+	// value on entry
+	vector<bool> known(num_vars, false);
+	vector<Range> range(num_vars, full_range());
+	for(VarId v = 0; v < num_vars; v++){
+		if(def_block[v] == NO_BLOCK){
+			known[v] = true;
+			range[v] = func->is_local(v) && !func->is_param(v) ? exactly(0) : full_range();
+		}
+		else if(def_inst[v] == NULL && def_phi[v] == NULL){
+			known[v] = true;
+		}
+	}
+	auto range_at = [&](VarId v, BlockId id){
+		Range r = range[v];
+		for(int k = facts_at[id]; k >= 0; k = facts[k].next){
+			const LirInst& cmp = facts[k].cmp;
+			uint8_t op = cmp.op;
+			int other = 1;
+			if(cmp.var(0) != v){
+				if(cmp.var(1) != v){
+					continue;
+				}
+				other = 0;
+				op = swapped(op);
+			}
+			if(cmp.is_var(other) && !known[cmp.var(other)]){
+				continue;
+			}
+			Range o = cmp.is_var(other) ? range[cmp.var(other)] : exactly(cmp.num(other));
+			if((op == ComparisonOp::Lt || op == ComparisonOp::Lte || op == ComparisonOp::Equal) && o.hi > INT64_MIN){
+				r.hi = min(r.hi, op == ComparisonOp::Lt ? o.hi - 1 : o.hi);
+			}
+			if((op == ComparisonOp::Gt || op == ComparisonOp::Gte || op == ComparisonOp::Equal) && o.lo < INT64_MAX){
+				r.lo = max(r.lo, op == ComparisonOp::Gt ? o.lo + 1 : o.lo);
+			}
+		}
+		// nothing reaches a block where the facts contradict each other
+		return r.lo <= r.hi ? r : range[v];
+	};
+	vector<int> changes(num_vars, 0);
+	bool changed = true;
+	auto update = [&](VarId v, Range r, bool widen){
+		if(known[v]){
+			Range old = range[v];
+			r = join(old, r);
+			if(r.lo == old.lo && r.hi == old.hi){
+				return;
+			}
+			if(widen && ++changes[v] > 2){
+				r.lo = r.lo < old.lo ? INT64_MIN : r.lo;
+				r.hi = r.hi > old.hi ? INT64_MAX : r.hi;
+			}
+		}
+		known[v] = true;
+		range[v] = r;
+		changed = true;
+	};
+	while(changed){
+		changed = false;
+		for(BlockId id : cfg.rpo){
+			BasicBlock* bb = func->body[id];
+			for(LirPhi& phi : bb->phis){
+				for(size_t j = 0; j < phi.args.size(); j++){
+					if(known[phi.args[j]]){
+						update(phi.lhs, range_at(phi.args[j], bb->preds[j]), true);
+					}
+				}
+			}
+			for(LirInst& inst : bb->insts){
+				if(!func->is_local(inst.lhs)){
+					continue;
+				}
+				if(inst.type == LirInst::Copy || inst.type == LirInst::Arith){
+					Range r[2];
+					bool ready = true;
+					for(int i = 0; i < (inst.type == LirInst::Copy ? 1 : 2); i++){
+						ready = ready && (!inst.is_var(i) || known[inst.var(i)]);
+						r[i] = inst.is_var(i) ? range_at(inst.var(i), id) : exactly(inst.num(i));
+					}
+					if(ready){
+						update(inst.lhs, inst.type == LirInst::Copy ? r[0] : arith_range(inst.op, r[0], r[1]), false);
+					}
+				}
+				else{
+					update(inst.lhs, inst.type == LirInst::Cmp ? Range{0, 1} : full_range(), false);
+				}
+			}
+		}
+	}
+
+	// invariant in a loop: a constant or a variable assigned outside it
+	auto invariant = [&](const LirInst& inst, int i, const vector<bool>& in_loop){
+		return !inst.is_var(i) || def_block[inst.var(i)] == NO_BLOCK || !in_loop[def_block[inst.var(i)]];
+	};
+	auto version_at = [&](BlockId header) -> LoopVersion& {
+		for(LoopVersion& v : versions){
+			if(v.header == header){
+				return v;
+			}
+		}
+		versions.push_back(LoopVersion());
+		versions.back().header = header;
+		return versions.back();
+	};
+	auto add_version = [&](BlockId header, const LirInst& cond, VarId gep){
+		LoopVersion& version = version_at(header);
+		bool seen = false;
+		for(const LirInst& c : version.conds){
+			seen = seen || (c.op == cond.op && same_slot(c, 0, cond, 0) && same_slot(c, 1, cond, 1));
+		}
+		if(!seen){
+			version.conds.push_back(cond);
+		}
+		version.geps.push_back(gep);
+	};
+	// the local the version of the loop at header reads the length of
+	// array into
+	int temps = 0;
+	auto length_of = [&](BlockId header, VarId array){
+		LoopVersion& version = version_at(header);
+		for(const pair<VarId, VarId>& length : version.lengths){
+			if(length.second == array){
+				return length.first;
+			}
+		}
+		VarId len = fresh_local(func, "len", int_type(), temps);
+		version.lengths.push_back(make_pair(len, array));
+		return len;
+	};
+	vector<vector<bool>> loops(num_blocks);
+	vector<int> loop_ok(num_blocks, -1);
+	auto innermost_loop = [&](BlockId header){
+		if(loop_ok[header] < 0){
+			loops[header] = natural_loop(func, cfg, header);
+			size_t size = 0;
+			bool inner = true;
+			for(BlockId id : cfg.rpo){
+				if(!loops[header][id]){
+					continue;
+				}
+				size += func->body[id]->insts.size();
+				for(BlockId pred : func->body[id]->preds){
+					inner = inner && (id == header || !cfg.reachable(pred) || !cfg.dominates(id, pred));
+				}
+			}
+			loop_ok[header] = loops[header][header] && inner && size <= MAX_VERSIONED_INSTS;
+		}
+		return loop_ok[header] == 1;
+	};
+
+	for(BlockId id : cfg.rpo){
+		for(LirInst& gep : func->body[id]->insts){
+			if(gep.type != LirInst::Gep || gep.op == LirInst::InBounds){
+				continue;
+			}
+			VarId array = gep.var(0);
+			const LirInst* alloc = def_inst[array];
+			if(alloc != NULL && alloc->type != LirInst::Alloc){
+				alloc = NULL;
+			}
+			Range idx = gep.is_var(1) ? range_at(gep.var(1), id) : exactly(gep.num(1));
+			bool above_0 = idx.lo >= 0;
+			bool below_len = false;
+			if(alloc != NULL){
+				// an Alloc that went through allocated at least 1
+				int64_t len = alloc->is_var(0) ? max(range[alloc->var(0)].lo, (int64_t)1) : alloc->num(0);
+				below_len = idx.hi < len || known_less(id, gep, 1, *alloc, 0);
+			}
+			if(above_0 && below_len){
+				gep.op = LirInst::InBounds;
+				continue;
+			}
+			// the length of any other array is only read by a version test
+			if(alloc == NULL && !stable(array)){
+				continue;
+			}
+
+			// the loop the index counts through
+			if(!gep.is_var(1) || def_phi[gep.var(1)] == NULL){
+				continue;
+			}
+			VarId i = gep.var(1);
+			BlockId header = def_block[i];
+			if(!innermost_loop(header) || !loops[header][id]){
+				continue;
+			}
+			const vector<bool>& in_loop = loops[header];
+			// a bound i < m that holds here, m fixed in the loop
+			const LirInst* bound = NULL;
+			int m = 0;
+			for(int k = facts_at[id]; k >= 0 && bound == NULL; k = facts[k].next){
+				const LirInst& cmp = facts[k].cmp;
+				if(cmp.op == ComparisonOp::Lt && cmp.var(0) == i && invariant(cmp, 1, in_loop)){
+					bound = &cmp;
+					m = 1;
+				}
+				else if(cmp.op == ComparisonOp::Gt && cmp.var(1) == i && invariant(cmp, 0, in_loop)){
+					bound = &cmp;
+					m = 0;
+				}
+			}
+			if(bound == NULL || (alloc != NULL && !invariant(*alloc, 0, in_loop)) || !invariant(gep, 0, in_loop)){
+				continue;
+			}
+			// i starts at one value from outside the loop and only ever
+			// goes up by 1 under the same bound, so it cannot wrap
+			const LirPhi* phi = def_phi[i];
+			BasicBlock* hb = func->body[header];
+			VarId init = NO_VAR;
+			bool counts = true;
+			for(size_t j = 0; j < hb->preds.size() && counts; j++){
+				if(!in_loop[hb->preds[j]]){
+					counts = init == NO_VAR || init == phi->args[j];
+					init = phi->args[j];
+					continue;
+				}
+				VarId next = phi->args[j];
+				const LirInst* step = def_inst[next];
+				counts = step != NULL && step->type == LirInst::Arith && step->op == ArithmeticOp::Add
+					&& ((step->var(0) == i && !step->is_var(1) && step->num(1) == 1) || (step->var(1) == i && !step->is_var(0) && step->num(0) == 1))
+					&& in_loop[def_block[next]];
+				LirInst index(LirInst::Cmp);
+				index.set_var(0, i);
+				counts = counts && known_less(def_block[next], index, 0, *bound, m);
+			}
+			BlockId entry_pred = NO_BLOCK;
+			for(BlockId pred : hb->preds){
+				if(!in_loop[pred]){
+					counts = counts && (entry_pred == NO_BLOCK || entry_pred == pred);
+					entry_pred = pred;
+				}
+			}
+			if(!counts || init == NO_VAR){
+				continue;
+			}
+			if(!below_len){
+				LirInst cond(LirInst::Cmp);
+				cond.op = ComparisonOp::Lte;
+				copy_slot(cond, 0, *bound, m);
+				if(alloc != NULL){
+					copy_slot(cond, 1, *alloc, 0);
+				}
+				else{
+					cond.set_var(1, length_of(header, array));
+				}
+				add_version(header, cond, gep.lhs);
+			}
+			if(!above_0){
+				LirInst cond(LirInst::Cmp);
+				cond.op = ComparisonOp::Gte;
+				cond.set_var(0, init);
+				cond.set_const(1, 0);
+				add_version(header, cond, gep.lhs);
+			}
+		}
+	}
+}
+
+// A copy of term jumping to to[id] instead of id where there is one
+static Terminal* clone_terminal(Terminal* term, const vector<BlockId>& to){
+	auto target = [&](BlockId id){
+		return to[id] != NO_BLOCK ? to[id] : id;
+	};
+	Terminal* copy = lir_new<Terminal>(term->type);
+	if(term->type == Terminal::Branch){
+		copy->value.Branch.guard = term->value.Branch.guard;
+		copy->value.Branch.tt = target(term->value.Branch.tt);
+		copy->value.Branch.ff = target(term->value.Branch.ff);
+	}
+	else if(term->type == Terminal::CallDirect){
+		copy->value.CallDirect.lhs = term->value.CallDirect.lhs;
+		copy->value.CallDirect.callee = term->value.CallDirect.callee;
+		copy->value.CallDirect.args = term->value.CallDirect.args;
+		copy->value.CallDirect.next_bb = target(term->value.CallDirect.next_bb);
+	}
+	else if(term->type == Terminal::CallIndirect){
+		copy->value.CallIndirect.lhs = term->value.CallIndirect.lhs;
+		copy->value.CallIndirect.callee = term->value.CallIndirect.callee;
+		copy->value.CallIndirect.args = term->value.CallIndirect.args;
+		copy->value.CallIndirect.next_bb = target(term->value.CallIndirect.next_bb);
+	}
+	else if(term->type == Terminal::Jump){
+		copy->value.Jump.next_bb = target(term->value.Jump.next_bb);
+	}
+	else{
+		copy->value.Ret.op = term->value.Ret.op;
+	}
+	return copy;
+}
+
+void version_loops(LIR_Function* func, CFG& cfg, const vector<LoopVersion>& versions){
+	int blocks = 0;
+	int temps = 0;
+	auto new_block = [&](){
+		string label;
+		do{
+			label = "bce" + to_string(++blocks);
+		} while(func->find_block(label) != NO_BLOCK);
+		BlockId id = func->intern_block(label);
+		func->body[id]->reachable = true;
+		return id;
+	};
+	// end block id in a branch to tt if all of conds (Cmps, lhs not set
+	// yet) hold, to ff if not
+	auto branch_on_all = [&](BlockId id, const vector<LirInst>& conds, BlockId tt, BlockId ff){
+		BasicBlock* bb = func->body[id];
+		VarId all = NO_VAR;
+		for(const LirInst& cond : conds){
+			LirInst cmp = cond;
+			cmp.lhs = fresh_local(func, "inbounds", int_type(), temps);
+			bb->insts.push_back(cmp);
+			if(all != NO_VAR){
+				LirInst both(LirInst::Arith, cmp.lhs);
+				both.op = ArithmeticOp::Mul;
+				both.set_var(0, all);
+				both.set_var(1, cmp.lhs);
+				bb->insts.push_back(both);
+			}
+			all = cmp.lhs;
+		}
+		bb->term = lir_new<Terminal>(Terminal::Branch);
+		bb->term->value.Branch.guard = lir_new<Operand>(Operand::Var);
+		bb->term->value.Branch.guard->value.Var.id = all;
+		bb->term->value.Branch.tt = tt;
+		bb->term->value.Branch.ff = ff;
+	};
+	for(const LoopVersion& version : versions){
+		BlockId header = version.header;
+		vector<bool> in_loop = natural_loop(func, cfg, header);
+		if(!in_loop[header]){
+			continue;
+		}
+
+		vector<BlockId> clone(func->body.size(), NO_BLOCK);
+		for(BlockId id : cfg.rpo){
+			if(in_loop[id]){
+				clone[id] = new_block();
+			}
+		}
+		for(BlockId id : cfg.rpo){
+			if(!in_loop[id]){
+				continue;
+			}
+			BasicBlock* copy = func->body[clone[id]];
+			copy->insts = func->body[id]->insts;
+			for(LirInst& inst : copy->insts){
+				if(inst.type == LirInst::Gep && find(version.geps.begin(), version.geps.end(), inst.lhs) != version.geps.end()){
+					inst.op = LirInst::InBounds;
+				}
+			}
+			copy->term = clone_terminal(func->body[id]->term, clone);
+		}
+
+		// test the conditions where the loop is entered, reading the
+		// lengths they need once the arrays are known not to be nil
+		BlockId test = new_block();
+		for(const pair<VarId, VarId>& length : version.lengths){
+			LirInst len(LirInst::Len, length.first);
+			len.set_var(0, length.second);
+			func->body[test]->insts.push_back(len);
+		}
+		branch_on_all(test, version.conds, clone[header], header);
+		vector<BlockId> to_test(func->body.size(), NO_BLOCK);
+		to_test[header] = test;
+		if(!version.lengths.empty()){
+			vector<LirInst> not_nil;
+			for(const pair<VarId, VarId>& length : version.lengths){
+				LirInst cmp(LirInst::Cmp);
+				cmp.op = ComparisonOp::NotEq;
+				cmp.set_var(0, length.second);
+				cmp.set_const(1, 0);
+				not_nil.push_back(cmp);
+			}
+			to_test[header] = new_block();
+			branch_on_all(to_test[header], not_nil, test, header);
+		}
+		for(BlockId pred : func->body[header]->preds){
+			if(!in_loop[pred] && cfg.reachable(pred)){
+				BasicBlock* pb = func->body[pred];
+				pb->term = clone_terminal(pb->term, to_test);
+			}
+		}
+		func->link_blocks();
+		cfg = CFG(func);
+	}
+}
@@ -0,0 +1,967 @@
+/**
+ * Writing and reading the binary AST and LIR images described in
+ * cache.hpp.
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+
+#include "cache.hpp"
+
+using namespace std;
+
+const uint32_t NO_STRING = 0xffffffff;
+
+struct ImageHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;
+    uint32_t num_strings;
+    uint32_t string_bytes; // padded to a multiple of 4
+    uint32_t num_words;
+    uint32_t reserved;
+    uint64_t checksum; // FNV-1a of everything after the header
+};
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+// Continue an FNV-1a hash h over size more bytes
+static uint64_t fnv1a(uint64_t h, const void* data, size_t size){
+    const unsigned char* p = (const unsigned char*)data;
+    for(size_t i = 0; i < size; i++){
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t hash_input(const char* data, size_t size, uint64_t seed){
+    return fnv1a(FNV_OFFSET ^ seed, data, size);
+}
+
+string cache_path(const char* dir, uint64_t hash){
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return string(dir) + "/" + name;
+}
+
+/*
+ * Writing
+ */
+
+struct ImageWriter {
+    vector<uint32_t> words;
+    vector<const string*> strings;
+    unordered_map<string, uint32_t> string_ids;
+
+    void word(uint32_t w){
+        words.push_back(w);
+    }
+
+    void str(const string& s){
+        auto it = string_ids.find(s);
+        if(it != string_ids.end()){
+            words.push_back(it->second);
+            return;
+        }
+        uint32_t id = strings.size();
+        it = string_ids.emplace(s, id).first;
+        strings.push_back(&it->first);
+        words.push_back(id);
+    }
+
+    // an optional name, empty means none
+    void opt_str(const string& s){
+        if(s == ""){
+            words.push_back(NO_STRING);
+        }
+        else{
+            str(s);
+        }
+    }
+
+    bool save(const string& path, const char* magic, uint32_t version, uint64_t hash);
+};
+
+bool ImageWriter::save(const string& path, const char* magic, uint32_t version, uint64_t hash){
+    ImageHeader header;
+    memcpy(header.magic, magic, 4);
+    header.version = version;
+    header.hash = hash;
+    header.num_strings = strings.size();
+    header.num_words = words.size();
+    header.reserved = 0;
+
+    vector<uint32_t> index;
+    uint32_t offset = 0;
+    for(const string* s : strings){
+        index.push_back(offset);
+        index.push_back(s->size());
+        offset += s->size();
+    }
+    header.string_bytes = (offset + 3) & ~3u;
+
+    // the checksum runs over the sections in the order they are written
+    const char pad[4] = {0, 0, 0, 0};
+    uint64_t sum = fnv1a(FNV_OFFSET, index.data(), index.size() * sizeof(uint32_t));
+    for(const string* s : strings){
+        sum = fnv1a(sum, s->data(), s->size());
+    }
+    sum = fnv1a(sum, pad, header.string_bytes - offset);
+    header.checksum = fnv1a(sum, words.data(), words.size() * sizeof(uint32_t));
+
+    // write to a temporary name first so a reader never sees half an image,
+    // the name is unique per thread since batch workers may race on a hash
+    size_t thread_tag = std::hash<thread::id>()(this_thread::get_id());
+    string tmp = path + ".tmp" + to_string(getpid()) + "." + to_string(thread_tag);
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if(f == NULL){
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(index.data(), sizeof(uint32_t), index.size(), f) == index.size();
+    for(const string* s : strings){
+        ok = ok && fwrite(s->data(), 1, s->size(), f) == s->size();
+    }
+    ok = ok && fwrite(pad, 1, header.string_bytes - offset, f) == header.string_bytes - offset;
+    ok = ok && fwrite(words.data(), sizeof(uint32_t), words.size(), f) == words.size();
+    ok = fclose(f) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0){
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void write_type(ImageWriter& w, Type* t){
+    if(t == NULL){
+        w.word(NO_STRING);
+        return;
+    }
+    w.word(t->type);
+    switch(t->type){
+        case Type::Struct:
+            w.str(t->value.Struct.name);
+            break;
+        case Type::Fn:
+            w.word(t->value.Fn.prms.size());
+            for(Type* p : t->value.Fn.prms){
+                write_type(w, p);
+            }
+            write_type(w, t->value.Fn.ret);
+            break;
+        case Type::Ptr:
+            write_type(w, t->value.Ptr.ref);
+            break;
+        default:
+            break;
+    }
+}
+
+static void write_decls(ImageWriter& w, const vector<Decl*>& decls){
+    w.word(decls.size());
+    for(Decl* d : decls){
+        w.str(d->name);
+        write_type(w, d->type);
+    }
+}
+
+static void write_exp(ImageWriter& w, Exp* e){
+    if(e == NULL){
+        w.word(NO_STRING);
+        return;
+    }
+    w.word(e->type);
+    switch(e->type){
+        case Exp::Num:
+            w.word((uint32_t)e->value.Num.n);
+            break;
+        case Exp::Id:
+            w.str(e->value.Id.name);
+            break;
+        case Exp::Nil:
+            break;
+        case Exp::UnOp:
+            w.word(e->value.UnOp.op->type);
+            write_exp(w, e->value.UnOp.operand);
+            break;
+        case Exp::BinOp:
+            w.word(e->value.BinOp.op->type);
+            write_exp(w, e->value.BinOp.left);
+            write_exp(w, e->value.BinOp.right);
+            break;
+        case Exp::ArrayAccess:
+            write_exp(w, e->value.ArrayAccess.ptr);
+            write_exp(w, e->value.ArrayAccess.index);
+            break;
+        case Exp::FieldAccess:
+            write_exp(w, e->value.FieldAccess.ptr);
+            w.str(e->value.FieldAccess.field);
+            break;
+        case Exp::Call:
+            write_exp(w, e->value.Call.callee);
+            w.word(e->value.Call.args.size());
+            for(Exp* a : e->value.Call.args){
+                write_exp(w, a);
+            }
+            break;
+    }
+}
+
+static void write_lval(ImageWriter& w, Lval* l){
+    w.word(l->type);
+    switch(l->type){
+        case Lval::Id:
+            w.str(l->value.Id.name);
+            break;
+        case Lval::Deref:
+            write_lval(w, l->value.Deref.lval);
+            break;
+        case Lval::ArrayAccess:
+            write_lval(w, l->value.ArrayAccess.ptr);
+            write_exp(w, l->value.ArrayAccess.index);
+            break;
+        case Lval::FieldAccess:
+            write_lval(w, l->value.FieldAccess.ptr);
+            w.str(l->value.FieldAccess.field);
+            break;
+    }
+}
+
+static void write_stmts(ImageWriter& w, const vector<Stmt*>& stmts);
+
+static void write_stmt(ImageWriter& w, Stmt* s){
+    w.word(s->type);
+    switch(s->type){
+        case Stmt::Break:
+        case Stmt::Continue:
+            break;
+        case Stmt::Return:
+            write_exp(w, s->value.Return.exp);
+            break;
+        case Stmt::Assign: {
+            write_lval(w, s->value.Assign.lhs);
+            Rhs* r = s->value.Assign.rhs;
+            w.word(r->type);
+            if(r->type == Rhs::RhsExp){
+                write_exp(w, r->value.RhsExp.exp);
+            }
+            else{
+                write_type(w, r->value.New.type);
+                write_exp(w, r->value.New.amount);
+            }
+            break;
+        }
+        case Stmt::Call:
+            write_lval(w, s->value.Call.callee);
+            w.word(s->value.Call.args.size());
+            for(Exp* a : s->value.Call.args){
+                write_exp(w, a);
+            }
+            break;
+        case Stmt::If:
+            write_exp(w, s->value.If.guard);
+            write_stmts(w, s->value.If.tt);
+            write_stmts(w, s->value.If.ff);
+            break;
+        case Stmt::While:
+            write_exp(w, s->value.While.guard);
+            write_stmts(w, s->value.While.body);
+            break;
+    }
+}
+
+static void write_stmts(ImageWriter& w, const vector<Stmt*>& stmts){
+    w.word(stmts.size());
+    for(Stmt* s : stmts){
+        write_stmt(w, s);
+    }
+}
+
+bool save_ast_image(const string& path, Program* prog, uint64_t hash){
+    ImageWriter w;
+    write_decls(w, prog->globals);
+    w.word(prog->structs.size());
+    for(Struct* s : prog->structs){
+        w.str(s->name);
+        write_decls(w, s->fields);
+    }
+    write_decls(w, prog->externs);
+    w.word(prog->functions.size());
+    for(Function* f : prog->functions){
+        w.str(f->name);
+        write_decls(w, f->params);
+        write_type(w, f->rettyp);
+        w.word(f->locals.size());
+        for(auto& local : f->locals){
+            w.str(local.first->name);
+            write_type(w, local.first->type);
+            write_exp(w, local.second);
+        }
+        write_stmts(w, f->stmts);
+    }
+    return w.save(path, "CFLA", AST_IMAGE_VERSION, hash);
+}
+
+static void write_type_map(ImageWriter& w, const map<string, Type*>& types){
+    w.word(types.size());
+    for(auto& t : types){
+        w.str(t.first);
+        write_type(w, t.second);
+    }
+}
+
+// the variable table of a function; instructions refer to it by VarId
+static void write_vars(ImageWriter& w, LIR_Function* func){
+    w.word(func->vars.size());
+    for(LirVar& var : func->vars){
+        w.str(var.name);
+        w.word((var.is_param ? 1 : 0) | (var.is_local ? 2 : 0));
+        if(var.is_param){
+            write_type(w, var.param_type);
+        }
+        if(var.is_local){
+            write_type(w, var.local_type);
+        }
+    }
+}
+
+static void write_operand(ImageWriter& w, Operand* op){
+    if(op == NULL){
+        w.word(NO_STRING);
+        return;
+    }
+    w.word(op->type);
+    if(op->type == Operand::Const){
+        w.word((uint32_t)op->value.Const.num);
+    }
+    else{
+        w.word(op->value.Var.id);
+    }
+}
+
+static void write_operands(ImageWriter& w, const vector<Operand*>& ops){
+    w.word(ops.size());
+    for(Operand* op : ops){
+        write_operand(w, op);
+    }
+}
+
+// the record as it is, its aux indexes the tables written by write_aux_tables
+static void write_inst(ImageWriter& w, const LirInst& inst){
+    w.word(inst.type | inst.op << 8 | inst.var_slots << 16);
+    w.word(inst.lhs);
+    w.word(inst.slot[0]);
+    w.word(inst.slot[1]);
+    w.word(inst.aux);
+}
+
+// the field names and extern calls of a function
+static void write_aux_tables(ImageWriter& w, LIR_Function* func){
+    w.word(func->fields.size());
+    for(const string& field : func->fields){
+        w.str(field);
+    }
+    w.word(func->calls.size());
+    for(const LirCall& call : func->calls){
+        w.str(call.callee);
+        write_operands(w, call.args);
+    }
+}
+
+static void write_terminal(ImageWriter& w, Terminal* term){
+    w.word(term->type);
+    switch(term->type){
+        case Terminal::Branch:
+            write_operand(w, term->value.Branch.guard);
+            w.word(term->value.Branch.tt);
+            w.word(term->value.Branch.ff);
+            break;
+        case Terminal::CallDirect:
+            w.word(term->value.CallDirect.lhs);
+            w.str(term->value.CallDirect.callee);
+            write_operands(w, term->value.CallDirect.args);
+            w.word(term->value.CallDirect.next_bb);
+            break;
+        case Terminal::CallIndirect:
+            w.word(term->value.CallIndirect.lhs);
+            w.word(term->value.CallIndirect.callee);
+            write_operands(w, term->value.CallIndirect.args);
+            w.word(term->value.CallIndirect.next_bb);
+            break;
+        case Terminal::Jump:
+            w.word(term->value.Jump.next_bb);
+            break;
+        case Terminal::Ret:
+            write_operand(w, term->value.Ret.op);
+            break;
+    }
+}
+
+bool save_lir_image(const string& path, LIR_Program* lir, uint64_t hash){
+    ImageWriter w;
+    write_type_map(w, lir->globals);
+    w.word(lir->structs.size());
+    for(auto& s : lir->structs){
+        w.str(s.first);
+        write_type_map(w, s.second);
+    }
+    write_type_map(w, lir->externs);
+    w.word(lir->functions.size());
+    for(auto& f : lir->functions){
+        LIR_Function* func = f.second;
+        w.str(func->name);
+        write_vars(w, func);
+        write_type(w, func->rettyp);
+        write_aux_tables(w, func);
+        // the labels come first so terminals can refer to later blocks
+        w.word(func->body.size());
+        for(BasicBlock* bb : func->body){
+            w.str(bb->label);
+        }
+        for(BasicBlock* bb : func->body){
+            w.word(bb->reachable);
+            w.word(bb->insts.size());
+            for(const LirInst& inst : bb->insts){
+                write_inst(w, inst);
+            }
+            write_terminal(w, bb->term);
+        }
+    }
+    return w.save(path, "CFLL", LIR_IMAGE_VERSION, hash);
+}
+
+/*
+ * Reading
+ */
+
+struct ImageReader {
+    const uint32_t* index;
+    const char* bytes;
+    uint32_t num_strings;
+    const uint32_t* pos;
+    const uint32_t* end;
+
+    uint32_t word(){
+        if(pos >= end){
+            throw runtime_error{"Truncated image"};
+        }
+        return *pos++;
+    }
+
+    // a count of things that each take at least one word
+    uint32_t count(){
+        uint32_t n = word();
+        if(n > (uint32_t)(end - pos)){
+            throw runtime_error{"Bad count in image"};
+        }
+        return n;
+    }
+
+    // assign string id into dst; the unions are zeroed, so empty names are skipped
+    void str(string& dst){
+        uint32_t id = word();
+        if(id == NO_STRING){
+            return;
+        }
+        if(id >= num_strings){
+            throw runtime_error{"Bad string id in image"};
+        }
+        if(index[2 * id + 1] > 0){
+            dst.assign(bytes + index[2 * id], index[2 * id + 1]);
+        }
+    }
+
+    string str(){
+        string s;
+        str(s);
+        return s;
+    }
+};
+
+/*
+ * Map an image and check its header. On success r is set up to read the
+ * words and data/size must be unmapped by the caller.
+ */
+static bool open_image(const string& path, const char* magic, uint32_t version, uint64_t hash,
+                       ImageReader& r, const char*& data, size_t& size){
+    if(access(path.c_str(), R_OK) != 0 || !map_file(path.c_str(), data, size)){
+        return false;
+    }
+    const ImageHeader* header = (const ImageHeader*)data;
+    if(size < sizeof(ImageHeader) || memcmp(header->magic, magic, 4) != 0
+       || header->version != version || header->hash != hash){
+        unmap_file(data, size);
+        return false;
+    }
+    uint64_t expected = sizeof(ImageHeader) + 8ULL * header->num_strings
+                        + header->string_bytes + 4ULL * header->num_words;
+    if(expected != size){
+        unmap_file(data, size);
+        return false;
+    }
+    // a truncated or corrupted body is a miss, not a different program
+    if(fnv1a(FNV_OFFSET, data + sizeof(ImageHeader), size - sizeof(ImageHeader)) != header->checksum){
+        unmap_file(data, size);
+        return false;
+    }
+    r.index = (const uint32_t*)(data + sizeof(ImageHeader));
+    r.num_strings = header->num_strings;
+    r.bytes = (const char*)(r.index + 2 * header->num_strings);
+    r.pos = (const uint32_t*)(r.bytes + header->string_bytes);
+    r.end = r.pos + header->num_words;
+    for(uint32_t i = 0; i < r.num_strings; i++){
+        if((uint64_t)r.index[2 * i] + r.index[2 * i + 1] > header->string_bytes){
+            unmap_file(data, size);
+            return false;
+        }
+    }
+    return true;
+}
+
+static Type* read_type(ImageReader& r){
+    uint32_t kind = r.word();
+    if(kind == NO_STRING){
+        return NULL;
+    }
+    if(kind > Type::Any){
+        throw runtime_error{"Bad type in image"};
+    }
+    switch(kind){
+        case Type::Int:
+            return int_type();
+        case Type::Struct:
+            return struct_type(r.str());
+        case Type::Fn: {
+            vector<Type*> prms;
+            uint32_t n = r.count();
+            for(uint32_t i = 0; i < n; i++){
+                prms.push_back(read_type(r));
+            }
+            Type* ret = read_type(r);
+            return fn_type(prms, ret);
+        }
+        case Type::Ptr:
+            return ptr_type(read_type(r));
+        default:
+            return any_type();
+    }
+}
+
+static vector<Decl*> read_decls(ImageReader& r){
+    vector<Decl*> decls;
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        Decl* d = ast_new<Decl>();
+        r.str(d->name);
+        d->type = read_type(r);
+        decls.push_back(d);
+    }
+    return decls;
+}
+
+static Exp* read_exp(ImageReader& r){
+    uint32_t kind = r.word();
+    if(kind == NO_STRING){
+        return NULL;
+    }
+    if(kind > Exp::Call){
+        throw runtime_error{"Bad exp in image"};
+    }
+    Exp* e = ast_new<Exp>();
+    switch(kind){
+        case Exp::Num:
+            e->type = Exp::Num;
+            e->value.Num.n = (int32_t)r.word();
+            break;
+        case Exp::Id:
+            e->type = Exp::Id;
+            r.str(e->value.Id.name);
+            break;
+        case Exp::Nil:
+            e->type = Exp::Nil;
+            break;
+        case Exp::UnOp:
+            e->type = Exp::UnOp;
+            e->value.UnOp.op = ast_new<UnaryOp>();
+            e->value.UnOp.op->type = (enum UnaryOp::type)r.word();
+            e->value.UnOp.operand = read_exp(r);
+            break;
+        case Exp::BinOp:
+            e->type = Exp::BinOp;
+            e->value.BinOp.op = ast_new<BinaryOp>();
+            e->value.BinOp.op->type = (enum BinaryOp::type)r.word();
+            e->value.BinOp.left = read_exp(r);
+            e->value.BinOp.right = read_exp(r);
+            break;
+        case Exp::ArrayAccess:
+            e->type = Exp::ArrayAccess;
+            e->value.ArrayAccess.ptr = read_exp(r);
+            e->value.ArrayAccess.index = read_exp(r);
+            break;
+        case Exp::FieldAccess:
+            e->type = Exp::FieldAccess;
+            e->value.FieldAccess.ptr = read_exp(r);
+            r.str(e->value.FieldAccess.field);
+            break;
+        case Exp::Call: {
+            e->type = Exp::Call;
+            e->value.Call.callee = read_exp(r);
+            uint32_t n = r.count();
+            for(uint32_t i = 0; i < n; i++){
+                e->value.Call.args.push_back(read_exp(r));
+            }
+            break;
+        }
+    }
+    return e;
+}
+
+static Lval* read_lval(ImageReader& r){
+    uint32_t kind = r.word();
+    if(kind > Lval::FieldAccess){
+        throw runtime_error{"Bad lval in image"};
+    }
+    Lval* l = ast_new<Lval>();
+    switch(kind){
+        case Lval::Id:
+            l->type = Lval::Id;
+            r.str(l->value.Id.name);
+            break;
+        case Lval::Deref:
+            l->type = Lval::Deref;
+            l->value.Deref.lval = read_lval(r);
+            break;
+        case Lval::ArrayAccess:
+            l->type = Lval::ArrayAccess;
+            l->value.ArrayAccess.ptr = read_lval(r);
+            l->value.ArrayAccess.index = read_exp(r);
+            break;
+        case Lval::FieldAccess:
+            l->type = Lval::FieldAccess;
+            l->value.FieldAccess.ptr = read_lval(r);
+            r.str(l->value.FieldAccess.field);
+            break;
+    }
+    return l;
+}
+
+static vector<Stmt*> read_stmts(ImageReader& r);
+
+static Stmt* read_stmt(ImageReader& r){
+    uint32_t kind = r.word();
+    if(kind > Stmt::While){
+        throw runtime_error{"Bad stmt in image"};
+    }
+    Stmt* s = ast_new<Stmt>();
+    switch(kind){
+        case Stmt::Break:
+            s->type = Stmt::Break;
+            break;
+        case Stmt::Continue:
+            s->type = Stmt::Continue;
+            break;
+        case Stmt::Return:
+            s->type = Stmt::Return;
+            s->value.Return.exp = read_exp(r);
+            break;
+        case Stmt::Assign: {
+            s->type = Stmt::Assign;
+            s->value.Assign.lhs = read_lval(r);
+            Rhs* rhs = ast_new<Rhs>();
+            if(r.word() == Rhs::RhsExp){
+                rhs->type = Rhs::RhsExp;
+                rhs->value.RhsExp.exp = read_exp(r);
+            }
+            else{
+                rhs->type = Rhs::New;
+                rhs->value.New.type = read_type(r);
+                rhs->value.New.amount = read_exp(r);
+            }
+            s->value.Assign.rhs = rhs;
+            break;
+        }
+        case Stmt::Call: {
+            s->type = Stmt::Call;
+            s->value.Call.callee = read_lval(r);
+            uint32_t n = r.count();
+            for(uint32_t i = 0; i < n; i++){
+                s->value.Call.args.push_back(read_exp(r));
+            }
+            break;
+        }
+        case Stmt::If:
+            s->type = Stmt::If;
+            s->value.If.guard = read_exp(r);
+            s->value.If.tt = read_stmts(r);
+            s->value.If.ff = read_stmts(r);
+            break;
+        case Stmt::While:
+            s->type = Stmt::While;
+            s->value.While.guard = read_exp(r);
+            s->value.While.body = read_stmts(r);
+            break;
+    }
+    return s;
+}
+
+static vector<Stmt*> read_stmts(ImageReader& r){
+    vector<Stmt*> stmts;
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        stmts.push_back(read_stmt(r));
+    }
+    return stmts;
+}
+
+Program* load_ast_image(const string& path, uint64_t hash){
+    ImageReader r;
+    const char* data;
+    size_t size;
+    if(!open_image(path, "CFLA", AST_IMAGE_VERSION, hash, r, data, size)){
+        return NULL;
+    }
+    Program* prog = ast_new<Program>();
+    try{
+        prog->globals = read_decls(r);
+        uint32_t n = r.count();
+        for(uint32_t i = 0; i < n; i++){
+            Struct* s = ast_new<Struct>();
+            r.str(s->name);
+            s->fields = read_decls(r);
+            prog->structs.push_back(s);
+        }
+        prog->externs = read_decls(r);
+        n = r.count();
+        for(uint32_t i = 0; i < n; i++){
+            Function* f = ast_new<Function>();
+            r.str(f->name);
+            f->params = read_decls(r);
+            f->rettyp = read_type(r);
+            uint32_t num_locals = r.count();
+            for(uint32_t j = 0; j < num_locals; j++){
+                Decl* d = ast_new<Decl>();
+                r.str(d->name);
+                d->type = read_type(r);
+                f->locals.push_back(make_pair(d, read_exp(r)));
+            }
+            f->stmts = read_stmts(r);
+            prog->functions.push_back(f);
+        }
+    }
+    catch(const runtime_error& e){
+        prog = NULL;
+    }
+    unmap_file(data, size);
+    return prog;
+}
+
+static void read_type_map(ImageReader& r, map<string, Type*>& types){
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        string name = r.str();
+        types[name] = read_type(r);
+    }
+}
+
+static void read_vars(ImageReader& r, LIR_Function* func){
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        VarId id = func->intern_var(r.str());
+        if(id != (VarId)i){
+            throw runtime_error{"Duplicate variable in image"};
+        }
+        uint32_t flags = r.word();
+        if(flags & 1){
+            func->add_param(id, read_type(r));
+        }
+        if(flags & 2){
+            func->add_local(id, read_type(r));
+        }
+    }
+}
+
+// a BlockId of func; every block is interned before any terminal is read
+static BlockId read_block_id(ImageReader& r, LIR_Function* func){
+    uint32_t id = r.word();
+    if(id >= func->body.size()){
+        throw runtime_error{"Bad block id in image"};
+    }
+    return id;
+}
+
+// a VarId of func, or NO_VAR
+static VarId read_var(ImageReader& r, LIR_Function* func){
+    uint32_t id = r.word();
+    if(id == (uint32_t)NO_VAR){
+        return NO_VAR;
+    }
+    if(id >= func->vars.size()){
+        throw runtime_error{"Bad variable id in image"};
+    }
+    return id;
+}
+
+static Operand* read_operand(ImageReader& r, LIR_Function* func){
+    uint32_t kind = r.word();
+    if(kind == NO_STRING){
+        return NULL;
+    }
+    Operand* op;
+    if(kind == Operand::Const){
+        op = lir_new<Operand>(Operand::Const);
+        op->value.Const.num = (int32_t)r.word();
+    }
+    else if(kind == Operand::Var){
+        op = lir_new<Operand>(Operand::Var);
+        op->value.Var.id = read_var(r, func);
+    }
+    else{
+        throw runtime_error{"Bad operand in image"};
+    }
+    return op;
+}
+
+static void read_operands(ImageReader& r, LIR_Function* func, vector<Operand*>& ops){
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        ops.push_back(read_operand(r, func));
+    }
+}
+
+// a slot of inst that holds a VarId must name a variable of func
+static void check_slot(const LirInst& inst, int i, LIR_Function* func){
+    if(inst.is_var(i) && (uint32_t)inst.var(i) >= func->vars.size()){
+        throw runtime_error{"Bad variable id in image"};
+    }
+}
+
+static LirInst read_inst(ImageReader& r, LIR_Function* func){
+    uint32_t head = r.word();
+    LirInst inst((enum LirInst::type)(head & 0xff));
+    inst.op = head >> 8 & 0xff;
+    inst.var_slots = head >> 16 & 0xff;
+    inst.lhs = read_var(r, func);
+    inst.slot[0] = r.word();
+    inst.slot[1] = r.word();
+    inst.aux = r.word();
+    if(inst.type > LirInst::Store || inst.var_slots > 3 || head >> 24 != 0){
+        throw runtime_error{"Bad instruction in image"};
+    }
+    if((inst.type == LirInst::Arith && inst.op > ArithmeticOp::Div)
+        || (inst.type == LirInst::Cmp && inst.op > ComparisonOp::Gte)){
+        throw runtime_error{"Bad instruction in image"};
+    }
+    if((inst.type == LirInst::Gfp && (uint32_t)inst.aux >= func->fields.size())
+        || (inst.type == LirInst::CallExt && (uint32_t)inst.aux >= func->calls.size())){
+        throw runtime_error{"Bad instruction in image"};
+    }
+    check_slot(inst, 0, func);
+    check_slot(inst, 1, func);
+    return inst;
+}
+
+static void read_aux_tables(ImageReader& r, LIR_Function* func){
+    uint32_t n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        func->intern_field(r.str());
+    }
+    n = r.count();
+    for(uint32_t i = 0; i < n; i++){
+        string callee = r.str();
+        vector<Operand*> args;
+        read_operands(r, func, args);
+        func->add_call(callee, args);
+    }
+}
+
+static Terminal* read_terminal(ImageReader& r, LIR_Function* func){
+    uint32_t kind = r.word();
+    if(kind > Terminal::Ret){
+        throw runtime_error{"Bad terminal in image"};
+    }
+    Terminal* term = lir_new<Terminal>((enum Terminal::type)kind);
+    switch(term->type){
+        case Terminal::Branch:
+            term->value.Branch.guard = read_operand(r, func);
+            term->value.Branch.tt = read_block_id(r, func);
+            term->value.Branch.ff = read_block_id(r, func);
+            break;
+        case Terminal::CallDirect:
+            term->value.CallDirect.lhs = read_var(r, func);
+            r.str(term->value.CallDirect.callee);
+            read_operands(r, func, term->value.CallDirect.args);
+            term->value.CallDirect.next_bb = read_block_id(r, func);
+            break;
+        case Terminal::CallIndirect:
+            term->value.CallIndirect.lhs = read_var(r, func);
+            term->value.CallIndirect.callee = read_var(r, func);
+            read_operands(r, func, term->value.CallIndirect.args);
+            term->value.CallIndirect.next_bb = read_block_id(r, func);
+            break;
+        case Terminal::Jump:
+            term->value.Jump.next_bb = read_block_id(r, func);
+            break;
+        case Terminal::Ret:
+            term->value.Ret.op = read_operand(r, func);
+            break;
+    }
+    return term;
+}
+
+LIR_Program* load_lir_image(const string& path, uint64_t hash){
+    ImageReader r;
+    const char* data;
+    size_t size;
+    if(!open_image(path, "CFLL", LIR_IMAGE_VERSION, hash, r, data, size)){
+        return NULL;
+    }
+    LIR_Program* lir = lir_new<LIR_Program>();
+    try{
+        read_type_map(r, lir->globals);
+        uint32_t n = r.count();
+        for(uint32_t i = 0; i < n; i++){
+            string name = r.str();
+            read_type_map(r, lir->structs[name]);
+        }
+        read_type_map(r, lir->externs);
+        n = r.count();
+        for(uint32_t i = 0; i < n; i++){
+            LIR_Function* func = lir_new<LIR_Function>();
+            r.str(func->name);
+            read_vars(r, func);
+            func->rettyp = read_type(r);
+            read_aux_tables(r, func);
+            // the labels come first so terminals can refer to later blocks
+            uint32_t num_blocks = r.count();
+            for(uint32_t j = 0; j < num_blocks; j++){
+                if(func->intern_block(r.str()) != (BlockId)j){
+                    throw runtime_error{"Duplicate block in image"};
+                }
+            }
+            for(BasicBlock* bb : func->body){
+                bb->reachable = r.word() != 0;
+                uint32_t num_insts = r.count();
+                for(uint32_t k = 0; k < num_insts; k++){
+                    bb->insts.push_back(read_inst(r, func));
+                }
+                bb->term = read_terminal(r, func);
+            }
+            func->link_blocks();
+            lir->functions[func->name] = func;
+        }
+    }
+    catch(const runtime_error& e){
+        lir = NULL;
+    }
+    unmap_file(data, size);
+    return lir;
+}
@@ -0,0 +1,47 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "ast.hpp"
+#include "lower.hpp"
+
+using namespace std;
+
+/*
+ * Binary images of a Program or LIR_Program, for skipping the front end
+ * when the same input is compiled again.
+ *
+ * An image is a fixed header, a string table and a stream of 32-bit words
+ * that encode the nodes in pre-order:
+ *
+ *   header   magic, version, hash of the input, section sizes and a
+ *            checksum of the rest of the image
+ *   strings  {offset, length} per string, then the bytes (4-byte aligned)
+ *   words    node kinds, counts, numbers and string ids
+ *
+ * Images are read with one mmap; strings are copied straight out of the
+ * table and nodes are rebuilt in a single walk over the words.
+ */
+
+// Bump these when the encoding of the matching structures changes
+const uint32_t AST_IMAGE_VERSION = 2;
+const uint32_t LIR_IMAGE_VERSION = 6;
+
+// 64-bit FNV-1a hash of an input file, used as the cache key
+uint64_t hash_input(const char* data, size_t size, uint64_t seed);
+
+// Path of the cached image for hash in dir, without the extension
+string cache_path(const char* dir, uint64_t hash);
+
+// Write an image, returns false if the file could not be written
+bool save_ast_image(const string& path, Program* prog, uint64_t hash);
+bool save_lir_image(const string& path, LIR_Program* lir, uint64_t hash);
+
+// Read an image, returns NULL if it is missing, stale or malformed
+Program* load_ast_image(const string& path, uint64_t hash);
+LIR_Program* load_lir_image(const string& path, uint64_t hash);
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * Reverse post-order, dominator tree and dominance frontiers of a
+ * function, see cfg.hpp. Dominators are found with the iterative
+ * algorithm of Cooper, Harvey and Kennedy ("A Simple, Fast Dominance
+ * Algorithm"), which converges in a couple of passes over the blocks in
+ * reverse post-order for the CFGs lowering produces.
+ */
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "cfg.hpp"
+
+using namespace std;
+
+CFG::CFG(const LIR_Function* func):func(func){
+	size_t n = func->body.size();
+	entry = func->find_block("entry");
+	rpo_index.assign(n, -1);
+	idom.assign(n, NO_BLOCK);
+	dom_children.resize(n);
+	frontier.resize(n);
+	dom_first.assign(n, -1);
+	dom_last.assign(n, -1);
+	if(entry == NO_BLOCK){
+		return;
+	}
+	order_blocks();
+	find_dominators();
+	number_dominator_tree();
+	find_frontiers();
+}
+
+/*
+ * Depth first from entry, keeping for every block on the stack the index
+ * of the next successor to visit. A block is finished once all of them
+ * have been seen; the reverse of that order is rpo.
+ */
+void CFG::order_blocks(){
+	vector<bool> seen(func->body.size(), false);
+	vector<pair<BlockId, size_t>> stack;
+	stack.push_back(make_pair(entry, 0));
+	seen[entry] = true;
+	while(!stack.empty()){
+		BlockId id = stack.back().first;
+		const vector<BlockId>& succs = func->body[id]->succs;
+		if(stack.back().second < succs.size()){
+			BlockId succ = succs[stack.back().second++];
+			if(!seen[succ]){
+				seen[succ] = true;
+				stack.push_back(make_pair(succ, 0));
+			}
+			continue;
+		}
+		rpo.push_back(id);
+		stack.pop_back();
+	}
+	reverse(rpo.begin(), rpo.end());
+	for(size_t i = 0; i < rpo.size(); i++){
+		rpo_index[rpo[i]] = i;
+	}
+}
+
+void CFG::find_dominators(){
+	// walk both fingers up the tree until they meet; blocks later in rpo
+	// are never above earlier ones
+	auto intersect = [&](BlockId a, BlockId b){
+		while(a != b){
+			while(rpo_index[a] > rpo_index[b]){
+				a = idom[a];
+			}
+			while(rpo_index[b] > rpo_index[a]){
+				b = idom[b];
+			}
+		}
+		return a;
+	};
+
+	idom[entry] = entry;
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(size_t i = 1; i < rpo.size(); i++){
+			BlockId id = rpo[i];
+			BlockId new_idom = NO_BLOCK;
+			for(BlockId pred : func->body[id]->preds){
+				// only predecessors already given a dominator count
+				if(!reachable(pred) || idom[pred] == NO_BLOCK){
+					continue;
+				}
+				new_idom = new_idom == NO_BLOCK ? pred : intersect(pred, new_idom);
+			}
+			if(idom[id] != new_idom){
+				idom[id] = new_idom;
+				changed = true;
+			}
+		}
+	}
+	idom[entry] = NO_BLOCK;
+
+	for(size_t i = 1; i < rpo.size(); i++){
+		dom_children[idom[rpo[i]]].push_back(rpo[i]);
+	}
+}
+
+void CFG::number_dominator_tree(){
+	vector<pair<BlockId, size_t>> stack;
+	stack.push_back(make_pair(entry, 0));
+	dom_first[entry] = 0;
+	dom_order.push_back(entry);
+	while(!stack.empty()){
+		BlockId id = stack.back().first;
+		if(stack.back().second < dom_children[id].size()){
+			BlockId child = dom_children[id][stack.back().second++];
+			dom_first[child] = dom_order.size();
+			dom_order.push_back(child);
+			stack.push_back(make_pair(child, 0));
+			continue;
+		}
+		dom_last[id] = dom_order.size() - 1;
+		stack.pop_back();
+	}
+}
+
+/*
+ * A join point is in the frontier of every block that dominates one of
+ * its predecessors but not the join point itself: walk up from each
+ * predecessor to the join point's immediate dominator.
+ */
+void CFG::find_frontiers(){
+	for(BlockId id : rpo){
+		const vector<BlockId>& preds = func->body[id]->preds;
+		if(preds.size() < 2 && id != entry){
+			continue;
+		}
+		for(BlockId pred : preds){
+			if(!reachable(pred)){
+				continue;
+			}
+			for(BlockId runner = pred; runner != NO_BLOCK && runner != idom[id]; runner = idom[runner]){
+				if(frontier[runner].empty() || frontier[runner].back() != id){
+					frontier[runner].push_back(id);
+				}
+			}
+		}
+	}
+}
+
+bool CFG::dominates(BlockId a, BlockId b) const {
+	if(!reachable(a) || !reachable(b)){
+		return false;
+	}
+	return dom_first[a] <= dom_first[b] && dom_first[b] <= dom_last[a];
+}
@@ -0,0 +1,53 @@
+#ifndef CFG_HPP
+#define CFG_HPP
+
+#include <vector>
+
+#include "lower.hpp"
+
+using namespace std;
+
+/*
+ * Control flow facts about one LIR_Function, worked out once so the passes
+ * that need them can share them. The walks use explicit work lists, so a
+ * long chain of blocks cannot overflow the call stack.
+ *
+ * The edges are read from the succs and preds of the blocks, which must be
+ * up to date (LIR_Function::link_blocks); once a pass changes the edges
+ * a new CFG has to be built. Only blocks reachable from entry take part.
+ * Every per-block vector is indexed by BlockId and holds -1, NO_BLOCK or
+ * nothing for the others.
+ */
+struct CFG {
+	const LIR_Function* func;
+	BlockId entry;
+	// the reachable blocks in reverse post-order from entry
+	vector<BlockId> rpo;
+	// where each block is in rpo, -1 if it is unreachable
+	vector<int> rpo_index;
+	// immediate dominator, NO_BLOCK for entry and unreachable blocks
+	vector<BlockId> idom;
+	// the dominator tree: children in rpo order, and the whole tree in
+	// pre-order (parents before children)
+	vector<vector<BlockId>> dom_children;
+	vector<BlockId> dom_order;
+	// the blocks where the dominance of each block ends
+	vector<vector<BlockId>> frontier;
+
+	CFG(const LIR_Function* func);
+	bool reachable(BlockId id) const { return rpo_index[id] >= 0; }
+	// a dominates b; a block dominates itself
+	bool dominates(BlockId a, BlockId b) const;
+
+private:
+	// pre-order number and the last pre-order number below each block in
+	// the dominator tree, for constant time dominates()
+	vector<int> dom_first;
+	vector<int> dom_last;
+	void order_blocks();
+	void find_dominators();
+	void number_dominator_tree();
+	void find_frontiers();
+};
+
+#endif
@@ -10,43 +10,72 @@
 
 using namespace std;
 
-unordered_map<string, unordered_map<string, int>> varOffsets;
+// Per-compilation state, one copy per thread so programs can be compiled
+// concurrently (see run_batch). reset_codegen() clears it between programs.
+thread_local ostream* asm_out = &cout;
 
-unordered_set<string> global_var;
+// Where each variable of the function being generated lives, by VarId:
+// its frame offset (0 if it has none) and its operand string
+thread_local vector<int> varOffsets;
+thread_local vector<string> varHomes;
 
-unordered_set<string> global_fn;
+// The assembly label of each block of the function being generated, by BlockId
+thread_local vector<string> blockLabels;
 
-unordered_map<string, unordered_map<string, int>> structOffsets;
+thread_local unordered_set<string> global_var;
 
-unordered_map<string, unordered_map<string, string>> varStructType;
+thread_local unordered_set<string> global_fn;
 
-// get the correct variable stack offset, or return the variable name if it is a global variable
-string get_var_stack(string var, string funcName){
-    if(varOffsets[funcName].find(var) != varOffsets[funcName].end()){
-        return to_string(varOffsets[funcName][var]) + "(%rbp)";
-    }
-    else if(global_var.find(var) != global_var.end()){
-        return var + "(%rip)";
-    }
-    else if(global_fn.find(var) != global_fn.end()){
-        return var + "_(%rip)";
+thread_local unordered_map<string, unordered_map<string, int>> structOffsets;
+
+// struct a global points to, and the struct each variable of the function
+// being generated points to ("" if none)
+thread_local unordered_map<string, string> globalStructType;
+thread_local vector<string> varStructType;
+
+void reset_codegen(){
+    varOffsets.clear();
+    varHomes.clear();
+    blockLabels.clear();
+    global_var.clear();
+    global_fn.clear();
+    structOffsets.clear();
+    globalStructType.clear();
+    varStructType.clear();
+}
+
+// get the correct variable stack offset, or the variable name if it is a global variable
+const string& get_var_stack(VarId var){
+    static const string error = "ERROR";
+    if(var == NO_VAR){
+        return error;
     }
-    return "ERROR";
+    return varHomes[var];
 }
 
 void LIR_Program::codeGenString(){
-    cout << ".data\n" << endl;
+    codeGenHeader();
+    for(auto it = functions.begin(); it != functions.end(); it++){
+        *asm_out << ".globl " << it->first << endl;
+        it->second->codeGenString();
+    }
+    codeGenFooter();
+}
+
+// .data section with the globals, the struct offsets and the start of .text
+void LIR_Program::codeGenHeader(){
+    *asm_out << ".data\n" << endl;
     // generate global variables
     //We need to initialize globals differently if its a function vs a variable
     for(auto it = globals.begin(); it != globals.end(); it++){
         if(it->second->type == Type::Ptr && it->second->value.Ptr.ref->type == Type::Fn){
-            cout << ".globl " << it->first << "_" << endl;
-            cout << it->first << "_: .quad \"" << it->first << "\"" << endl << endl << endl;
+            *asm_out << ".globl " << it->first << "_" << endl;
+            *asm_out << it->first << "_: .quad \"" << it->first << "\"" << endl << endl << endl;
             global_fn.insert(it->first);
         }
         else{
-            cout << ".globl " << it->first << endl;
-            cout << it->first << ": .zero 8" << endl << endl << endl;
+            *asm_out << ".globl " << it->first << endl;
+            *asm_out << it->first << ": .zero 8" << endl << endl << endl;
             global_var.insert(it->first);
         }
     }
@@ -63,222 +92,277 @@ void LIR_Program::codeGenString(){
     // generate global variable offset into varStructType
     for(auto it = globals.begin(); it != globals.end(); it++){
         if(it->second && it->second->type == Type::Ptr && it->second->value.Ptr.ref->type == Type::Struct){
-            varStructType["global"][it->first] = it->second->value.Ptr.ref->value.Struct.name;
+            globalStructType[it->first] = it->second->value.Ptr.ref->value.Struct.name;
         }
     }
         
 
-    cout << "out_of_bounds_msg: .string \"out-of-bounds array access\"\ninvalid_alloc_msg: .string \"invalid allocation amount\"\n        \n.text\n\n";
+    *asm_out << "out_of_bounds_msg: .string \"out-of-bounds array access\"\ninvalid_alloc_msg: .string \"invalid allocation amount\"\n        \n.text\n\n";
+}
 
-        
-    for(auto it = functions.begin(); it != functions.end(); it++){
-        cout << ".globl " << it->first << endl;
-        it->second->codeGenString();
-    }
+// the shared panic blocks that follow the last function
+void LIR_Program::codeGenFooter(){
     //.out_of_bounds:
-    cout << ".out_of_bounds:" << endl;
-    cout << "  lea out_of_bounds_msg(%rip), %rdi" << endl;
-    cout << "  call _cflat_panic\n" << endl;
+    *asm_out << ".out_of_bounds:" << endl;
+    *asm_out << "  lea out_of_bounds_msg(%rip), %rdi" << endl;
+    *asm_out << "  call _cflat_panic\n" << endl;
 
     //.invalid_alloc_length:
-    cout << ".invalid_alloc_length:" << endl;
-    cout << "  lea invalid_alloc_msg(%rip), %rdi" << endl;
-    cout << "  call _cflat_panic" << endl;
-    cout << "        " << endl;
+    *asm_out << ".invalid_alloc_length:" << endl;
+    *asm_out << "  lea invalid_alloc_msg(%rip), %rdi" << endl;
+    *asm_out << "  call _cflat_panic" << endl;
+    *asm_out << "        " << endl;
 }
 
 void LIR_Function::codeGenString(){
 
-    cout << name << ":" << endl;
+    *asm_out << name << ":" << endl;
     
     // prologue
-    cout << "  pushq %rbp\n  movq %rsp, %rbp" << endl;
-    int stack_size = locals.size() * 8;
+    *asm_out << "  pushq %rbp\n  movq %rsp, %rbp" << endl;
+    int stack_size = num_locals * 8;
     if(stack_size % 16 != 0)
         stack_size += 8;
 
     // this is how much space we need for locals
-    cout << "  subq $" << stack_size << ", %rsp" << endl;
+    *asm_out << "  subq $" << stack_size << ", %rsp" << endl;
 
     // ensure that size > 0
 
-    auto it = params.begin();
-    for(int i = 16; i <= params.size() * 8 + 8; i += 8){
-        if(it->second && it->second->type == Type::Ptr && it->second->value.Ptr.ref->type == Type::Struct){
-            varStructType[name][it->first] = it->second->value.Ptr.ref->value.Struct.name;
-        }
-        varOffsets[name][it->first] = i;
-        it++;
+    // frame slots are handed out in name order, parameters first
+    varOffsets.assign(vars.size(), 0);
+    varStructType.assign(vars.size(), "");
+    vector<bool> in_frame(vars.size(), false);
+    int i = 16;
+    for(VarId id : params_by_name()){
+        Type* t = param_type(id);
+        if(t && t->type == Type::Ptr && t->value.Ptr.ref->type == Type::Struct){
+            varStructType[id] = t->value.Ptr.ref->value.Struct.name;
+        }
+        varOffsets[id] = i;
+        in_frame[id] = true;
+        i += 8;
     }
     if (stack_size > 0){
         // zero out all local variables
-        auto it = locals.begin();
-        for(int i = -8; i >= -locals.size() * 8; i -= 8){
-            if(it->second && it->second->type == Type::Ptr && it->second->value.Ptr.ref->type == Type::Struct){
-                varStructType[name][it->first] = it->second->value.Ptr.ref->value.Struct.name;
+        int i = -8;
+        for(VarId id : locals_by_name()){
+            Type* t = local_type(id);
+            if(t && t->type == Type::Ptr && t->value.Ptr.ref->type == Type::Struct){
+                varStructType[id] = t->value.Ptr.ref->value.Struct.name;
             }
-            cout << "  movq $0, " << i << "(%rbp)" << endl;
-            varOffsets[name][it->first] = i;
-            it++;
+            *asm_out << "  movq $0, " << i << "(%rbp)" << endl;
+            varOffsets[id] = i;
+            in_frame[id] = true;
+            i -= 8;
         }
     }
-    cout << "  jmp " << name << "_entry" << endl;
-    cout << endl;
+    // everything else is a global, looked up by name once per function
+    varHomes.assign(vars.size(), "");
+    for(VarId id = 0; id < (VarId)vars.size(); id++){
+        const string& var = var_name(id);
+        if(in_frame[id]){
+            varHomes[id] = to_string(varOffsets[id]) + "(%rbp)";
+            if(varStructType[id] != ""){
+                continue;
+            }
+        }
+        else if(global_var.find(var) != global_var.end()){
+            varHomes[id] = var + "(%rip)";
+        }
+        else if(global_fn.find(var) != global_fn.end()){
+            varHomes[id] = var + "_(%rip)";
+        }
+        else{
+            varHomes[id] = "ERROR";
+        }
+        auto it = globalStructType.find(var);
+        if(it != globalStructType.end()){
+            varStructType[id] = it->second;
+        }
+    }
+    *asm_out << "  jmp " << name << "_entry" << endl;
+    *asm_out << endl;
 
-    // generate code for each basic block
-    for(auto it = body.begin(); it != body.end(); it++){
-        if(it->second->reachable == false)
+    blockLabels.resize(body.size());
+    for(BlockId id = 0; id < (BlockId)body.size(); id++){
+        blockLabels[id] = name + "_" + body[id]->label;
+    }
+
+    // generate code for each basic block, in label order
+    for(BlockId id : blocks_by_label()){
+        if(body[id]->reachable == false)
             continue;
-        cout << name << "_" << it->second->label << ":" << endl;
-        it->second->codeGenString(name);
+        *asm_out << blockLabels[id] << ":" << endl;
+        body[id]->codeGenString(this);
     }
 
     // epilogue
-    cout << name << "_epilogue:" << endl;
-    cout << "  movq %rbp, %rsp" << endl;
-    cout << "  popq %rbp" << endl;
-    cout << "  ret\n" << endl;
+    *asm_out << name << "_epilogue:" << endl;
+    *asm_out << "  movq %rbp, %rsp" << endl;
+    *asm_out << "  popq %rbp" << endl;
+    *asm_out << "  ret\n" << endl;
+
+    // the offsets are only needed while generating this function
+    varOffsets.clear();
+    varHomes.clear();
+    varStructType.clear();
+    blockLabels.clear();
 
 }
 
-void BasicBlock::codeGenString(string funcName){
-    for(auto it = insts.begin(); it != insts.end(); it++){
-        (*it)->codeGenString(funcName);
+void BasicBlock::codeGenString(const LIR_Function* func){
+    for(const LirInst& inst : insts){
+        inst.codeGenString(func);
     }
-    term->codeGenString(funcName);
+    term->codeGenString(func->name);
+
+    *asm_out << endl;
+}
 
-    cout << endl;
+// where slot i of inst lives, like Operand::codeGenString
+static string slot_string(const LirInst& inst, int i){
+    if(inst.is_var(i)){
+        return get_var_stack(inst.var(i));
+    }
+    return "$" + to_string(inst.num(i));
 }
 
-// enum type{Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Load, Store} type;
-void LirInst::codeGenString(string funcName){
+// enum type{Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Len, Load, Store} type;
+void LirInst::codeGenString(const LIR_Function* func) const {
     if(type == LirInst::Alloc){
-        bool num_is_const = value.Alloc.num->type == Operand::Const;
+        bool num_is_const = !is_var(0);
         if(num_is_const){
-            cout << "  movq " << value.Alloc.num->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  cmpq $0, %r8" << endl;
+            *asm_out << "  movq " << slot_string(*this, 0) << ", %r8" << endl;
+            *asm_out << "  cmpq $0, %r8" << endl;
         }
         else{
-            cout << "  cmpq $0, " << value.Alloc.num->codeGenString(funcName) << endl;
+            *asm_out << "  cmpq $0, " << slot_string(*this, 0) << endl;
         }
-        cout << "  jle .invalid_alloc_length" << endl;
-        cout << "  movq $1, %rdi" << endl;
+        *asm_out << "  jle .invalid_alloc_length" << endl;
+        *asm_out << "  movq $1, %rdi" << endl;
         if(num_is_const)
-            cout << "  imulq %r8, %rdi" << endl;
+            *asm_out << "  imulq %r8, %rdi" << endl;
         else
-            cout << "  imulq " << value.Alloc.num->codeGenString(funcName) << ", %rdi" << endl;
-        cout << "  incq %rdi" << endl;
-        cout << "  call _cflat_alloc" << endl;
-        cout << "  movq " << value.Alloc.num->codeGenString(funcName) << ", %r8" << endl;
-        cout << "  movq %r8, 0(%rax)" << endl;
-        cout << "  addq $8, %rax" << endl;
-        cout << "  movq %rax, " << get_var_stack(value.Alloc.lhs, funcName) << endl;
+            *asm_out << "  imulq " << slot_string(*this, 0) << ", %rdi" << endl;
+        *asm_out << "  incq %rdi" << endl;
+        *asm_out << "  call _cflat_alloc" << endl;
+        *asm_out << "  movq " << slot_string(*this, 0) << ", %r8" << endl;
+        *asm_out << "  movq %r8, 0(%rax)" << endl;
+        *asm_out << "  addq $8, %rax" << endl;
+        *asm_out << "  movq %rax, " << get_var_stack(lhs) << endl;
     } else if(type == LirInst::Arith){
-        if(value.Arith.aop->type == ArithmeticOp::Div){
-            cout << "  movq " << value.Arith.left->codeGenString(funcName) << ", %rax" << endl;
-            cout << "  cqo" << endl;
-            if(value.Arith.right->type == Operand::Const){
-                cout << "  movq " << value.Arith.right->codeGenString(funcName) << ", %r8" << endl;
-                cout << "  idivq %r8" << endl;
+        if(op == ArithmeticOp::Div){
+            *asm_out << "  movq " << slot_string(*this, 0) << ", %rax" << endl;
+            *asm_out << "  cqo" << endl;
+            if(!is_var(1)){
+                *asm_out << "  movq " << slot_string(*this, 1) << ", %r8" << endl;
+                *asm_out << "  idivq %r8" << endl;
             }
             else {
-                cout << "  idivq " << value.Arith.right->codeGenString(funcName) << endl;
+                *asm_out << "  idivq " << slot_string(*this, 1) << endl;
             }
-            cout << "  movq %rax, " << get_var_stack(value.Arith.lhs, funcName) << endl;
+            *asm_out << "  movq %rax, " << get_var_stack(lhs) << endl;
         }
         else{
-            cout << "  movq " << value.Arith.left->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  " << value.Arith.aop->codeGenString() << " " << value.Arith.right->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  movq %r8, " << get_var_stack(value.Arith.lhs, funcName) << endl;
+            *asm_out << "  movq " << slot_string(*this, 0) << ", %r8" << endl;
+            *asm_out << "  " << ArithmeticOp((enum ArithmeticOp::type)op).codeGenString() << " " << slot_string(*this, 1) << ", %r8" << endl;
+            *asm_out << "  movq %r8, " << get_var_stack(lhs) << endl;
         }
     } else if(type == LirInst::CallExt){
+        const vector<Operand*>& args = func->call(*this).args;
         int stack_size = 0;
 
         // first 6 arguments are passed in registers
-        if(value.CallExt.args.size() >= 1){
-            cout << "  movq " << value.CallExt.args[0]->codeGenString(funcName) << ", %rdi" << endl;
+        if(args.size() >= 1){
+            *asm_out << "  movq " << args[0]->codeGenString(func->name) << ", %rdi" << endl;
         }
-        if(value.CallExt.args.size() >= 2){
-            cout << "  movq " << value.CallExt.args[1]->codeGenString(funcName) << ", %rsi" << endl;
+        if(args.size() >= 2){
+            *asm_out << "  movq " << args[1]->codeGenString(func->name) << ", %rsi" << endl;
         }
-        if(value.CallExt.args.size() >= 3){
-            cout << "  movq " << value.CallExt.args[2]->codeGenString(funcName) << ", %rdx" << endl;
+        if(args.size() >= 3){
+            *asm_out << "  movq " << args[2]->codeGenString(func->name) << ", %rdx" << endl;
         }
-        if(value.CallExt.args.size() >= 4){
-            cout << "  movq " << value.CallExt.args[3]->codeGenString(funcName) << ", %rcx" << endl;
+        if(args.size() >= 4){
+            *asm_out << "  movq " << args[3]->codeGenString(func->name) << ", %rcx" << endl;
         }
-        if(value.CallExt.args.size() >= 5){
-            cout << "  movq " << value.CallExt.args[4]->codeGenString(funcName) << ", %r8" << endl;
+        if(args.size() >= 5){
+            *asm_out << "  movq " << args[4]->codeGenString(func->name) << ", %r8" << endl;
         }
-        if(value.CallExt.args.size() >= 6){
-            cout << "  movq " << value.CallExt.args[5]->codeGenString(funcName) << ", %r9" << endl;
+        if(args.size() >= 6){
+            *asm_out << "  movq " << args[5]->codeGenString(func->name) << ", %r9" << endl;
         }
         // if there are more than 6 arguments, push them onto the stack
-        if(value.CallExt.args.size() > 6){
-            for(int i = value.CallExt.args.size() - 1; i >= 6; i--){
-                cout << "  pushq " << value.CallExt.args[i]->codeGenString(funcName) << endl;
+        if(args.size() > 6){
+            for(int i = args.size() - 1; i >= 6; i--){
+                *asm_out << "  pushq " << args[i]->codeGenString(func->name) << endl;
                 stack_size += 8;
             }
             // align the stack
             if(stack_size % 16 != 0){
                 stack_size += 8;
-                cout << "  subq $" << 8 << ", %rsp" << endl;
+                *asm_out << "  subq $" << 8 << ", %rsp" << endl;
             }
         }
-        cout << "  call " << value.CallExt.callee << endl;
+        *asm_out << "  call " << func->call(*this).callee << endl;
         // only return if it is an assignment
-        if(value.CallExt.lhs != ""){
-            cout << "  movq %rax, " << get_var_stack(value.CallExt.lhs, funcName) << endl;
+        if(lhs != NO_VAR){
+            *asm_out << "  movq %rax, " << get_var_stack(lhs) << endl;
         }
         if(stack_size > 0){
-            cout << "  addq $" << stack_size << ", %rsp" << endl;
+            *asm_out << "  addq $" << stack_size << ", %rsp" << endl;
         }
     } else if(type == LirInst::Cmp){
-        if(value.Cmp.right->type != Operand::Const || (value.Cmp.right->type == Operand::Const && value.Cmp.left->type == Operand::Const)){
-            cout << "  movq " << value.Cmp.left->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  cmpq " << value.Cmp.right->codeGenString(funcName) << ", %r8" << endl;
+        if(is_var(1) || !is_var(0)){
+            *asm_out << "  movq " << slot_string(*this, 0) << ", %r8" << endl;
+            *asm_out << "  cmpq " << slot_string(*this, 1) << ", %r8" << endl;
         }
         else{
-            cout << "  cmpq " << value.Cmp.right->codeGenString(funcName) << ", " << value.Cmp.left->codeGenString(funcName) << endl;
+            *asm_out << "  cmpq " << slot_string(*this, 1) << ", " << slot_string(*this, 0) << endl;
         }
-        cout << "  movq $0, %r8" << endl;
-        cout << "  " << value.Cmp.aop->codeGenString() << " %r8b" << endl;
-        cout << "  movq %r8, " << get_var_stack(value.Cmp.lhs, funcName) << endl;
+        *asm_out << "  movq $0, %r8" << endl;
+        *asm_out << "  " << ComparisonOp((enum ComparisonOp::type)op).codeGenString() << " %r8b" << endl;
+        *asm_out << "  movq %r8, " << get_var_stack(lhs) << endl;
     } else if(type == LirInst::Copy){
-        if(value.Copy.op->type == Operand::Const){
-            cout << "  movq " << value.Copy.op->codeGenString(funcName) << ", " << get_var_stack(value.Copy.lhs, funcName) << endl;
-        } else if(value.Copy.op->type == Operand::Var){
-            cout << "  movq " << value.Copy.op->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  movq %r8, " << get_var_stack(value.Copy.lhs, funcName) << endl;
+        if(!is_var(0)){
+            *asm_out << "  movq " << slot_string(*this, 0) << ", " << get_var_stack(lhs) << endl;
+        } else if(is_var(0)){
+            *asm_out << "  movq " << slot_string(*this, 0) << ", %r8" << endl;
+            *asm_out << "  movq %r8, " << get_var_stack(lhs) << endl;
         }
     } else if(type == LirInst::Gep){
-        cout << "  movq " << value.Gep.idx->codeGenString(funcName) << ", %r8" << endl;
-        cout << "  cmpq $0, %r8" << endl;
-        cout << "  jl .out_of_bounds" << endl;
-        cout << "  movq " << get_var_stack(value.Gep.src, funcName) << ", %r9" << endl;
-        cout << "  movq -8(%r9), %r10" << endl;
-        cout << "  cmpq %r10, %r8" << endl;
-        cout << "  jge .out_of_bounds" << endl;
-        cout << "  imulq $8, %r8" << endl;
-        cout << "  addq %r9, %r8" << endl;
-        cout << "  movq %r8, " << get_var_stack(value.Gep.lhs, funcName) << endl;
-    } else if(type == LirInst::Gfp){
-        cout << "  movq " << get_var_stack(value.Gfp.src, funcName) << ", %r8" << endl;
-        if(varStructType[funcName].find(value.Gfp.src) != varStructType[funcName].end()){
-            cout << "  leaq " << structOffsets[varStructType[funcName][value.Gfp.src]][value.Gfp.field] << "(%r8), %r9" << endl;
+        *asm_out << "  movq " << slot_string(*this, 1) << ", %r8" << endl;
+        if(op == LirInst::InBounds){
+            *asm_out << "  movq " << get_var_stack(var(0)) << ", %r9" << endl;
         }
         else{
-            cout << "  leaq " << structOffsets[varStructType["global"][value.Gfp.src]][value.Gfp.field] << "(%r8), %r9" << endl;
-        }
-        cout << "  movq %r9, " << get_var_stack(value.Gfp.lhs, funcName) << endl;
+            *asm_out << "  cmpq $0, %r8" << endl;
+            *asm_out << "  jl .out_of_bounds" << endl;
+            *asm_out << "  movq " << get_var_stack(var(0)) << ", %r9" << endl;
+            *asm_out << "  movq -8(%r9), %r10" << endl;
+            *asm_out << "  cmpq %r10, %r8" << endl;
+            *asm_out << "  jge .out_of_bounds" << endl;
+        }
+        *asm_out << "  imulq $8, %r8" << endl;
+        *asm_out << "  addq %r9, %r8" << endl;
+        *asm_out << "  movq %r8, " << get_var_stack(lhs) << endl;
+    } else if(type == LirInst::Gfp){
+        *asm_out << "  movq " << get_var_stack(var(0)) << ", %r8" << endl;
+        *asm_out << "  leaq " << structOffsets[varStructType[var(0)]][func->field(*this)] << "(%r8), %r9" << endl;
+        *asm_out << "  movq %r9, " << get_var_stack(lhs) << endl;
+    } else if(type == LirInst::Len){
+        // an array's length sits just below its first element
+        *asm_out << "  movq " << get_var_stack(var(0)) << ", %r8" << endl;
+        *asm_out << "  movq -8(%r8), %r9" << endl;
+        *asm_out << "  movq %r9, " << get_var_stack(lhs) << endl;
     } else if(type == LirInst::Load){
-        cout << "  movq " << get_var_stack(value.Load.src, funcName) << ", %r8" << endl;
-        cout << "  movq 0(%r8), %r9" << endl;
-        cout << "  movq %r9, " << get_var_stack(value.Load.lhs, funcName) << endl;
+        *asm_out << "  movq " << get_var_stack(var(0)) << ", %r8" << endl;
+        *asm_out << "  movq 0(%r8), %r9" << endl;
+        *asm_out << "  movq %r9, " << get_var_stack(lhs) << endl;
     } else if(type == LirInst::Store){
-        cout << "  movq " << value.Store.op->codeGenString(funcName) << ", %r8" << endl;
-        cout << "  movq " << get_var_stack(value.Store.dst, funcName) << ", %r9" << endl;
-        cout << "  movq %r8, 0(%r9)" << endl;
+        *asm_out << "  movq " << slot_string(*this, 1) << ", %r8" << endl;
+        *asm_out << "  movq " << get_var_stack(var(0)) << ", %r9" << endl;
+        *asm_out << "  movq %r8, 0(%r9)" << endl;
     }
 }
 	// enum type{Branch, CallDirect, CallIndirect, Jump, Ret} type;
@@ -290,31 +374,31 @@ void Terminal::codeGenString(string funcName){
         // jmp main_lbl9
         //Step 1: Compare op to 0, set the codes
         if(value.Branch.guard->type == Operand::Var){
-            cout << "  cmpq $0, " << value.Branch.guard->codeGenString(funcName) << endl;
-            cout << "  jne " << funcName << "_" << value.Branch.tt << endl;
-            cout << "  jmp " << funcName << "_" << value.Branch.ff << endl;
+            *asm_out << "  cmpq $0, " << value.Branch.guard->codeGenString(funcName) << endl;
+            *asm_out << "  jne " << blockLabels[value.Branch.tt] << endl;
+            *asm_out << "  jmp " << blockLabels[value.Branch.ff] << endl;
         }
         else if(value.Branch.guard->type == Operand::Const){
-            cout << "  movq " << value.Branch.guard->codeGenString(funcName) << ", %r8" << endl;
-            cout << "  cmpq $0, %r8" << endl;
-            cout << "  jne " << funcName << "_" << value.Branch.tt << endl;
-            cout << "  jmp " << funcName << "_" << value.Branch.ff << endl;
+            *asm_out << "  movq " << value.Branch.guard->codeGenString(funcName) << ", %r8" << endl;
+            *asm_out << "  cmpq $0, %r8" << endl;
+            *asm_out << "  jne " << blockLabels[value.Branch.tt] << endl;
+            *asm_out << "  jmp " << blockLabels[value.Branch.ff] << endl;
         } else {
-            cout << "uh ohh gen" << endl;
+            *asm_out << "uh ohh gen" << endl;
         }
     } else if(type == Terminal::CallDirect){
         // push op1...opn in reverse order to the stack
         int stack_count = 0;
         if(value.CallDirect.args.size() % 2 != 0)
-            cout << "  subq $8, %rsp" << endl;
+            *asm_out << "  subq $8, %rsp" << endl;
         for (auto it = value.CallDirect.args.rbegin(); it != value.CallDirect.args.rend(); ++it) {
             stack_count+=8;
             Operand* op = *it;  
             if(op->type == Operand::Var){
-                cout << "  pushq " << op->codeGenString(funcName) << endl;
+                *asm_out << "  pushq " << op->codeGenString(funcName) << endl;
             }
             else{
-                cout << "  pushq $" << op->value.Const.num << endl;
+                *asm_out << "  pushq $" << op->value.Const.num << endl;
             }  
         } 
         // TODO: fix stack alignment - make it divisible by 16 for edge case
@@ -322,30 +406,30 @@ void Terminal::codeGenString(string funcName){
             stack_count += 8;
         }
         // call foo
-        cout << "  call " << value.CallDirect.callee << endl;
+        *asm_out << "  call " << value.CallDirect.callee << endl;
         // store %rax to x
-        if(value.CallDirect.lhs != ""){
-            cout << "  movq %rax, " << varOffsets[funcName][value.CallDirect.lhs] << "(%rbp)" << endl;
+        if(value.CallDirect.lhs != NO_VAR){
+            *asm_out << "  movq %rax, " << varOffsets[value.CallDirect.lhs] << "(%rbp)" << endl;
         }
         // restore stack pointer <-- this was first on ben's notes
         if(stack_count > 0){
-            cout << "  addq $" << stack_count << ", %rsp" << endl;
+            *asm_out << "  addq $" << stack_count << ", %rsp" << endl;
         }
         // jump to bb
-        cout << "  jmp " << funcName << "_" << value.CallDirect.next_bb << endl;
+        *asm_out << "  jmp " << blockLabels[value.CallDirect.next_bb] << endl;
     } else if(type == Terminal::CallIndirect){
         // push op1...opn in reverse order to the stack
         int stack_count = 0;
         if(value.CallIndirect.args.size() % 2 != 0)
-            cout << "  subq $8, %rsp" << endl;
+            *asm_out << "  subq $8, %rsp" << endl;
         for (auto it = value.CallIndirect.args.rbegin(); it != value.CallIndirect.args.rend(); ++it) {
             stack_count+=8;
             Operand* op = *it;
             if(op->type == Operand::Var){
-                cout << "  pushq " << op->codeGenString(funcName) << endl;
+                *asm_out << "  pushq " << op->codeGenString(funcName) << endl;
             }
             else{
-                cout << "  pushq $" << op->value.Const.num << endl;
+                *asm_out << "  pushq $" << op->value.Const.num << endl;
             }  
         } 
         // TODO: fix stack alignment - make it divisible by 16 for edge case
@@ -353,31 +437,31 @@ void Terminal::codeGenString(string funcName){
             stack_count += 8;
         }
         // call foo
-        cout << "  call *" << varOffsets[funcName][value.CallIndirect.callee] << "(%rbp)" <<endl;
+        *asm_out << "  call *" << varOffsets[value.CallIndirect.callee] << "(%rbp)" <<endl;
         // store %rax to x
-        if(value.CallIndirect.lhs != ""){
-            cout << "  movq %rax, " << varOffsets[funcName][value.CallIndirect.lhs] << "(%rbp)" << endl;
+        if(value.CallIndirect.lhs != NO_VAR){
+            *asm_out << "  movq %rax, " << varOffsets[value.CallIndirect.lhs] << "(%rbp)" << endl;
         }
         // restore stack pointer <-- this was first on ben's notes
         if(stack_count > 0){
-            cout << "  addq $" << stack_count << ", %rsp" << endl;
+            *asm_out << "  addq $" << stack_count << ", %rsp" << endl;
         }
         // jump to bb
-        cout << "  jmp " << funcName << "_" << value.CallDirect.next_bb << endl;
+        *asm_out << "  jmp " << blockLabels[value.CallIndirect.next_bb] << endl;
     } else if(type == Terminal::Jump){
-        cout << "  jmp " << funcName << "_" << value.Jump.next_bb << endl;
+        *asm_out << "  jmp " << blockLabels[value.Jump.next_bb] << endl;
     } else if(type == Terminal::Ret){
         // $ret op
         // return value goes into a specific register (%rax)
-        cout << "  movq " << value.Ret.op->codeGenString(funcName) << ", %rax" << endl;
-        cout << "  jmp " << funcName << "_epilogue" << endl;
+        *asm_out << "  movq " << value.Ret.op->codeGenString(funcName) << ", %rax" << endl;
+        *asm_out << "  jmp " << funcName << "_epilogue" << endl;
         // then jump to main_epilogue
     }
 }
 
 string Operand::codeGenString(string funcName){
     if(type == Operand::Var){
-        return get_var_stack(value.Var.id, funcName);
+        return get_var_stack(value.Var.id);
     } else if(type == Operand::Const){
         return "$" + to_string(value.Const.num);
     }
@@ -0,0 +1,233 @@
+/**
+ * Copy propagation and dead code elimination over a function in SSA
+ * form, and dropping the locals nothing refers to any more.
+ *
+ * In SSA form a copy x = y can be undone by reading y wherever x is read,
+ * as long as y cannot change in between: a parameter or local (every
+ * version is assigned once) but not a global. A phi whose arguments are
+ * all the same variable, or the phi itself around a loop, is a copy too.
+ *
+ * Dead code elimination starts from what has to stay: terminals, stores,
+ * calls, and the instructions that can stop the program (allocations,
+ * loads, array accesses still bounds checked, divisions by what may be
+ * zero) or write a global. Everything these read, transitively, is live;
+ * the other phis and instructions go.
+ */
+
+#include <vector>
+
+#include "opt.hpp"
+
+using namespace std;
+
+void propagate_copies(LIR_Function* func, const CFG& cfg){
+	VarId num_vars = func->vars.size();
+	// the variable each copy reads instead, NO_VAR for one that stays
+	vector<VarId> same_as(num_vars, NO_VAR);
+	auto find = [&](VarId v){
+		VarId root = v;
+		while(same_as[root] != NO_VAR){
+			root = same_as[root];
+		}
+		while(same_as[v] != NO_VAR){
+			VarId next = same_as[v];
+			same_as[v] = root;
+			v = next;
+		}
+		return root;
+	};
+	auto stable = [&](VarId v){
+		return func->is_local(v) || func->is_param(v);
+	};
+
+	for(BlockId id : cfg.rpo){
+		for(LirInst& inst : func->body[id]->insts){
+			if(inst.type != LirInst::Copy || !inst.is_var(0) || !func->is_local(inst.lhs) || !stable(inst.var(0))){
+				continue;
+			}
+			VarId src = find(inst.var(0));
+			if(src != inst.lhs){
+				same_as[inst.lhs] = src;
+			}
+		}
+	}
+	// a phi can only become a copy once the copies feeding it are known
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(BlockId id : cfg.rpo){
+			for(LirPhi& phi : func->body[id]->phis){
+				if(same_as[phi.lhs] != NO_VAR){
+					continue;
+				}
+				VarId only = NO_VAR;
+				bool copy = true;
+				for(VarId arg : phi.args){
+					VarId v = find(arg);
+					if(v == phi.lhs || v == only){
+						continue;
+					}
+					copy = only == NO_VAR;
+					only = v;
+					if(!copy){
+						break;
+					}
+				}
+				if(copy && only != NO_VAR){
+					same_as[phi.lhs] = only;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		for(LirPhi& phi : bb->phis){
+			for(VarId& arg : phi.args){
+				arg = find(arg);
+			}
+		}
+		for(LirInst& inst : bb->insts){
+			map_uses(func, inst, find);
+		}
+		map_uses(bb->term, find);
+	}
+}
+
+// whether inst has to stay even if nothing reads what it assigns
+static bool must_keep(const LIR_Function* func, const LirInst& inst){
+	switch(inst.type){
+		case LirInst::Copy:
+		case LirInst::Cmp:
+		case LirInst::Gfp:
+			break;
+		case LirInst::Gep:
+			if(inst.op == LirInst::Checked){
+				return true;
+			}
+			break;
+		case LirInst::Arith:
+			if(inst.op == ArithmeticOp::Div && (inst.is_var(1) || inst.num(1) == 0 || inst.num(1) == -1)){
+				return true;
+			}
+			break;
+		default:
+			return true;
+	}
+	return inst.lhs != NO_VAR && !func->is_local(inst.lhs) && !func->is_param(inst.lhs);
+}
+
+void eliminate_dead_code(LIR_Function* func, const CFG& cfg){
+	VarId num_vars = func->vars.size();
+	size_t num_blocks = func->body.size();
+	// where each variable is assigned: the block, and the instruction or
+	// (as -1 - index) the phi
+	vector<BlockId> def_block(num_vars, NO_BLOCK);
+	vector<int> def_index(num_vars, 0);
+	vector<vector<bool>> phi_live(num_blocks);
+	vector<vector<bool>> inst_live(num_blocks);
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		phi_live[id].assign(bb->phis.size(), false);
+		inst_live[id].assign(bb->insts.size(), false);
+		for(size_t i = 0; i < bb->phis.size(); i++){
+			def_block[bb->phis[i].lhs] = id;
+			def_index[bb->phis[i].lhs] = -1 - (int)i;
+		}
+		for(size_t i = 0; i < bb->insts.size(); i++){
+			if(bb->insts[i].lhs != NO_VAR){
+				def_block[bb->insts[i].lhs] = id;
+				def_index[bb->insts[i].lhs] = i;
+			}
+		}
+	}
+
+	vector<bool> live(num_vars, false);
+	vector<VarId> work;
+	auto use = [&](VarId v){
+		if(!live[v]){
+			live[v] = true;
+			work.push_back(v);
+		}
+		return v;
+	};
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		for(size_t i = 0; i < bb->insts.size(); i++){
+			if(must_keep(func, bb->insts[i])){
+				inst_live[id][i] = true;
+				map_uses(func, bb->insts[i], use);
+			}
+		}
+		map_uses(bb->term, use);
+	}
+	while(!work.empty()){
+		VarId v = work.back();
+		work.pop_back();
+		BlockId id = def_block[v];
+		if(id == NO_BLOCK){
+			continue;
+		}
+		BasicBlock* bb = func->body[id];
+		int i = def_index[v];
+		if(i >= 0 && !inst_live[id][i]){
+			inst_live[id][i] = true;
+			map_uses(func, bb->insts[i], use);
+		}
+		else if(i < 0 && !phi_live[id][-1 - i]){
+			phi_live[id][-1 - i] = true;
+			for(VarId arg : bb->phis[-1 - i].args){
+				use(arg);
+			}
+		}
+	}
+
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		size_t kept = 0;
+		for(size_t i = 0; i < bb->phis.size(); i++){
+			if(phi_live[id][i]){
+				bb->phis[kept++] = bb->phis[i];
+			}
+		}
+		bb->phis.resize(kept);
+		kept = 0;
+		for(size_t i = 0; i < bb->insts.size(); i++){
+			if(inst_live[id][i]){
+				bb->insts[kept++] = bb->insts[i];
+			}
+		}
+		bb->insts.resize(kept);
+	}
+}
+
+void drop_unused_locals(LIR_Function* func){
+	VarId num_vars = func->vars.size();
+	vector<bool> used(num_vars, false);
+	auto mark = [&](VarId v){
+		if(v != NO_VAR){
+			used[v] = true;
+		}
+		return v;
+	};
+	for(BasicBlock* bb : func->body){
+		if(!bb->reachable){
+			continue;
+		}
+		for(LirInst& inst : bb->insts){
+			map_uses(func, inst, mark);
+			mark(inst.lhs);
+		}
+		map_uses(bb->term, mark);
+		VarId* lhs = term_def(bb->term);
+		if(lhs != NULL){
+			mark(*lhs);
+		}
+	}
+	for(VarId v = 0; v < num_vars; v++){
+		if(!used[v]){
+			func->remove_local(v);
+		}
+	}
+}
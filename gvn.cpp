@@ -0,0 +1,206 @@
+/**
+ * Global value numbering over a function in SSA form: an instruction that
+ * computes what a dominating one already did, from the same variables,
+ * is dropped and its result read from the earlier one instead.
+ *
+ * The dominator tree is walked with a scoped table of the computations
+ * available so far. Arith, Cmp, Gfp and Gep only depend on their operands,
+ * which as parameters or locals in SSA form never change; if the earlier
+ * one did not trap (a division, a bounds check), neither would the later.
+ * Operands of commutative operators are put in a fixed order first.
+ *
+ * A load also depends on memory. Memory is tracked as epochs that every
+ * store and call moves on. A value of one pointer type can only be stored
+ * through a pointer of that type (Gfp and Gep give typed pointers, there
+ * are no casts), so a store only moves the epoch of its pointer type on
+ * and loads through other types stay available. A block only starts with
+ * the memory of its immediate dominator when that is its one predecessor
+ * and does not end in a call; otherwise whatever happened on the way in
+ * is unknown.
+ */
+
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "opt.hpp"
+
+using namespace std;
+
+struct ValueKey {
+	LirInst inst;
+	// the memory epochs a load depends on, 0 for other instructions
+	int mem[2];
+
+	bool operator==(const ValueKey& o) const {
+		return inst.type == o.inst.type && inst.op == o.inst.op && inst.var_slots == o.inst.var_slots
+			&& inst.slot[0] == o.inst.slot[0] && inst.slot[1] == o.inst.slot[1] && inst.aux == o.inst.aux
+			&& mem[0] == o.mem[0] && mem[1] == o.mem[1];
+	}
+};
+
+struct ValueKeyHash {
+	size_t operator()(const ValueKey& k) const {
+		size_t h = k.inst.type * 31 + k.inst.op;
+		h = h * 31 + k.inst.var_slots;
+		h = h * 1000003 + (uint32_t)k.inst.slot[0];
+		h = h * 1000003 + (uint32_t)k.inst.slot[1];
+		h = h * 1000003 + (uint32_t)k.inst.aux;
+		h = h * 1000003 + (uint32_t)k.mem[0];
+		return h * 1000003 + (uint32_t)k.mem[1];
+	}
+};
+
+// What memory looks like at one point, as epochs; calls is moved on by
+// anything that may write anywhere, any by every write, and by_type by a
+// store through a pointer of that type
+struct MemoryState {
+	int calls;
+	int any;
+	unordered_map<Type*, int> by_type;
+};
+
+static bool commutative(const LirInst& inst){
+	if(inst.type == LirInst::Arith){
+		return inst.op == ArithmeticOp::Add || inst.op == ArithmeticOp::Mul;
+	}
+	return inst.type == LirInst::Cmp && (inst.op == ComparisonOp::Equal || inst.op == ComparisonOp::NotEq);
+}
+
+void gvn(LIR_Function* func, const CFG& cfg){
+	VarId num_vars = func->vars.size();
+	size_t num_blocks = func->body.size();
+	vector<VarId> same_as(num_vars, NO_VAR);
+	auto find = [&](VarId v){
+		return same_as[v] != NO_VAR ? same_as[v] : v;
+	};
+	auto stable = [&](VarId v){
+		return func->is_local(v) || func->is_param(v);
+	};
+	// the type memory is accessed as through pointer v, NULL if it is not
+	// known to be a pointer
+	auto alias_class = [&](VarId v){
+		Type* t = var_type(func, v);
+		return t != NULL && t->type == Type::Ptr ? t : (Type*)NULL;
+	};
+
+	unordered_map<ValueKey, VarId, ValueKeyHash> available;
+	vector<ValueKey> added;
+	vector<MemoryState> memory(num_blocks);
+	int epoch = 0;
+
+	auto number = [&](BlockId id){
+		BasicBlock* bb = func->body[id];
+		MemoryState& mem = memory[id];
+		BlockId idom = cfg.idom[id];
+		bool inherit = idom != NO_BLOCK && term_def(func->body[idom]->term) == NULL;
+		for(BlockId pred : bb->preds){
+			inherit = inherit && pred == idom;
+		}
+		if(inherit){
+			mem = memory[idom];
+		}
+		else{
+			mem.calls = ++epoch;
+			mem.any = ++epoch;
+		}
+
+		size_t kept = 0;
+		for(size_t i = 0; i < bb->insts.size(); i++){
+			LirInst inst = bb->insts[i];
+			map_uses(func, inst, find);
+			bb->insts[kept++] = inst;
+			if(inst.type == LirInst::Store){
+				Type* t = alias_class(inst.var(0));
+				if(t == NULL || !stable(inst.var(0))){
+					mem.calls = ++epoch;
+				}
+				else{
+					mem.by_type[t] = ++epoch;
+				}
+				mem.any = ++epoch;
+				continue;
+			}
+			if(inst.type == LirInst::CallExt){
+				mem.calls = ++epoch;
+				mem.any = ++epoch;
+				continue;
+			}
+			bool pure = inst.type == LirInst::Arith || inst.type == LirInst::Cmp || inst.type == LirInst::Gfp || inst.type == LirInst::Gep;
+			if(!(pure || inst.type == LirInst::Load) || !func->is_local(inst.lhs)){
+				continue;
+			}
+			if((inst.is_var(0) && !stable(inst.var(0))) || (inst.is_var(1) && !stable(inst.var(1)))){
+				continue;
+			}
+
+			ValueKey key;
+			key.inst = inst;
+			key.inst.lhs = NO_VAR;
+			key.mem[0] = key.mem[1] = 0;
+			if(commutative(inst)){
+				int64_t a = inst.is_var(0) ? inst.slot[0] : inst.slot[0] - ((int64_t)1 << 32);
+				int64_t b = inst.is_var(1) ? inst.slot[1] : inst.slot[1] - ((int64_t)1 << 32);
+				if(b < a){
+					key.inst.slot[0] = inst.slot[1];
+					key.inst.slot[1] = inst.slot[0];
+					key.inst.var_slots = (inst.is_var(0) << 1) | inst.is_var(1);
+				}
+			}
+			if(inst.type == LirInst::Load){
+				Type* t = alias_class(inst.var(0));
+				if(t == NULL){
+					key.mem[0] = mem.any;
+				}
+				else{
+					auto it = mem.by_type.find(t);
+					key.mem[0] = mem.calls;
+					key.mem[1] = it == mem.by_type.end() ? 0 : it->second;
+				}
+			}
+			auto it = available.find(key);
+			if(it != available.end()){
+				same_as[inst.lhs] = it->second;
+				kept--;
+			}
+			else{
+				available.emplace(key, inst.lhs);
+				added.push_back(key);
+			}
+		}
+		bb->insts.resize(kept);
+		map_uses(bb->term, find);
+	};
+
+	// each entry is a block, the next dominator tree child to visit, and
+	// how many computations were available before the block
+	vector<pair<BlockId, size_t>> stack;
+	vector<size_t> marks;
+	number(cfg.entry);
+	stack.push_back(make_pair(cfg.entry, 0));
+	marks.push_back(0);
+	while(!stack.empty()){
+		BlockId id = stack.back().first;
+		if(stack.back().second < cfg.dom_children[id].size()){
+			BlockId child = cfg.dom_children[id][stack.back().second++];
+			marks.push_back(added.size());
+			number(child);
+			stack.push_back(make_pair(child, 0));
+			continue;
+		}
+		while(added.size() > marks.back()){
+			available.erase(added.back());
+			added.pop_back();
+		}
+		marks.pop_back();
+		stack.pop_back();
+	}
+
+	for(BlockId id : cfg.rpo){
+		for(LirPhi& phi : func->body[id]->phis){
+			for(VarId& arg : phi.args){
+				arg = find(arg);
+			}
+		}
+	}
+}
@@ -0,0 +1,246 @@
+/**
+ * A lexer for the cflat surface syntax. It produces the same Token records
+ * as classify_tokens(), so the parser can run straight on a source file
+ * without going through the external lex step and the token text format.
+ *
+ * Runs of identifier characters, digits and whitespace are scanned 16 bytes
+ * at a time with SSE2 when it is available, with a scalar loop for the tail.
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "parse.hpp"
+
+using namespace std;
+
+bool DEBUG_LEX = false;
+
+// Keywords and the token kind each one lexes to
+struct Keyword {
+    const char* name;
+    enum Token::kind kind;
+};
+
+const Keyword keywords[] = {
+    {"int", Token::Int}, {"struct", Token::Struct}, {"nil", Token::Nil},
+    {"break", Token::Break}, {"continue", Token::Continue},
+    {"return", Token::Return}, {"if", Token::If}, {"else", Token::Else},
+    {"while", Token::While}, {"new", Token::New}, {"let", Token::Let},
+    {"extern", Token::Extern}, {"fn", Token::Fn}};
+
+const int num_keywords = sizeof(keywords) / sizeof(keywords[0]);
+
+static inline bool is_alpha(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool is_digit(char c){
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+#ifdef __SSE2__
+// true for each byte of x that lies in [lo, hi]; only valid for ASCII ranges
+static inline __m128i in_range(__m128i x, char lo, char hi){
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(x, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i digit_class(__m128i x){
+    return in_range(x, '0', '9');
+}
+
+static inline __m128i ident_class(__m128i x){
+    // setting bit 5 folds upper case letters onto lower case ones
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_or_si128(in_range(lower, 'a', 'z'), digit_class(x));
+}
+
+static inline __m128i space_class(__m128i x){
+    __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+    __m128i nl = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                              _mm_cmpeq_epi8(x, _mm_set1_epi8('\r')));
+    return _mm_or_si128(sp, nl);
+}
+
+// Skip 16-byte chunks whose bytes are all in the class. Returns the first
+// position that is outside the class, or the start of the unscanned tail.
+template<__m128i (*char_class)(__m128i)>
+static inline const char* skip_class(const char* pos, const char* end){
+    while(end - pos >= 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i*)pos);
+        int outside = ~_mm_movemask_epi8(char_class(chunk)) & 0xffff;
+        if(outside != 0){
+            return pos + __builtin_ctz(outside);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+#endif
+
+static inline const char* skip_ident(const char* pos, const char* end){
+#ifdef __SSE2__
+    pos = skip_class<ident_class>(pos, end);
+#endif
+    while(pos < end && (is_alpha(*pos) || is_digit(*pos))){
+        pos++;
+    }
+    return pos;
+}
+
+static inline const char* skip_digits(const char* pos, const char* end){
+#ifdef __SSE2__
+    pos = skip_class<digit_class>(pos, end);
+#endif
+    while(pos < end && is_digit(*pos)){
+        pos++;
+    }
+    return pos;
+}
+
+static inline const char* skip_space(const char* pos, const char* end){
+#ifdef __SSE2__
+    pos = skip_class<space_class>(pos, end);
+#endif
+    while(pos < end && is_space(*pos)){
+        pos++;
+    }
+    return pos;
+}
+
+/*
+ * Lex a whole cflat source file into Token records, ending with End.
+ * Throws a runtime error on a character that cannot start a token;
+ * token_index is left one past the last token produced.
+ */
+void lex(const char* data, size_t size, vector<Token>& out){
+    const char* pos = data;
+    const char* end = data + size;
+    while(true){
+        pos = skip_space(pos, end);
+        if(pos >= end){
+            break;
+        }
+        token_index = out.size() + 1;
+        char c = *pos;
+        Token t = {Token::End, 0};
+
+        // id or keyword
+        if(is_alpha(c)){
+            const char* start = pos;
+            pos = skip_ident(pos + 1, end);
+            size_t len = pos - start;
+            t.kind = Token::Id;
+            for(int k = 0; k < num_keywords; k++){
+                if(strncmp(keywords[k].name, start, len) == 0 && keywords[k].name[len] == '\0'){
+                    t.kind = keywords[k].kind;
+                    break;
+                }
+            }
+            if(t.kind == Token::Id){
+                t.payload = intern_id(start, len);
+            }
+            out.push_back(t);
+            continue;
+        }
+
+        // num
+        if(is_digit(c)){
+            const char* start = pos;
+            pos = skip_digits(pos + 1, end);
+            int64_t num = 0;
+            for(const char* d = start; d < pos; d++){
+                num = num * 10 + (*d - '0');
+                if(num > INT32_MAX){
+                    throw runtime_error{"Number out of range " + string(start, pos - start)};
+                }
+            }
+            t.kind = Token::Num;
+            t.payload = (int32_t)num;
+            out.push_back(t);
+            continue;
+        }
+
+        char next = pos + 1 < end ? pos[1] : '\0';
+
+        // comments
+        if(c == '/' && next == '/'){
+            const char* nl = (const char*)memchr(pos, '\n', end - pos);
+            pos = nl == NULL ? end : nl + 1;
+            continue;
+        }
+        if(c == '/' && next == '*'){
+            pos += 2;
+            while(pos + 1 < end && !(pos[0] == '*' && pos[1] == '/')){
+                pos++;
+            }
+            if(pos + 1 >= end){
+                throw runtime_error{"Unterminated comment"};
+            }
+            pos += 2;
+            continue;
+        }
+
+        // punctuation, two character tokens first
+        int len = 1;
+        switch(c){
+            case '&': t.kind = Token::Address; break;
+            case ':': t.kind = Token::Colon; break;
+            case ';': t.kind = Token::Semicolon; break;
+            case ',': t.kind = Token::Comma; break;
+            case '_': t.kind = Token::Underscore; break;
+            case '+': t.kind = Token::Plus; break;
+            case '*': t.kind = Token::Star; break;
+            case '/': t.kind = Token::Slash; break;
+            case '.': t.kind = Token::Dot; break;
+            case '(': t.kind = Token::OpenParen; break;
+            case ')': t.kind = Token::CloseParen; break;
+            case '[': t.kind = Token::OpenBracket; break;
+            case ']': t.kind = Token::CloseBracket; break;
+            case '{': t.kind = Token::OpenBrace; break;
+            case '}': t.kind = Token::CloseBrace; break;
+            case '-':
+                if(next == '>'){ t.kind = Token::Arrow; len = 2; }
+                else t.kind = Token::Dash;
+                break;
+            case '=':
+                if(next == '='){ t.kind = Token::Equal; len = 2; }
+                else t.kind = Token::Gets;
+                break;
+            case '!':
+                if(next == '='){ t.kind = Token::NotEq; len = 2; }
+                break;
+            case '<':
+                if(next == '='){ t.kind = Token::Lte; len = 2; }
+                else t.kind = Token::Lt;
+                break;
+            case '>':
+                if(next == '='){ t.kind = Token::Gte; len = 2; }
+                else t.kind = Token::Gt;
+                break;
+            default:
+                break;
+        }
+        if(t.kind == Token::End){
+            throw runtime_error{"Unexpected character " + string(1, c)};
+        }
+        if(DEBUG_LEX) cout << "lex: " << t << endl;
+        out.push_back(t);
+        pos += len;
+    }
+    token_index = 0;
+    out.push_back(Token{Token::End, 0});
+}
@@ -0,0 +1,456 @@
+/**
+ * A reader for the human readable LIR format (what `lower -hr` prints, and
+ * what file_lir holds). It builds the LIR_Program directly, so codegen can
+ * run without the lexer, parser and lowering in front of it.
+ *
+ * The file is scanned once, front to back, straight out of the mapped
+ * buffer. Only names are copied out into strings; there is no intermediate
+ * line or token array.
+ *
+ *   struct st { f:int ... }          struct definition, one field per line
+ *   g:&int                           global
+ *   extern e:(int) -> int            extern
+ *   fn f(p:int) -> int {             function, followed by an optional
+ *   let x:int, y:&int                `let` line of locals and the blocks
+ *   entry:
+ *     x = $arith add p 1
+ *     $ret x
+ *   }
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include "lower.hpp"
+
+using namespace std;
+
+bool DEBUG_LIR_READ = false;
+
+// Position in the mapped file; line is used for error messages
+struct LirCursor {
+    const char* pos;
+    const char* end;
+    int line;
+};
+
+static inline bool is_name_char(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void lir_error(LirCursor& cur, string msg){
+    token_index = cur.line;
+    throw runtime_error{msg};
+}
+
+// skip spaces and tabs, but not newlines
+static void skip_blanks(LirCursor& cur){
+    while(cur.pos < cur.end && (*cur.pos == ' ' || *cur.pos == '\t')){
+        cur.pos++;
+    }
+}
+
+// skip any whitespace including empty lines
+static void skip_lines(LirCursor& cur){
+    while(cur.pos < cur.end && (*cur.pos == ' ' || *cur.pos == '\t' || *cur.pos == '\n' || *cur.pos == '\r')){
+        if(*cur.pos == '\n'){
+            cur.line++;
+        }
+        cur.pos++;
+    }
+}
+
+static bool at_line_end(LirCursor& cur){
+    skip_blanks(cur);
+    return cur.pos >= cur.end || *cur.pos == '\n' || *cur.pos == '\r';
+}
+
+static void expect_line_end(LirCursor& cur){
+    if(!at_line_end(cur)){
+        lir_error(cur, "Expected end of line");
+    }
+    skip_lines(cur);
+}
+
+// consume the literal s if it is next, after any blanks
+static bool accept(LirCursor& cur, const char* s){
+    skip_blanks(cur);
+    size_t len = strlen(s);
+    if((size_t)(cur.end - cur.pos) >= len && memcmp(cur.pos, s, len) == 0){
+        cur.pos += len;
+        return true;
+    }
+    return false;
+}
+
+static void expect(LirCursor& cur, const char* s){
+    if(!accept(cur, s)){
+        lir_error(cur, string("Expected ") + s);
+    }
+}
+
+// the next name without consuming it, empty if there is none
+static size_t peek_name(LirCursor& cur){
+    skip_blanks(cur);
+    const char* p = cur.pos;
+    while(p < cur.end && is_name_char(*p)){
+        p++;
+    }
+    return p - cur.pos;
+}
+
+static string read_name(LirCursor& cur){
+    size_t len = peek_name(cur);
+    if(len == 0){
+        lir_error(cur, "Expected a name");
+    }
+    string name(cur.pos, len);
+    cur.pos += len;
+    return name;
+}
+
+// consume the keyword kw only if it is a whole name
+static bool accept_keyword(LirCursor& cur, const char* kw){
+    size_t len = peek_name(cur);
+    if(len == strlen(kw) && memcmp(cur.pos, kw, len) == 0){
+        cur.pos += len;
+        return true;
+    }
+    return false;
+}
+
+static Type* read_type(LirCursor& cur);
+
+// rettyp ::= type | `_`
+static Type* read_rettyp(LirCursor& cur){
+    skip_blanks(cur);
+    if(cur.pos < cur.end && *cur.pos == '_' && (cur.pos + 1 == cur.end || !is_name_char(cur.pos[1]))){
+        cur.pos++;
+        return NULL;
+    }
+    return read_type(cur);
+}
+
+// type ::= `&` type | `int` | id | `(` (type (`,` type)*)? `)` `->` rettyp
+static Type* read_type(LirCursor& cur){
+    if(accept(cur, "&")){
+        return ptr_type(read_type(cur));
+    }
+    if(accept(cur, "(")){
+        vector<Type*> prms;
+        if(!accept(cur, ")")){
+            prms.push_back(read_type(cur));
+            while(accept(cur, ",")){
+                prms.push_back(read_type(cur));
+            }
+            expect(cur, ")");
+        }
+        expect(cur, "->");
+        return fn_type(prms, read_rettyp(cur));
+    }
+    if(accept_keyword(cur, "int")){
+        return int_type();
+    }
+    return struct_type(read_name(cur));
+}
+
+// operand ::= num | id
+static Operand* read_operand(LirCursor& cur, LIR_Function* func){
+    skip_blanks(cur);
+    bool negative = cur.pos < cur.end && *cur.pos == '-';
+    const char* p = negative ? cur.pos + 1 : cur.pos;
+    if(p < cur.end && *p >= '0' && *p <= '9'){
+        int64_t num = 0;
+        while(p < cur.end && *p >= '0' && *p <= '9'){
+            num = num * 10 + (*p - '0');
+            if(num > (int64_t)INT32_MAX + 1){
+                lir_error(cur, "Number out of range");
+            }
+            p++;
+        }
+        cur.pos = p;
+        Operand* op = lir_new<Operand>(Operand::Const);
+        op->value.Const.num = (int32_t)(negative ? -num : num);
+        return op;
+    }
+    Operand* op = lir_new<Operand>(Operand::Var);
+    op->value.Var.id = func->intern_var(read_name(cur));
+    return op;
+}
+
+// args ::= `(` (operand (`,` operand)*)? `)`
+static vector<Operand*> read_args(LirCursor& cur, LIR_Function* func){
+    vector<Operand*> args;
+    expect(cur, "(");
+    if(!accept(cur, ")")){
+        args.push_back(read_operand(cur, func));
+        while(accept(cur, ",")){
+            args.push_back(read_operand(cur, func));
+        }
+        expect(cur, ")");
+    }
+    return args;
+}
+
+static ArithmeticOp* read_aop(LirCursor& cur){
+    string name = read_name(cur);
+    if(name == "add") return lir_new<ArithmeticOp>(ArithmeticOp::Add);
+    if(name == "sub") return lir_new<ArithmeticOp>(ArithmeticOp::Sub);
+    if(name == "mul") return lir_new<ArithmeticOp>(ArithmeticOp::Mul);
+    if(name == "div") return lir_new<ArithmeticOp>(ArithmeticOp::Div);
+    lir_error(cur, "Unknown arithmetic op " + name);
+    return NULL;
+}
+
+static ComparisonOp* read_cop(LirCursor& cur){
+    string name = read_name(cur);
+    if(name == "eq") return lir_new<ComparisonOp>(ComparisonOp::Equal);
+    if(name == "neq") return lir_new<ComparisonOp>(ComparisonOp::NotEq);
+    if(name == "lt") return lir_new<ComparisonOp>(ComparisonOp::Lt);
+    if(name == "lte") return lir_new<ComparisonOp>(ComparisonOp::Lte);
+    if(name == "gt") return lir_new<ComparisonOp>(ComparisonOp::Gt);
+    if(name == "gte") return lir_new<ComparisonOp>(ComparisonOp::Gte);
+    lir_error(cur, "Unknown comparison op " + name);
+    return NULL;
+}
+
+/*
+ * Read one instruction line into bb. Returns true if it was the terminal.
+ * The `[_allocN]` tag on $alloc only names the allocation site and is
+ * not kept.
+ */
+static bool read_inst(LirCursor& cur, LIR_Function* func, BasicBlock* bb){
+    VarId lhs = NO_VAR;
+    if(!accept(cur, "$")){
+        lhs = func->intern_var(read_name(cur));
+        expect(cur, "=");
+        expect(cur, "$");
+    }
+    string op = read_name(cur);
+    if(DEBUG_LIR_READ) cout << "read_inst: " << (lhs == NO_VAR ? "_" : func->var_name(lhs)) << " = $" << op << endl;
+
+    // terminals
+    if(op == "branch" || op == "jump" || op == "ret" || op == "call_dir" || op == "call_idr"){
+        Terminal* term;
+        if(op == "branch"){
+            term = lir_new<Terminal>(Terminal::Branch);
+            term->value.Branch.guard = read_operand(cur, func);
+            term->value.Branch.tt = func->intern_block(read_name(cur));
+            term->value.Branch.ff = func->intern_block(read_name(cur));
+        }
+        else if(op == "jump"){
+            term = lir_new<Terminal>(Terminal::Jump);
+            term->value.Jump.next_bb = func->intern_block(read_name(cur));
+        }
+        else if(op == "ret"){
+            term = lir_new<Terminal>(Terminal::Ret);
+            term->value.Ret.op = at_line_end(cur) ? NULL : read_operand(cur, func);
+        }
+        else if(op == "call_dir"){
+            term = lir_new<Terminal>(Terminal::CallDirect);
+            string callee = read_name(cur);
+            vector<Operand*> args = read_args(cur, func);
+            expect(cur, "then");
+            BlockId next_bb = func->intern_block(read_name(cur));
+            term->value.CallDirect.lhs = lhs;
+            term->value.CallDirect.callee = callee;
+            term->value.CallDirect.args = args;
+            term->value.CallDirect.next_bb = next_bb;
+        }
+        else{
+            term = lir_new<Terminal>(Terminal::CallIndirect);
+            VarId callee = func->intern_var(read_name(cur));
+            vector<Operand*> args = read_args(cur, func);
+            expect(cur, "then");
+            BlockId next_bb = func->intern_block(read_name(cur));
+            term->value.CallIndirect.lhs = lhs;
+            term->value.CallIndirect.callee = callee;
+            term->value.CallIndirect.args = args;
+            term->value.CallIndirect.next_bb = next_bb;
+        }
+        if(bb->term != NULL){
+            lir_error(cur, "Second terminal in block " + bb->label);
+        }
+        bb->term = term;
+        expect_line_end(cur);
+        return true;
+    }
+
+    LirInst inst(LirInst::Copy, lhs);
+    if(op == "alloc"){
+        inst.type = LirInst::Alloc;
+        inst.set(0, read_operand(cur, func));
+        if(accept(cur, "[")){
+            read_name(cur);
+            expect(cur, "]");
+        }
+    }
+    else if(op == "arith"){
+        inst.type = LirInst::Arith;
+        inst.op = read_aop(cur)->type;
+        inst.set(0, read_operand(cur, func));
+        inst.set(1, read_operand(cur, func));
+    }
+    else if(op == "cmp"){
+        inst.type = LirInst::Cmp;
+        inst.op = read_cop(cur)->type;
+        inst.set(0, read_operand(cur, func));
+        inst.set(1, read_operand(cur, func));
+    }
+    else if(op == "call_ext"){
+        inst.type = LirInst::CallExt;
+        string callee = read_name(cur);
+        inst.aux = func->add_call(callee, read_args(cur, func));
+    }
+    else if(op == "copy"){
+        inst.set(0, read_operand(cur, func));
+    }
+    else if(op == "gep"){
+        inst.type = LirInst::Gep;
+        inst.set_var(0, func->intern_var(read_name(cur)));
+        inst.set(1, read_operand(cur, func));
+    }
+    else if(op == "gfp"){
+        inst.type = LirInst::Gfp;
+        inst.set_var(0, func->intern_var(read_name(cur)));
+        inst.aux = func->intern_field(read_name(cur));
+    }
+    else if(op == "load"){
+        inst.type = LirInst::Load;
+        inst.set_var(0, func->intern_var(read_name(cur)));
+    }
+    else if(op == "store"){
+        inst.type = LirInst::Store;
+        inst.lhs = NO_VAR;
+        inst.set_var(0, func->intern_var(read_name(cur)));
+        inst.set(1, read_operand(cur, func));
+    }
+    else{
+        lir_error(cur, "Unknown instruction $" + op);
+        return false;
+    }
+    if(bb->term != NULL){
+        lir_error(cur, "Instruction after the terminal of block " + bb->label);
+    }
+    bb->insts.push_back(inst);
+    expect_line_end(cur);
+    return false;
+}
+
+// decl ::= id `:` type
+static pair<string, Type*> read_decl(LirCursor& cur){
+    string name = read_name(cur);
+    expect(cur, ":");
+    return make_pair(name, read_type(cur));
+}
+
+static LIR_Function* read_function(LirCursor& cur){
+    LIR_Function* func = lir_new<LIR_Function>();
+    func->name = read_name(cur);
+    if(DEBUG_LIR_READ) cout << "read_function: " << func->name << endl;
+    expect(cur, "(");
+    if(!accept(cur, ")")){
+        do{
+            pair<string, Type*> decl = read_decl(cur);
+            VarId id = func->intern_var(decl.first);
+            if(!func->is_param(id)){
+                func->add_param(id, decl.second);
+            }
+        } while(accept(cur, ","));
+        expect(cur, ")");
+    }
+    expect(cur, "->");
+    func->rettyp = read_rettyp(cur);
+    expect(cur, "{");
+    expect_line_end(cur);
+
+    if(accept_keyword(cur, "let")){
+        do{
+            pair<string, Type*> decl = read_decl(cur);
+            VarId id = func->intern_var(decl.first);
+            if(!func->is_local(id)){
+                func->add_local(id, decl.second);
+            }
+        } while(accept(cur, ","));
+        expect_line_end(cur);
+    }
+
+    // blocks can be referenced before they are defined, defined marks the ones seen
+    BasicBlock* bb = NULL;
+    vector<bool> defined;
+    while(!accept(cur, "}")){
+        if(cur.pos >= cur.end){
+            lir_error(cur, "Unterminated function " + func->name);
+        }
+        // a line that is a name followed by `:` starts a new block
+        size_t len = peek_name(cur);
+        if(len > 0 && cur.pos + len < cur.end && cur.pos[len] == ':'){
+            bb = func->body[func->intern_block(string(cur.pos, len))];
+            defined.resize(func->body.size(), false);
+            if(defined[bb->id]){
+                lir_error(cur, "Duplicate block " + bb->label);
+            }
+            defined[bb->id] = true;
+            cur.pos += len + 1;
+            expect_line_end(cur);
+            continue;
+        }
+        if(bb == NULL){
+            lir_error(cur, "Instruction outside of a block");
+        }
+        read_inst(cur, func, bb);
+    }
+    expect_line_end(cur);
+
+    for(BasicBlock* b : func->body){
+        if(b->term == NULL){
+            lir_error(cur, "Block " + b->label + " has no terminal");
+        }
+    }
+    if(func->find_block("entry") == NO_BLOCK){
+        lir_error(cur, "Function " + func->name + " has no entry block");
+    }
+    func->set_reachable();
+    func->link_blocks();
+    return func;
+}
+
+/*
+ * Read a whole LIR program. Throws a runtime error on malformed input,
+ * with token_index set to the line it was found on.
+ */
+LIR_Program* read_lir(const char* data, size_t size){
+    LirCursor cur = {data, data + size, 1};
+    LIR_Program* prog = lir_new<LIR_Program>();
+    skip_lines(cur);
+    while(cur.pos < cur.end){
+        if(accept_keyword(cur, "struct")){
+            string name = read_name(cur);
+            expect(cur, "{");
+            expect_line_end(cur);
+            map<string, Type*>& fields = prog->structs[name];
+            while(!accept(cur, "}")){
+                fields.insert(read_decl(cur));
+                expect_line_end(cur);
+            }
+        }
+        else if(accept_keyword(cur, "extern")){
+            prog->externs.insert(read_decl(cur));
+        }
+        else if(accept_keyword(cur, "fn")){
+            LIR_Function* func = read_function(cur);
+            prog->functions[func->name] = func;
+            continue;
+        }
+        else{
+            prog->globals.insert(read_decl(cur));
+        }
+        expect_line_end(cur);
+    }
+    token_index = 0;
+    return prog;
+}
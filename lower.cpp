@@ -3,6 +3,7 @@
 #include <vector>
 #include <unordered_map>
 #include <stack>
+#include <algorithm>
 #include <string>
 
 #include "lower.hpp"
@@ -11,25 +12,49 @@
 
 using namespace std;
 
+// Lowering state is per thread so programs can be lowered concurrently,
+// reset_lower() clears it between programs.
+
 //Global hashmaps that map function names to counters for their variables or labels
-unordered_map<string, int> fresh_vars;
-unordered_map<string, int> fresh_labels;
+thread_local unordered_map<string, int> fresh_vars;
+thread_local unordered_map<string, int> fresh_labels;
 
 // create empty LIR program
-LIR_Program* lir;
-
-stack<string> while_hdr_labels;
-stack<string> while_end_labels;
+thread_local LIR_Program* lir;
 
-int num_ret = 0;
+thread_local stack<BlockId> while_hdr_labels;
+thread_local stack<BlockId> while_end_labels;
 
 bool DEBUG_LOWER = false;
 
+void reset_lower(){
+	fresh_vars.clear();
+	fresh_labels.clear();
+	lir = NULL;
+	while_hdr_labels = stack<BlockId>();
+	while_end_labels = stack<BlockId>();
+}
+
 /* 
  * 2.3 Lowering Expressions
  */
 LIR_Program* lower(Program* prog){
-	lir = new LIR_Program;
+	lower_toplevel(prog);
+
+	//For loop just to run the statements in each of the function bodies
+	for(Function* func : prog->functions){
+		lower_function(lir->functions[func->name], func);
+	}
+	
+	return lir;
+};
+
+/*
+ * Copy the globals, externs, structs and function signatures into a new
+ * LIR program. Function bodies are left empty for lower_function.
+ */
+LIR_Program* lower_toplevel(Program* prog){
+	lir = lir_new<LIR_Program>();
 	// Copy prog.{globals, externs, structs, functions} into lir
 
 	// Copy globals from AST --> LIR
@@ -50,16 +75,7 @@ LIR_Program* lower(Program* prog){
 			temp.push_back(decl->type);
 		}
 
-		Type* fn = new Type;
-		fn->type = Type::Fn;
-		fn->value.Fn.prms = temp;
-		fn->value.Fn.ret = func->rettyp;
-
-		Type* ptr = new Type;
-		ptr->type = Type::Ptr;
-		ptr->value.Ptr.ref = fn;
-
-		lir->globals[func->name] = ptr;
+		lir->globals[func->name] = ptr_type(fn_type(temp, func->rettyp));
 	}
 
 
@@ -77,10 +93,10 @@ LIR_Program* lower(Program* prog){
 
 	//For loop to insert func_names, func return types, etc
 	for(Function* func : prog->functions){
-		LIR_Function* lir_func = new LIR_Function;
+		LIR_Function* lir_func = lir_new<LIR_Function>();
 		// populate the params
 		for(Decl* decl: func->params){
-			lir_func->params[decl->name] = decl->type;
+			lir_func->add_param(lir_func->intern_var(decl->name), decl->type);
 		}
 		// populate rettyp
 		lir_func->rettyp = func->rettyp;
@@ -91,176 +107,138 @@ LIR_Program* lower(Program* prog){
 	
 	}
 
-	//For loop just to run the statements in each of the function bodies
-	for(Function* func : prog->functions){
-		LIR_Function* lir_func = lir->functions[func->name];
-		//Declare a function type that belongs to the LIR data structure
-		
-		//populate the locals + eliminate locals by turning them into assignments --> add them to func.stmts
-		vector<Stmt*> local_assignment;
-		for(pair<Decl*,Exp*> p: func->locals){
-			Decl* decl = p.first;
-			Exp* e = p.second;
-
-			lir_func->locals[decl->name] = decl->type;
-
-			if(e != NULL){
-				Stmt* stmt = new Stmt; 
-				stmt->type = Stmt::Assign;
-
-				Lval* l = new Lval;
-				l->type = Lval::Id;
-				l->value.Id.name = decl->name;
-				stmt->value.Assign.lhs = l; // string
-
-				Rhs* r = new Rhs;
-				r->type = Rhs::RhsExp;
-				r->value.RhsExp.exp = e; // Exp*
-				stmt->value.Assign.rhs = r;
-
-				// func->stmts.insert(func->stmts.begin(), stmt);
-				local_assignment.push_back(stmt);
-			}
-		}
-		//vec1.insert(vec1.end(), vec2.begin(), vec2.end());
-		func->stmts.insert(func->stmts.begin(), local_assignment.begin(), local_assignment.end());
-		// TODO(): Compute func.stmts which will fill in the translation vector.
+	return lir;
+}
 
-		// create vector that will hold the emitted instructions/labels
-		// a string vector so we must to_string() the emitted_inst before we ever push onto translation vector
-		vector<LIR*> translation_vector;
+/*
+ * Lower the body of one function into lir_func, which must already be in
+ * lir->functions (see lower_toplevel). The AST of func is not modified.
+ */
+void lower_function(LIR_Function* lir_func, Function* func){
+	//populate the locals
+	for(pair<Decl*,Exp*> p: func->locals){
+		lir_func->add_local(lir_func->intern_var(p.first->name), p.first->type);
+	}
+
+	// the blocks were added when their labels were made, they are filled in
+	// as the statements are lowered
+	BlockBuilder blocks(lir_func);
+
+	// the body starts with Label("entry")
+	blocks.start(lir_func->intern_block("entry"));
+
+	// eliminate locals by turning their initializers into assignments,
+	// i.e. emit Copy(Var(name), [e]^e) ahead of the statements
+	for(pair<Decl*,Exp*> p: func->locals){
+		if(p.second != NULL){
+			LirInst copy(LirInst::Copy, lir_func->intern_var(p.first->name));
+			copy.set(0, exp_lower(lir_func, p.second, blocks));
+			blocks.append(copy);
+		}
+	}
 
-		// Its first and only element should be Label("entry").
-		translation_vector.push_back(new Label("entry"));
+	// stmt_lower(lir_func, func, blocks); previous version with a function as the parameter
+	for (Stmt* stmt : func->stmts){
+		stmt_lower(lir_func, stmt, blocks);
+	}
 
-		// stmt_lower(lir_func, func, translation_vector); previous version with a function as the parameter
-		for (Stmt* stmt : func->stmts){
-			stmt_lower(lir_func, stmt, translation_vector);
-		}
-		// TODO(): Take the final translation vector and construct the CFG for lir.functions[func].body.
-		
-		string cur_bb = "";
-		// create a new BasicBlock
-		for(LIR* lir : translation_vector){
-			if(dynamic_cast<Label*>(lir) != NULL){
-				Label* temp = dynamic_cast<Label*>(lir);
-				BasicBlock* bb = new BasicBlock;
-				bb->label = temp->name;
-				bb->term = NULL;
-				bb->insts = vector<LirInst*>();
-				lir_func->body[temp->name] = bb;
-				cur_bb = temp->name;
-			}
-			else if(dynamic_cast<Terminal*>(lir) != NULL){
-				if(cur_bb == "") continue;
-				Terminal* temp = dynamic_cast<Terminal*>(lir);
-				lir_func->body[cur_bb]->term = temp;
-				cur_bb = "";
-			}
-			else{ // if its not a Terminal or Label, it is a LirInst
-				if(cur_bb == "") continue;
-				LirInst* temp = dynamic_cast<LirInst*>(lir);
-				lir_func->body[cur_bb]->insts.push_back(temp);
-			}
+	if(DEBUG_LOWER){cout << "Before reachable" << endl;}
+	// set reachable
+	lir_func->set_reachable();
+	
+	// check return stuff
+	int num_ret = 0;
+	for(BasicBlock* bb : lir_func->body){
+		if(bb->reachable && bb->term->type == Terminal::Ret){
+			num_ret++;
 		}
-
-		num_ret = 0;
+	}
+	if(num_ret > 1){
+		// emit Label(EXIT); the blocks before it are the ones to rewrite
+		BlockId exit_label = create_fresh_label(lir_func);
+		BasicBlock* exit_bb = lir_func->body[exit_label];
 		
-		if(DEBUG_LOWER){cout << "Before reachable" << endl;}
-		// set reachable
-		lir_func->body["entry"]->set_reachable(lir_func->body);
+		exit_bb->term = lir_new<Terminal>(Terminal::Ret);
+		exit_bb->reachable = true;
 		
-		// check return stuff
-		if(num_ret > 1){
-			string exit_label = create_fresh_label(lir_func);
-			// emit Label(EXIT)
-			BasicBlock* exit_bb = new BasicBlock;
-			
-			exit_bb->label = exit_label;
-			exit_bb->term = new Terminal(Terminal::Ret);
-			exit_bb->insts = vector<LirInst*>();
-			exit_bb->reachable = true;
-			
-
-			if(lir_func->rettyp == NULL){
-				// emit Return(None)
-				exit_bb->term->value.Ret.op = NULL;
-				// replace all previous Return(None) instructions with Jump(EXIT)
-				for(auto bb : lir_func->body){
-					if(bb.second->term->type == Terminal::Ret){
-						bb.second->term = new Terminal(Terminal::Jump);
-						bb.second->term->value.Jump.next_bb = exit_label;
-					}
+
+		if(lir_func->rettyp == NULL){
+			// emit Return(None)
+			exit_bb->term->value.Ret.op = NULL;
+			// replace all previous Return(None) instructions with Jump(EXIT)
+			for(BlockId id = 0; id < exit_label; id++){
+				BasicBlock* bb = lir_func->body[id];
+				if(bb->term->type == Terminal::Ret){
+					bb->term = lir_new<Terminal>(Terminal::Jump);
+					bb->term->value.Jump.next_bb = exit_label;
 				}
 			}
-			else{
-				string exit_var = create_fresh_var(lir_func, lir_func->rettyp);
-				Operand* op = new Operand(Operand::Var);
-				op->value.Var.id = exit_var;
-				//emit Return(x)
-				exit_bb->term->value.Ret.op = op;
-				// replace all other Return(op) instructions with Copy(exit_var, op); Jump(EXIT)
-				for(auto bb : lir_func->body){
-					if(bb.second->term->type == Terminal::Ret){
-						LirInst* copy = new LirInst(LirInst::Copy);
-						copy->value.Copy.lhs = exit_var;
-						copy->value.Copy.op = bb.second->term->value.Ret.op;
-						bb.second->insts.push_back(copy);
-						bb.second->term = new Terminal(Terminal::Jump);
-						bb.second->term->value.Jump.next_bb = exit_label;
-					}
+		}
+		else{
+			VarId exit_var = create_fresh_var(lir_func, lir_func->rettyp);
+			Operand* op = lir_new<Operand>(Operand::Var);
+			op->value.Var.id = exit_var;
+			//emit Return(x)
+			exit_bb->term->value.Ret.op = op;
+			// replace all other Return(op) instructions with Copy(exit_var, op); Jump(EXIT)
+			for(BlockId id = 0; id < exit_label; id++){
+				BasicBlock* bb = lir_func->body[id];
+				if(bb->term->type == Terminal::Ret){
+					LirInst copy(LirInst::Copy, exit_var);
+					copy.set(0, bb->term->value.Ret.op);
+					bb->insts.push_back(copy);
+					bb->term = lir_new<Terminal>(Terminal::Jump);
+					bb->term->value.Jump.next_bb = exit_label;
 				}
 			}
-			lir_func->body[exit_label] = exit_bb;
 		}
 	}
-	
-	return lir;
-};
+	lir_func->link_blocks();
+}
 
 /*
  * 2.2 Lowering Statements
- * Summary: Takes a stmt and emits LIR instructions into the translation vector w/o returning anything
- * Parameters: LIR_Function* lir_func, Stmt* stmt, vector<string>& translation_vector
+ * Summary: Takes a stmt and emits LIR instructions into the current block w/o returning anything
+ * Parameters: LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks
  * 
 */
-void stmt_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void stmt_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	if (DEBUG_LOWER) cout << "entered stmt_lower" << endl;
 	if(stmt->type == Stmt::If){
 		if (DEBUG_LOWER) cout << "  stmt if_lower" << endl;
-		if_lower(lir_func, stmt, translation_vector);
+		if_lower(lir_func, stmt, blocks);
 	}
 	else if(stmt->type == Stmt::While){
 		if (DEBUG_LOWER) cout << "  stmt while_lower" << endl;
-		while_lower(lir_func, stmt, translation_vector);
+		while_lower(lir_func, stmt, blocks);
 	}
 	else if(stmt->type == Stmt::Assign){
 		if (stmt->value.Assign.rhs->type == Rhs::RhsExp){
 			if (DEBUG_LOWER) cout << "  stmt assign_exp_lower" << endl;
-			assign_exp_lower(lir_func, stmt, translation_vector);
+			assign_exp_lower(lir_func, stmt, blocks);
 		} else {
 			if (DEBUG_LOWER) cout << "  stmt assign_new_lower" << endl;
-			assign_new_lower(lir_func, stmt, translation_vector);
+			assign_new_lower(lir_func, stmt, blocks);
 		}
 	}
 	else if(stmt->type == Stmt::Call){
 		if (DEBUG_LOWER) cout << "  stmt call_lower" << endl;
-		call_lower(lir_func, stmt, translation_vector);
+		call_lower(lir_func, stmt, blocks);
 	}
 	else if(stmt->type == Stmt::Continue){
 		if (DEBUG_LOWER) cout << "  stmt continue_lower" << endl;
-		continue_lower(lir_func, stmt, translation_vector);
+		continue_lower(lir_func, stmt, blocks);
 	}
 	else if(stmt->type == Stmt::Break){
 		if (DEBUG_LOWER) cout << "  stmt break_lower" << endl;
-		break_lower(lir_func, stmt, translation_vector);
+		break_lower(lir_func, stmt, blocks);
 	}
 	else if(stmt->type == Stmt::Return){
 		if (DEBUG_LOWER) cout << "  stmt return_lower" << endl;
 		if (stmt->value.Return.exp == NULL){
-			return_none_lower(lir_func, stmt, translation_vector);
+			return_none_lower(lir_func, stmt, blocks);
 		} else {
-			return_one_lower(lir_func, stmt, translation_vector);
+			return_one_lower(lir_func, stmt, blocks);
 		}
 		// Two case when it returns nothing and when it returns an exp
 		// Return(None)^s: emit Return(None)
@@ -272,256 +250,251 @@ void stmt_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_ve
 	if (DEBUG_LOWER) cout << "exited stmt_lower" << endl;
 }
 
-void if_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void if_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	if (DEBUG_LOWER) cout << "entered if_lower" << endl;
 	
 	// let TT , FF , IF_END be fresh labels
-	string TT = create_fresh_label(lir_func);
-	string FF = create_fresh_label(lir_func);
-	string IF_END = create_fresh_label(lir_func);
+	BlockId TT = create_fresh_label(lir_func);
+	BlockId FF = create_fresh_label(lir_func);
+	BlockId IF_END = create_fresh_label(lir_func);
 	
 	// emit Branch([[Guard]]^e, TT, FF) 
-	Terminal* emit_branch = new Terminal(Terminal::Branch);
-	emit_branch->value.Branch.guard = exp_lower(lir_func, stmt->value.If.guard, translation_vector);
+	Terminal* emit_branch = lir_new<Terminal>(Terminal::Branch);
+	emit_branch->value.Branch.guard = exp_lower(lir_func, stmt->value.If.guard, blocks);
 	emit_branch->value.Branch.tt = TT;
 	emit_branch->value.Branch.ff = FF;
-	translation_vector.push_back(emit_branch);
+	blocks.terminate(emit_branch);
 
 	// emit Label(TT)
-	translation_vector.push_back(new Label(TT));
+	blocks.start(TT);
 
 	// go through all TT statements: [TT]^s
 	for(Stmt* stmt: stmt->value.If.tt){
-		stmt_lower(lir_func, stmt, translation_vector);
+		stmt_lower(lir_func, stmt, blocks);
 	}
 
 	// emit Jump(IF END)
-	Terminal* Jump1 = new Terminal(Terminal::Jump);
+	Terminal* Jump1 = lir_new<Terminal>(Terminal::Jump);
 	Jump1->value.Jump.next_bb = IF_END;
-	translation_vector.push_back(Jump1);
+	blocks.terminate(Jump1);
 
 	// emit Label(FF)
-	translation_vector.push_back(new Label(FF));
+	blocks.start(FF);
 
 	// go through all FF statements: [FF]^s
 	for(Stmt* stmt: stmt->value.If.ff){
-		stmt_lower(lir_func, stmt, translation_vector);
+		stmt_lower(lir_func, stmt, blocks);
 	}
 
 	// emit Jump(IF END)
-	Terminal* Jump2 = new Terminal(Terminal::Jump);
+	Terminal* Jump2 = lir_new<Terminal>(Terminal::Jump);
 	Jump2->value.Jump.next_bb = IF_END;
-	translation_vector.push_back(Jump2);
+	blocks.terminate(Jump2);
 
 	// emit Label(IF END)
-	translation_vector.push_back(new Label(IF_END));
+	blocks.start(IF_END);
 	if (DEBUG_LOWER) cout << "exited if_lower" << endl;
 }
 
-void while_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void while_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 
 	// let WHILE_HDR , WHILE_BODY , WHILE_END be fresh labels
-	string WHILE_HDR = create_fresh_label(lir_func);
-	string WHILE_BODY = create_fresh_label(lir_func);
-	string WHILE_END = create_fresh_label(lir_func);
+	BlockId WHILE_HDR = create_fresh_label(lir_func);
+	BlockId WHILE_BODY = create_fresh_label(lir_func);
+	BlockId WHILE_END = create_fresh_label(lir_func);
 	
 	while_hdr_labels.push(WHILE_HDR);
 	while_end_labels.push(WHILE_END);
 
 	// emit Jump(WHILE HDR)
-	Terminal* Jump1 = new Terminal(Terminal::Jump);
+	Terminal* Jump1 = lir_new<Terminal>(Terminal::Jump);
 	Jump1->value.Jump.next_bb = WHILE_HDR;
-	translation_vector.push_back(Jump1);
+	blocks.terminate(Jump1);
 
 	// emit Label(WHILE HDR)
-	translation_vector.push_back(new Label(WHILE_HDR));
+	blocks.start(WHILE_HDR);
 
 	// emit Branch(guard, WHILE BODY, WHILE END)
-	Terminal* emit_branch = new Terminal(Terminal::Branch);	
-	emit_branch->value.Branch.guard = exp_lower(lir_func, stmt->value.While.guard, translation_vector);
+	Terminal* emit_branch = lir_new<Terminal>(Terminal::Branch);	
+	emit_branch->value.Branch.guard = exp_lower(lir_func, stmt->value.While.guard, blocks);
 	emit_branch->value.Branch.tt = WHILE_BODY;
 	emit_branch->value.Branch.ff = WHILE_END;
-	translation_vector.push_back(emit_branch);
+	blocks.terminate(emit_branch);
 
 	// emit Label(WHILE HDR)
-	translation_vector.push_back(new Label(WHILE_BODY));
+	blocks.start(WHILE_BODY);
 	
 	// go through all body statements: [[body]]^s
 	for(Stmt* stmt: stmt->value.While.body){
-		stmt_lower(lir_func, stmt, translation_vector);
+		stmt_lower(lir_func, stmt, blocks);
 	}
 	
 	// emit Jump(WHILE HDR)
-	Terminal* Jump2 = new Terminal(Terminal::Jump);
+	Terminal* Jump2 = lir_new<Terminal>(Terminal::Jump);
 	Jump2->value.Jump.next_bb = WHILE_HDR;
-	translation_vector.push_back(Jump2);
+	blocks.terminate(Jump2);
 	
 	// emit Label(WHILE END
-	translation_vector.push_back(new Label(WHILE_END));
+	blocks.start(WHILE_END);
 
 	while_hdr_labels.pop();
 	while_end_labels.pop();
 }
 
 
-void assign_exp_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void assign_exp_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	// if lhs is Id(name) then emit Copy(Var(name), [e]^e)
 	if(stmt->value.Assign.lhs->type == Lval::Id){
-		LirInst* copy = new LirInst(LirInst::Copy);
-		copy->value.Copy.lhs = stmt->value.Assign.lhs->value.Id.name; // string
-		copy->value.Copy.op = exp_lower(lir_func, stmt->value.Assign.rhs->value.RhsExp.exp, translation_vector); // Operand*
-		translation_vector.push_back(copy);
+		LirInst copy(LirInst::Copy, lir_func->intern_var(stmt->value.Assign.lhs->value.Id.name));
+		copy.set(0, exp_lower(lir_func, stmt->value.Assign.rhs->value.RhsExp.exp, blocks));
+		blocks.append(copy);
 	}
 	else{
 		// let x = [lhs]^l
 		//TODO; Is type* x what it really returns?
-		Operand* x = lval_lower(lir_func, stmt->value.Assign.lhs, translation_vector);
+		Operand* x = lval_lower(lir_func, stmt->value.Assign.lhs, blocks);
 		// let y = [e]^e
-		Operand* y = exp_lower(lir_func, stmt->value.Assign.rhs->value.RhsExp.exp, translation_vector);
+		Operand* y = exp_lower(lir_func, stmt->value.Assign.rhs->value.RhsExp.exp, blocks);
 		// emit Store(x, y)
-		LirInst* store = new LirInst(LirInst::Store);
-		store->value.Store.dst = x->value.Var.id;
-		store->value.Store.op = y;
-		translation_vector.push_back(store);
+		LirInst store(LirInst::Store);
+		store.set_var(0, x->value.Var.id);
+		store.set(1, y);
+		blocks.append(store);
 	}
 }
 
-void assign_new_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void assign_new_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	// 	if lhs is Id(name) then emit Alloc(Var(name), [e]^e)
-	LirInst* alloc = new LirInst(LirInst::Alloc);
+	LirInst alloc(LirInst::Alloc);
 	if(stmt->value.Assign.lhs->type == Lval::Id){
-		alloc->value.Alloc.lhs = stmt->value.Assign.lhs->value.Id.name;
+		alloc.lhs = lir_func->intern_var(stmt->value.Assign.lhs->value.Id.name);
 		//TODO: Check this later below
-		alloc->value.Alloc.num = exp_lower(lir_func, stmt->value.Assign.rhs->value.New.amount, translation_vector);
+		alloc.set(0, exp_lower(lir_func, stmt->value.Assign.rhs->value.New.amount, blocks));
 
-		translation_vector.push_back(alloc);
+		blocks.append(alloc);
 	}
 	else{
 		// let w be a fresh var with type &typ
-		Type* typ = new Type(Type::Ptr);
-		typ->value.Ptr.ref = stmt->value.Assign.rhs->value.New.type;
-		string w = create_fresh_var(lir_func, typ);
+		Type* typ = ptr_type(stmt->value.Assign.rhs->value.New.type);
+		VarId w = create_fresh_var(lir_func, typ);
 		// let x = [lhs]^l
-		Operand* x = lval_lower(lir_func, stmt->value.Assign.lhs, translation_vector);
+		Operand* x = lval_lower(lir_func, stmt->value.Assign.lhs, blocks);
 		// emit Alloc(w, [e]^e)
-		alloc->value.Alloc.lhs = w;
-		alloc->value.Alloc.num = exp_lower(lir_func, stmt->value.Assign.rhs->value.New.amount, translation_vector);
-		translation_vector.push_back(alloc);
+		alloc.lhs = w;
+		alloc.set(0, exp_lower(lir_func, stmt->value.Assign.rhs->value.New.amount, blocks));
+		blocks.append(alloc);
 		// emit Store(x, w)
-		LirInst* store = new LirInst(LirInst::Store);
-		Operand* new_w = new Operand(Operand::Var);
-		new_w->value.Var.id = w;
-		store->value.Store.dst = x->value.Var.id;
-		store->value.Store.op = new_w;
-		translation_vector.push_back(store);
+		LirInst store(LirInst::Store);
+		store.set_var(0, x->value.Var.id);
+		store.set_var(1, w);
+		blocks.append(store);
 	}
 }
 
-void call_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void call_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	// let aops = ∀a ∈ args . [a]e
 	vector<Operand*> aops;
 	for(Exp* arg: stmt->value.Call.args){
-		aops.push_back(exp_lower(lir_func, arg, translation_vector));
+		aops.push_back(exp_lower(lir_func, arg, blocks));
 	}
 	// let direct = callee is Id(name) and name is not shadowed by a local / parameter
 	bool direct = stmt->value.Call.callee->type == Lval::Id;
-	direct = direct && lir_func->locals.find(stmt->value.Call.callee->value.Id.name) == lir_func->locals.end();
+	direct = direct && !lir_func->is_local(lir_func->find_var(stmt->value.Call.callee->value.Id.name));
 	// if direct and name is an extern then emit CallExt(None, name, aops)
 	if(direct && lir->externs.find(stmt->value.Call.callee->value.Id.name) != lir->externs.end()){
 		if(DEBUG_LOWER) cout << "Call to extern" << endl;
-		LirInst* call_ext = new LirInst(LirInst::CallExt);
-		call_ext->value.CallExt.callee = stmt->value.Call.callee->value.Id.name;
-		call_ext->value.CallExt.args = aops;
-		translation_vector.push_back(call_ext);
+		LirInst call_ext(LirInst::CallExt);
+		call_ext.aux = lir_func->add_call(stmt->value.Call.callee->value.Id.name, aops);
+		blocks.append(call_ext);
 	}
 	// else
 	else{
 		// let NEXT be a fresh label
-		string NEXT = create_fresh_label(lir_func);
+		BlockId NEXT = create_fresh_label(lir_func);
 		// if direct and name is a function then emit CallDirect(None, name, aops, NEXT)
 		if(direct && lir->functions.find(stmt->value.Call.callee->value.Id.name) != lir->functions.end()){
 			if (DEBUG_LOWER) cout << "Call to function" << endl;
-			Terminal* call_direct = new Terminal(Terminal::CallDirect);
+			Terminal* call_direct = lir_new<Terminal>(Terminal::CallDirect);
 			call_direct->value.CallDirect.callee = stmt->value.Call.callee->value.Id.name;
 			call_direct->value.CallDirect.args = aops;
 			call_direct->value.CallDirect.next_bb = NEXT;
-			translation_vector.push_back(call_direct);
+			blocks.terminate(call_direct);
 		}
 		// else emit CallIndirect(None, [callee]ℓe, aops, NEXT)
 		else{
 			if (DEBUG_LOWER) cout << "Call to indirect" << endl;
-			Terminal* call_indirect = new Terminal(Terminal::CallIndirect);
-			call_indirect->value.CallIndirect.callee = lval_exp_lower(lir_func, stmt->value.Call.callee, translation_vector)->value.Var.id;
+			Terminal* call_indirect = lir_new<Terminal>(Terminal::CallIndirect);
+			call_indirect->value.CallIndirect.callee = lval_exp_lower(lir_func, stmt->value.Call.callee, blocks)->value.Var.id;
 			call_indirect->value.CallIndirect.args = aops;
 			call_indirect->value.CallIndirect.next_bb = NEXT;
-			translation_vector.push_back(call_indirect);
+			blocks.terminate(call_indirect);
 		}
 		// emit Label(NEXT)
-		translation_vector.push_back(new Label(NEXT));
+		blocks.start(NEXT);
 	}
 }
 
-void continue_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void continue_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	// find the nearest previous Label(WHILE HDR)
-	string nearest_while_hdr = while_hdr_labels.top(); 
+	BlockId nearest_while_hdr = while_hdr_labels.top(); 
 	// emit Jump(WHILE HDR)
-	Terminal* jump = new Terminal(Terminal::Jump);
+	Terminal* jump = lir_new<Terminal>(Terminal::Jump);
 	jump->value.Jump.next_bb = nearest_while_hdr;
-	translation_vector.push_back(jump);
+	blocks.terminate(jump);
 }
 
-void break_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
+void break_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
 	// find the nearest previous Branch( , , WHILE END)
-	string nearest_while_end = while_end_labels.top();
+	BlockId nearest_while_end = while_end_labels.top();
 	// emit Jump(WHILE END)
-	Terminal* jump = new Terminal(Terminal::Jump);
+	Terminal* jump = lir_new<Terminal>(Terminal::Jump);
 	jump->value.Jump.next_bb = nearest_while_end;
-	translation_vector.push_back(jump);
+	blocks.terminate(jump);
 }
 
-void return_none_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
-	translation_vector.push_back(new Terminal(Terminal::Ret));
+void return_none_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
+	blocks.terminate(lir_new<Terminal>(Terminal::Ret));
 }
 
-void return_one_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector){
-	Operand* op = exp_lower(lir_func, stmt->value.Return.exp, translation_vector);
-	Terminal* ret = new Terminal(Terminal::Ret);
+void return_one_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks){
+	Operand* op = exp_lower(lir_func, stmt->value.Return.exp, blocks);
+	Terminal* ret = lir_new<Terminal>(Terminal::Ret);
 	ret->value.Ret.op = op;
-	translation_vector.push_back(ret);
+	blocks.terminate(ret);
 }
 
 /*
  * 2.3 Lowering Expressions
  *  
- * Summary: Takes a exp and emits LIR instructions into the translation vector,
+ * Summary: Takes a exp and emits LIR instructions into the current block,
  * returning a LIR Operand (a variable or constant) containing the final value of the expression
- * Parameters: LIR_Function* lir_func, Exp* exp, vector<string>& translation_vector
+ * Parameters: LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks
 */
-Operand* exp_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* exp_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	Operand* operand = NULL;
 	if(exp->type == Exp::Num){
 		if(DEBUG_LOWER) cout << "    ->Num" << endl;
-		operand = num_lower(lir_func, exp, translation_vector);
+		operand = num_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    Num->" << endl;
 	}
 	else if(exp->type == Exp::Id){
 		if(DEBUG_LOWER) cout << "    ->Id" << endl;
-		operand = id_lower(lir_func, exp, translation_vector);
+		operand = id_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    Id->" << endl;
 	}
 	else if(exp->type == Exp::Nil){
 		if(DEBUG_LOWER) cout << "    ->Nil" << endl;
-		operand = nil_lower(lir_func, exp, translation_vector);
+		operand = nil_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    Nil->" << endl;
 	}
 	else if(exp->type == Exp::UnOp){
 		if (exp->value.UnOp.op->type == UnaryOp::Neg){
 			if(DEBUG_LOWER) cout << "    ->Neg" << endl;
-			operand = unop_neg_lower(lir_func, exp, translation_vector);
+			operand = unop_neg_lower(lir_func, exp, blocks);
 			if(DEBUG_LOWER) cout << "    Neg->" << endl;
 		} else {
 			if(DEBUG_LOWER) cout << "    ->Deref" << endl;
-			operand = unop_deref_lower(lir_func, exp, translation_vector);
+			operand = unop_deref_lower(lir_func, exp, blocks);
 			if(DEBUG_LOWER) cout << "    Deref->" << endl;
 		}
 	}
@@ -531,27 +504,27 @@ Operand* exp_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_v
 			exp->value.BinOp.op->type == BinaryOp::Mul ||
 			exp->value.BinOp.op->type == BinaryOp::Div){
 			if (DEBUG_LOWER) cout << "    ->Arith" << endl;
-			operand = binop_arith_lower(lir_func, exp, translation_vector);	
+			operand = binop_arith_lower(lir_func, exp, blocks);	
 			if (DEBUG_LOWER) cout << "    Arith->" << endl;
 		} else {
 			if (DEBUG_LOWER) cout << "    ->Compare" << endl;
-			operand = binop_compare_lower(lir_func, exp, translation_vector);
+			operand = binop_compare_lower(lir_func, exp, blocks);
 			if (DEBUG_LOWER) cout << "    Compare->" << endl;
 		}
 	}
 	else if(exp->type == Exp::ArrayAccess){
 		if(DEBUG_LOWER) cout << "    ->ArrayAccess" << endl;
-		operand = arrayaccess_lower(lir_func, exp, translation_vector);
+		operand = arrayaccess_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    ArrayAccess->" << endl;
 	}
 	else if(exp->type == Exp::FieldAccess){
 		if(DEBUG_LOWER) cout << "    ->FieldAccess" << endl;
-		operand = fieldaccess_lower(lir_func, exp, translation_vector);
+		operand = fieldaccess_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    FieldAccess->" << endl;
 	}
 	else if(exp->type == Exp::Call){
 		if(DEBUG_LOWER) cout << "    ->Call" << endl;
-		operand = call_lower(lir_func, exp, translation_vector);
+		operand = call_lower(lir_func, exp, blocks);
 		if(DEBUG_LOWER) cout << "    Call->" << endl;
 	}	
 	else{
@@ -560,301 +533,228 @@ Operand* exp_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_v
 	return operand;
 }
 
-Operand* num_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
-	Operand* operand = new Operand(Operand::Const);
+Operand* num_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
+	Operand* operand = lir_new<Operand>(Operand::Const);
 	operand->value.Const.num = exp->value.Num.n;
 	return operand;
 }
 
-Operand* id_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
-	Operand* operand = new Operand(Operand::Var);
-	operand->value.Var.id = exp->value.Id.name;
+Operand* id_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
+	Operand* operand = lir_new<Operand>(Operand::Var);
+	operand->value.Var.id = lir_func->intern_var(exp->value.Id.name);
 	return operand;
 }
 
-Operand* nil_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
-	Operand* operand = new Operand(Operand::Const);
+Operand* nil_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
+	Operand* operand = lir_new<Operand>(Operand::Const);
 	operand->value.Const.num = 0;
 	return operand;
 }
 
-Operand* unop_neg_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* unop_neg_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	//let lhs be a fresh var of type Int
-	string lhs = create_fresh_var(lir_func, new Type(Type::Int));
+	VarId lhs = create_fresh_var(lir_func, int_type());
 
 	// emit Arith(lhs, Sub, Const(0), [e]^e)
 
 	// create the LirInst of type Arith
-	LirInst* arith_lir = new LirInst(LirInst::Arith);
-	arith_lir->value.Arith.lhs = lhs;
-	arith_lir->value.Arith.aop = new ArithmeticOp(ArithmeticOp::Sub);
+	LirInst arith_lir(LirInst::Arith, lhs);
+	arith_lir.op = ArithmeticOp::Sub;
 
 	// create const(0)
-	Operand* op = new Operand(Operand::Const);
-	op->value.Const.num = 0;
-	arith_lir->value.Arith.left = op;
+	arith_lir.set_const(0, 0);
 
 	// create right [e]^e
-	arith_lir->value.Arith.right = exp_lower(lir_func, exp->value.UnOp.operand, translation_vector); 
+	arith_lir.set(1, exp_lower(lir_func, exp->value.UnOp.operand, blocks));
 
-	// push the LirInst into the translation vector
-	translation_vector.push_back(arith_lir);
+	// append the LirInst to the current block
+	blocks.append(arith_lir);
 	
 	// return lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* unop_deref_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* unop_deref_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let src = [e]e
-	Operand* src = exp_lower(lir_func, exp->value.UnOp.operand, translation_vector);
+	Operand* src = exp_lower(lir_func, exp->value.UnOp.operand, blocks);
 	
 	// let lhs be a fresh var of type τ s . t . src :&τ
-	string lhs;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		lhs = create_fresh_var(lir_func, lir_func->locals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		lhs = create_fresh_var(lir_func, lir->globals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		lhs = create_fresh_var(lir_func, lir_func->params[src->value.Var.id]->value.Ptr.ref);
-	}
-	else{
-		cout << "Bad Bad" << endl;
-	}
+	VarId lhs = create_fresh_var(lir_func, exp->typ);
 	
 	// emit Load(lhs, src)
-	LirInst* load = new LirInst(LirInst::Load);
-	load->value.Load.lhs = lhs;
-	load->value.Load.src = src->value.Var.id;
-	translation_vector.push_back(load);
+	LirInst load(LirInst::Load, lhs);
+	load.set_var(0, src->value.Var.id);
+	blocks.append(load);
 
 	// Return lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* binop_arith_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* binop_arith_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let op1 = left
-	Operand* op1 = exp_lower(lir_func, exp->value.BinOp.left, translation_vector);
+	Operand* op1 = exp_lower(lir_func, exp->value.BinOp.left, blocks);
 	// let op2 = right
-	Operand* op2 = exp_lower(lir_func, exp->value.BinOp.right, translation_vector);
+	Operand* op2 = exp_lower(lir_func, exp->value.BinOp.right, blocks);
 	// let lhs be a fresh var of type Int
-	string lhs = create_fresh_var(lir_func, new Type(Type::Int));
+	VarId lhs = create_fresh_var(lir_func, int_type());
 	// emit Arith(lhs, op, op1, op2)
-	LirInst* arith = new LirInst(LirInst::Arith);
-	arith->value.Arith.lhs = lhs;
-	arith->value.Arith.aop = new ArithmeticOp;
-	arith->value.Arith.left = op1;
-	arith->value.Arith.right = op2;
+	LirInst arith(LirInst::Arith, lhs);
+	arith.set(0, op1);
+	arith.set(1, op2);
 	BinaryOp* binop = exp->value.BinOp.op;
 	if(binop->type == BinaryOp::Add){
-		arith->value.Arith.aop->type = ArithmeticOp::Add;
+		arith.op = ArithmeticOp::Add;
 	}
 	else if(binop->type == BinaryOp::Sub){
-		arith->value.Arith.aop->type = ArithmeticOp::Sub;
+		arith.op = ArithmeticOp::Sub;
 	}
 	else if(binop->type == BinaryOp::Mul){
-		arith->value.Arith.aop->type = ArithmeticOp::Mul;
+		arith.op = ArithmeticOp::Mul;
 	}
 	else if(binop->type == BinaryOp::Div){
-		arith->value.Arith.aop->type = ArithmeticOp::Div;
+		arith.op = ArithmeticOp::Div;
 	}
-	translation_vector.push_back(arith);
+	blocks.append(arith);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* binop_compare_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* binop_compare_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let op1 = left
-	Operand* op1 = exp_lower(lir_func, exp->value.BinOp.left, translation_vector);
+	Operand* op1 = exp_lower(lir_func, exp->value.BinOp.left, blocks);
 	// let op2 = right
-	Operand* op2 = exp_lower(lir_func, exp->value.BinOp.right, translation_vector);
+	Operand* op2 = exp_lower(lir_func, exp->value.BinOp.right, blocks);
 	// let lhs be a fresh var of type Int
-	string lhs = create_fresh_var(lir_func, new Type(Type::Int));
+	VarId lhs = create_fresh_var(lir_func, int_type());
 	// emit Cmp(lhs, op, op1, op2)
-	LirInst* cmp = new LirInst(LirInst::Cmp);
-	cmp->value.Cmp.lhs = lhs;
-	cmp->value.Cmp.aop = new ComparisonOp;
-	cmp->value.Cmp.left = op1;
-	cmp->value.Cmp.right = op2;
+	LirInst cmp(LirInst::Cmp, lhs);
+	cmp.set(0, op1);
+	cmp.set(1, op2);
 	BinaryOp* binop = exp->value.BinOp.op;
 	if(binop->type == BinaryOp::Equal){
-		cmp->value.Cmp.aop->type = ComparisonOp::Equal;
+		cmp.op = ComparisonOp::Equal;
 	}
 	else if(binop->type == BinaryOp::NotEq){
-		cmp->value.Cmp.aop->type = ComparisonOp::NotEq;
+		cmp.op = ComparisonOp::NotEq;
 	}
 	else if(binop->type == BinaryOp::Lt){
-		cmp->value.Cmp.aop->type = ComparisonOp::Lt;
+		cmp.op = ComparisonOp::Lt;
 	}
 	else if(binop->type == BinaryOp::Lte){
-		cmp->value.Cmp.aop->type = ComparisonOp::Lte;
+		cmp.op = ComparisonOp::Lte;
 	}
 	else if(binop->type == BinaryOp::Gt){
-		cmp->value.Cmp.aop->type = ComparisonOp::Gt;
+		cmp.op = ComparisonOp::Gt;
 	}
 	else if(binop->type == BinaryOp::Gte){
-		cmp->value.Cmp.aop->type = ComparisonOp::Gte;
+		cmp.op = ComparisonOp::Gte;
 	}
-	translation_vector.push_back(cmp);
+	blocks.append(cmp);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* arrayaccess_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* arrayaccess_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let src = ptr
-	Operand* src = exp_lower(lir_func, exp->value.ArrayAccess.ptr, translation_vector);
+	Operand* src = exp_lower(lir_func, exp->value.ArrayAccess.ptr, blocks);
 	// let idx = index
-	Operand* idx = exp_lower(lir_func, exp->value.ArrayAccess.index, translation_vector);
+	Operand* idx = exp_lower(lir_func, exp->value.ArrayAccess.index, blocks);
 	// let elem be a fresh var of type &t s . t . src :&t
-	string elem;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		elem = create_fresh_var(lir_func, lir_func->locals[src->value.Var.id]);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		elem = create_fresh_var(lir_func, lir->globals[src->value.Var.id]);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		elem = create_fresh_var(lir_func, lir_func->params[src->value.Var.id]->value.Ptr.ref);
-	}
-	else{
-		cout << "Bad Bad" << endl;
-	}
+	VarId elem = create_fresh_var(lir_func, exp->value.ArrayAccess.ptr->typ);
 	// let lhs be a fresh var of type t s . t . src :&t
-	string lhs;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		lhs = create_fresh_var(lir_func, lir_func->locals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		lhs = create_fresh_var(lir_func, lir->globals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		lhs = create_fresh_var(lir_func, lir_func->params[src->value.Var.id]->value.Ptr.ref);
-	}
-	else
-		cout << "Bad Bad" << endl;
+	VarId lhs = create_fresh_var(lir_func, exp->typ);
 		
 	// emit Gep(elem, src, idx)
-	LirInst* gep = new LirInst(LirInst::Gep);
-	gep->value.Gep.lhs = elem;
-	gep->value.Gep.src = src->value.Var.id;
-	gep->value.Gep.idx = idx;
-	translation_vector.push_back(gep);
+	LirInst gep(LirInst::Gep, elem);
+	gep.set_var(0, src->value.Var.id);
+	gep.set(1, idx);
+	blocks.append(gep);
 	// emit Load(lhs, elem)
-	LirInst* load = new LirInst(LirInst::Load);
-	load->value.Load.lhs = lhs;
-	load->value.Load.src = elem;
-	translation_vector.push_back(load);
+	LirInst load(LirInst::Load, lhs);
+	load.set_var(0, elem);
+	blocks.append(load);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* fieldaccess_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* fieldaccess_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let src = ptr
-	Operand* src = exp_lower(lir_func, exp->value.FieldAccess.ptr, translation_vector);
+	Operand* src = exp_lower(lir_func, exp->value.FieldAccess.ptr, blocks);
 	// let fldp be a fresh var of type &t s . t . src :& Structid , id [ fld ]:t
-	string struct_name;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		struct_name = get_struct_name(lir_func->locals[src->value.Var.id]);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		struct_name = get_struct_name(lir->globals[src->value.Var.id]);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		struct_name = get_struct_name(lir_func->params[src->value.Var.id]);
-	}
-	else
-		cout << "Bad Bad" << endl;
-	Type* fldp_type = new Type(Type::Ptr);
-	fldp_type->value.Ptr.ref = lir->structs[struct_name][exp->value.FieldAccess.field];
-	
-	string fldp = create_fresh_var(lir_func, fldp_type);
+	VarId fldp = create_fresh_var(lir_func, ptr_type(exp->typ));
 	// let lhs be a fresh var of type t s . t . src :& Structid , id [ fld ]:t
-	string lhs = create_fresh_var(lir_func, lir->structs[struct_name][exp->value.FieldAccess.field]);
+	VarId lhs = create_fresh_var(lir_func, exp->typ);
 	// emit Gfp(fldp, src, fld)
-	LirInst* gfp = new LirInst(LirInst::Gfp);
-	gfp->value.Gfp.lhs = fldp;
-	gfp->value.Gfp.src = src->value.Var.id;
-	gfp->value.Gfp.field = exp->value.FieldAccess.field;
-	translation_vector.push_back(gfp);
+	LirInst gfp(LirInst::Gfp, fldp);
+	gfp.set_var(0, src->value.Var.id);
+	gfp.aux = lir_func->intern_field(exp->value.FieldAccess.field);
+	blocks.append(gfp);
 	// emit Load(lhs, fldp)
-	LirInst* load = new LirInst(LirInst::Load);
-	load->value.Load.lhs = lhs;
-	load->value.Load.src = fldp;
-	translation_vector.push_back(load);
+	LirInst load(LirInst::Load, lhs);
+	load.set_var(0, fldp);
+	blocks.append(load);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* call_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector){
+Operand* call_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks){
 	// let aops = ∀a ∈ args . [a]
 	vector<Operand*> aops;
 	for(Exp* arg: exp->value.Call.args){
-		aops.push_back(exp_lower(lir_func, arg, translation_vector));
+		aops.push_back(exp_lower(lir_func, arg, blocks));
 	}
 	// let direct = callee is Id(name) and name is not shadowed by a local / parameter
 	bool direct = exp->value.Call.callee->type == Exp::Id;
-	direct = direct && lir_func->locals.find(exp->value.Call.callee->value.Id.name) == lir_func->locals.end();
+	direct = direct && !lir_func->is_local(lir_func->find_var(exp->value.Call.callee->value.Id.name));
 	// let fun = callee
-	Operand* fun = exp_lower(lir_func, exp->value.Call.callee, translation_vector);
+	Operand* fun = exp_lower(lir_func, exp->value.Call.callee, blocks);
 	// let lhs be a fresh var of type τ s . t . fun :&( _ )→ τ
-	string lhs;
-	if(lir->functions.find(fun->value.Var.id) != lir->functions.end()){
-		lhs = create_fresh_var(lir_func, lir->functions[fun->value.Var.id]->rettyp);
-	}
-	else if(lir_func->locals.find(fun->value.Var.id) != lir_func->locals.end()){
-		lhs = create_fresh_var(lir_func, lir_func->locals[fun->value.Var.id]->value.Ptr.ref->value.Fn.ret);
-	}
-	else{
-		lhs = create_fresh_var(lir_func, lir->externs[fun->value.Var.id]->value.Fn.ret);
-	}
+	VarId lhs = create_fresh_var(lir_func, exp->typ);
 	// if direct and name is an extern then emit CallExt(lhs, name, aops)
 	if(direct && lir->externs.find(exp->value.Call.callee->value.Id.name) != lir->externs.end()){
-		LirInst* call_ext = new LirInst(LirInst::CallExt);
-		call_ext->value.CallExt.lhs = lhs;
-		call_ext->value.CallExt.callee = exp->value.Call.callee->value.Id.name;
-		call_ext->value.CallExt.args = aops;
-		translation_vector.push_back(call_ext);
+		LirInst call_ext(LirInst::CallExt, lhs);
+		call_ext.aux = lir_func->add_call(exp->value.Call.callee->value.Id.name, aops);
+		blocks.append(call_ext);
 	}
 	// else
 	else{
 		// let NEXT be a fresh label
-		string NEXT = create_fresh_label(lir_func);
+		BlockId NEXT = create_fresh_label(lir_func);
 		// if direct and name is a function then emit CallDirect(lhs, name, aops, NEXT)
 		if(direct && lir->functions.find(exp->value.Call.callee->value.Id.name) != lir->functions.end()){
-			Terminal* call_direct = new Terminal(Terminal::CallDirect);
+			Terminal* call_direct = lir_new<Terminal>(Terminal::CallDirect);
 			call_direct->value.CallDirect.lhs = lhs;
 			call_direct->value.CallDirect.callee = exp->value.Call.callee->value.Id.name;
 			call_direct->value.CallDirect.args = aops;
 			call_direct->value.CallDirect.next_bb = NEXT;
-			translation_vector.push_back(call_direct);
+			blocks.terminate(call_direct);
 		}
 		// else emit CallIndirect(lhs, fun, aops, NEXT)
 		else{
-			Terminal* call_indirect = new Terminal(Terminal::CallIndirect);
+			Terminal* call_indirect = lir_new<Terminal>(Terminal::CallIndirect);
 			call_indirect->value.CallIndirect.lhs = lhs;
 			call_indirect->value.CallIndirect.callee = fun->value.Var.id;
 			call_indirect->value.CallIndirect.args = aops;
 			call_indirect->value.CallIndirect.next_bb = NEXT;
-			translation_vector.push_back(call_indirect);
+			blocks.terminate(call_indirect);
 		}
 		// emit Label(NEXT)
-		translation_vector.push_back(new Label(NEXT));		
+		blocks.start(NEXT);		
 	}
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
@@ -862,25 +762,25 @@ Operand* call_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_
 /* 
  * 2.4 Lowering Lvals, NOT AN ID
  *
- * These functions emit LIR instructions into the translation vector that will compute the location where a 
+ * These functions emit LIR instructions into the current block that will compute the location where a 
  * value should be stored and return a variable that contains a pointer to that location. Note that the argument
  * should not be an Id.
  */
-Operand* lval_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
+Operand* lval_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
 	Operand* operand = NULL;
 	if (lval->type == Lval::Deref){
 		if(DEBUG_LOWER) cout << "    ->lval_deref" << endl;
-		operand = deref_lower(lir_func, lval, translation_vector);
+		operand = deref_lower(lir_func, lval, blocks);
 		if(DEBUG_LOWER) cout << "    lval_deref->" << endl;
 	} 
 	else if (lval->type == Lval::ArrayAccess){
 		if(DEBUG_LOWER) cout << "    ->lval_arrayAccess" << endl;
-		operand = arrayaccess_lower(lir_func, lval, translation_vector);
+		operand = arrayaccess_lower(lir_func, lval, blocks);
 		if(DEBUG_LOWER) cout << "    lval_arrayAccess->" << endl;
 	} 
 	else if (lval->type == Lval::FieldAccess){
 		if(DEBUG_LOWER) cout << "    ->lval_fieldAccess" << endl;
-		operand = fieldaccess_lower(lir_func, lval, translation_vector);
+		operand = fieldaccess_lower(lir_func, lval, blocks);
 		if(DEBUG_LOWER) cout << "    lval_fieldAccess->" << endl;
 	} 
 	else if (lval->type == Lval::Id){ 
@@ -889,67 +789,41 @@ Operand* lval_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translatio
 	return operand;
 }
 
-Operand* deref_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
-	return lval_exp_lower(lir_func, lval->value.Deref.lval, translation_vector);
+Operand* deref_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
+	return lval_exp_lower(lir_func, lval->value.Deref.lval, blocks);
 }
 
-Operand* arrayaccess_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
+Operand* arrayaccess_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
 	// let src = ptr
-	Operand* src = lval_exp_lower(lir_func, lval->value.ArrayAccess.ptr, translation_vector);
+	Operand* src = lval_exp_lower(lir_func, lval->value.ArrayAccess.ptr, blocks);
 	// let idx = index
-	Operand* idx = exp_lower(lir_func, lval->value.ArrayAccess.index, translation_vector);
+	Operand* idx = exp_lower(lir_func, lval->value.ArrayAccess.index, blocks);
 	// let lhs be a fresh var of type τ s . t . src :τ
-	string lhs;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		lhs = create_fresh_var(lir_func, lir_func->locals[src->value.Var.id]);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		lhs = create_fresh_var(lir_func, lir->globals[src->value.Var.id]);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		lhs = create_fresh_var(lir_func, lir_func->params[src->value.Var.id]);
-	}
-	else
-		cout << "Bad Bad" << endl;
+	VarId lhs = create_fresh_var(lir_func, lval->value.ArrayAccess.ptr->typ);
 	// emit Gep(lhs, src, idx)
-	LirInst* gep = new LirInst(LirInst::Gep);
-	gep->value.Gep.lhs = lhs;
-	gep->value.Gep.src = src->value.Var.id;
-	gep->value.Gep.idx = idx;
-	translation_vector.push_back(gep);
+	LirInst gep(LirInst::Gep, lhs);
+	gep.set_var(0, src->value.Var.id);
+	gep.set(1, idx);
+	blocks.append(gep);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
 
-Operand* fieldaccess_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
+Operand* fieldaccess_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
 	// let src = ptr
-	Operand* src = lval_exp_lower(lir_func, lval->value.FieldAccess.ptr, translation_vector);
+	Operand* src = lval_exp_lower(lir_func, lval->value.FieldAccess.ptr, blocks);
 	// let lhs be a fresh var of type &τ s . t . src :& Structid , id [ fld ]:τ
-	string struct_name;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		struct_name = get_struct_name(lir_func->locals[src->value.Var.id]);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		struct_name = get_struct_name(lir->globals[src->value.Var.id]);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		struct_name = get_struct_name(lir_func->params[src->value.Var.id]);
-	}
-	else
-		cout << "Bad Bad" << endl;
-	Type* lhs_type = new Type(Type::Ptr);
-	lhs_type->value.Ptr.ref = lir->structs[struct_name][lval->value.FieldAccess.field];
-	string lhs = create_fresh_var(lir_func, lhs_type);
+	Type* lhs_type = ptr_type(lval->typ);
+	VarId lhs = create_fresh_var(lir_func, lhs_type);
 	// emit Gfp(lhs, src, fld)
-	LirInst* gfp = new LirInst(LirInst::Gfp);
-	gfp->value.Gfp.lhs = lhs;
-	gfp->value.Gfp.src = src->value.Var.id;
-	gfp->value.Gfp.field = lval->value.FieldAccess.field;
-	translation_vector.push_back(gfp);
+	LirInst gfp(LirInst::Gfp, lhs);
+	gfp.set_var(0, src->value.Var.id);
+	gfp.aux = lir_func->intern_field(lval->value.FieldAccess.field);
+	blocks.append(gfp);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
@@ -960,46 +834,34 @@ Operand* fieldaccess_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& tra
  * These functions lower an Lval as if it were an expression, returning a variable containing the final value.
  * Note that the argument can be an Id.
  */
-Operand* lval_exp_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
+Operand* lval_exp_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
 	Operand* operand;
 	if (lval->type == Lval::Id){
-		operand = id_lower(lir_func, lval, translation_vector);
+		operand = id_lower(lir_func, lval, blocks);
 	} else {
-		operand = not_id_lower(lir_func, lval, translation_vector);
+		operand = not_id_lower(lir_func, lval, blocks);
 	}
 	return operand;
 }
 
-Operand* id_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
-	Operand* var = new Operand(Operand::Var);
-	var->value.Var.id = lval->value.Id.name;
+Operand* id_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
+	Operand* var = lir_new<Operand>(Operand::Var);
+	var->value.Var.id = lir_func->intern_var(lval->value.Id.name);
 	return var;
 }
 
-Operand* not_id_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector){
+Operand* not_id_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks){
 	// let src = [[lv]]^l
-	Operand* src = lval_lower(lir_func, lval, translation_vector);
+	Operand* src = lval_lower(lir_func, lval, blocks);
 
 	// let lhs be a fresh var of type T s . t . src :&T
-	string lhs;
-	if(lir_func->locals.find(src->value.Var.id) != lir_func->locals.end()){
-		lhs = create_fresh_var(lir_func, lir_func->locals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir->globals.find(src->value.Var.id) != lir->globals.end()){
-		lhs = create_fresh_var(lir_func, lir->globals[src->value.Var.id]->value.Ptr.ref);
-	}
-	else if(lir_func->params.find(src->value.Var.id) != lir_func->params.end()){
-		lhs = create_fresh_var(lir_func, lir_func->params[src->value.Var.id]->value.Ptr.ref);
-	}
-	else
-		cout << "Bad Bad" << endl;
+	VarId lhs = create_fresh_var(lir_func, lval->typ);
 	// emit Load(lhs, src)
-	LirInst* load = new LirInst(LirInst::Load);
-	load->value.Load.lhs = lhs;
-	load->value.Load.src = src->value.Var.id;
-	translation_vector.push_back(load);
+	LirInst load(LirInst::Load, lhs);
+	load.set_var(0, src->value.Var.id);
+	blocks.append(load);
 	// lhs
-	Operand* to_be_returned_op = new Operand(Operand::Var);
+	Operand* to_be_returned_op = lir_new<Operand>(Operand::Var);
 	to_be_returned_op->value.Var.id = lhs;
 	return to_be_returned_op;
 }
@@ -1009,7 +871,7 @@ Operand* not_id_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translat
  * (1) creates a new variable of that type, inserting it into the enclosing function's locals;
  * and (2) returns that variable to the caller. T 
  */
-string create_fresh_var(LIR_Function* lir_func, Type* type){
+VarId create_fresh_var(LIR_Function* lir_func, Type* type){
 	string func_name = lir_func->name;
 	
 	if(fresh_vars.find(func_name) == fresh_vars.end()){
@@ -1017,13 +879,13 @@ string create_fresh_var(LIR_Function* lir_func, Type* type){
 	}
 
 	// Add the label to the locals of the lir_function
-	string label = "_t" + std::to_string(fresh_vars[func_name]);
-	lir_func->locals[label] = type;
+	VarId var = lir_func->intern_var("_t" + std::to_string(fresh_vars[func_name]));
+	lir_func->add_local(var, type);
 	
 	// Increase the counter
 	fresh_vars[func_name]++;
 
-	return label;
+	return var;
 }
 
 /*
@@ -1031,46 +893,216 @@ string create_fresh_var(LIR_Function* lir_func, Type* type){
  * they should be called lbln, where n is a counter that starts from 1 for each function and increases 
  * each time the helper function is called (e.g., lbl1, lbl2, etc). 
  */
-string create_fresh_label(LIR_Function* lir_func){
+BlockId create_fresh_label(LIR_Function* lir_func){
 	string func_name = lir_func->name;
 	if(fresh_labels.find(func_name) == fresh_labels.end()){
 		fresh_labels[func_name] = 1;
 	}
 
-	string label = "lbl" + std::to_string(fresh_labels[func_name]);
+	BlockId label = lir_func->intern_block("lbl" + std::to_string(fresh_labels[func_name]));
 	fresh_labels[func_name]++;
 
 	return label;
 }
 
-void BasicBlock::set_reachable(map<string, BasicBlock*>& body){
-	// if this block is already reachable, return
-	if(reachable){
-		return;
+VarId LIR_Function::intern_var(const string& var){
+	auto it = var_ids.find(var);
+	if(it != var_ids.end()){
+		return it->second;
+	}
+	VarId id = vars.size();
+	vars.push_back(LirVar());
+	vars.back().name = var;
+	var_ids[var] = id;
+	return id;
+}
+
+VarId LIR_Function::find_var(const string& var) const {
+	auto it = var_ids.find(var);
+	return it == var_ids.end() ? NO_VAR : it->second;
+}
+
+BlockId LIR_Function::intern_block(const string& label){
+	auto it = block_ids.find(label);
+	if(it != block_ids.end()){
+		return it->second;
+	}
+	BasicBlock* bb = lir_new<BasicBlock>();
+	bb->label = label;
+	bb->id = body.size();
+	body.push_back(bb);
+	block_ids[label] = bb->id;
+	return bb->id;
+}
+
+BlockId LIR_Function::find_block(const string& label) const {
+	auto it = block_ids.find(label);
+	return it == block_ids.end() ? NO_BLOCK : it->second;
+}
+
+vector<BlockId> LIR_Function::blocks_by_label() const {
+	vector<BlockId> ids;
+	for(BlockId id = 0; id < (BlockId)body.size(); id++){
+		ids.push_back(id);
+	}
+	sort(ids.begin(), ids.end(), [&](BlockId a, BlockId b){ return body[a]->label < body[b]->label; });
+	return ids;
+}
+
+void LIR_Function::add_param(VarId id, Type* type){
+	if(!vars[id].is_param){
+		vars[id].is_param = true;
+		num_params++;
+	}
+	vars[id].param_type = type;
+}
+
+void LIR_Function::add_local(VarId id, Type* type){
+	if(!vars[id].is_local){
+		vars[id].is_local = true;
+		num_locals++;
+	}
+	vars[id].local_type = type;
+}
+
+void LIR_Function::remove_local(VarId id){
+	if(vars[id].is_local){
+		vars[id].is_local = false;
+		num_locals--;
+	}
+}
+
+int32_t LIR_Function::intern_field(const string& field){
+	auto it = field_ids.find(field);
+	if(it != field_ids.end()){
+		return it->second;
+	}
+	int32_t id = fields.size();
+	fields.push_back(field);
+	field_ids[field] = id;
+	return id;
+}
+
+int32_t LIR_Function::add_call(const string& callee, const vector<Operand*>& args){
+	calls.push_back(LirCall());
+	calls.back().callee = callee;
+	calls.back().args = args;
+	return calls.size() - 1;
+}
+
+static vector<VarId> vars_by_name(const vector<LirVar>& vars, bool params){
+	vector<VarId> ids;
+	for(VarId id = 0; id < (VarId)vars.size(); id++){
+		if(params ? vars[id].is_param : vars[id].is_local){
+			ids.push_back(id);
+		}
+	}
+	sort(ids.begin(), ids.end(), [&](VarId a, VarId b){ return vars[a].name < vars[b].name; });
+	return ids;
+}
+
+vector<VarId> LIR_Function::params_by_name() const {
+	return vars_by_name(vars, true);
+}
+
+vector<VarId> LIR_Function::locals_by_name() const {
+	return vars_by_name(vars, false);
+}
+
+thread_local Arena lir_arena;
+
+/*
+ * The union does not know which member is live, so a terminal destroys the
+ * member that matches its type. Operands are arena objects of their own
+ * and are left alone.
+ */
+Terminal::~Terminal(){
+	switch(type){
+		case Terminal::CallDirect:
+			value.CallDirect.callee.~string();
+			value.CallDirect.args.~vector();
+			break;
+		case Terminal::CallIndirect:
+			value.CallIndirect.args.~vector();
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Drop the body and locals of a function once its code has been generated;
+ * the blocks themselves are freed with the arena. The function stays in
+ * lir->functions so later calls still see its signature.
+ */
+void release_function(LIR_Function* lir_func){
+	lir_func->body.clear();
+	lir_func->block_ids.clear();
+	lir_func->fields.clear();
+	lir_func->field_ids.clear();
+	lir_func->calls.clear();
+	vector<LirVar> vars;
+	vars.swap(lir_func->vars);
+	lir_func->var_ids.clear();
+	lir_func->num_params = 0;
+	lir_func->num_locals = 0;
+	for(LirVar& var : vars){
+		if(var.is_param){
+			lir_func->add_param(lir_func->intern_var(var.name), var.param_type);
+		}
+	}
+	fresh_vars.erase(lir_func->name);
+	fresh_labels.erase(lir_func->name);
+}
+
+void Terminal::successors(vector<BlockId>& out){
+	if(type == Terminal::Branch){
+		out.push_back(value.Branch.tt);
+		out.push_back(value.Branch.ff);
+	}
+	else if(type == Terminal::Jump){
+		out.push_back(value.Jump.next_bb);
 	}
-	// set this block as reachable
-	reachable = true;
-	// if this block has a terminal instruction
-	if(term->type == Terminal::Branch){
-		// set the true branch as reachable
-		body[term->value.Branch.tt]->set_reachable(body);
-		// set the false branch as reachable
-		body[term->value.Branch.ff]->set_reachable(body);
+	else if(type == Terminal::CallDirect){
+		out.push_back(value.CallDirect.next_bb);
 	}
-	else if(term->type == Terminal::Jump){
-		// set the next block as reachable
-		body[term->value.Jump.next_bb]->set_reachable(body);
+	else if(type == Terminal::CallIndirect){
+		out.push_back(value.CallIndirect.next_bb);
 	}
-	else if(term->type == Terminal::CallDirect){
-		// set the next block as reachable
-		body[term->value.CallDirect.next_bb]->set_reachable(body);
+}
+
+/*
+ * Depth first walk from the entry block, with an explicit stack so long
+ * chains of blocks cannot overflow the call stack. See CFG (cfg.hpp) for
+ * the order of the blocks and their dominators.
+ */
+void LIR_Function::set_reachable(){
+	vector<BlockId> work(1, find_block("entry"));
+	while(!work.empty()){
+		BasicBlock* bb = body[work.back()];
+		work.pop_back();
+		// if this block is already reachable, skip it
+		if(bb->reachable){
+			continue;
+		}
+		bb->reachable = true;
+		bb->term->successors(work);
 	}
-	else if(term->type == Terminal::CallIndirect){
-		// set the next block as reachable
-		body[term->value.CallIndirect.next_bb]->set_reachable(body);
+}
+
+void LIR_Function::link_blocks(){
+	for(BasicBlock* bb : body){
+		bb->succs.clear();
+		bb->preds.clear();
 	}
-	else if(term->type == Terminal::Ret){
-		num_ret++;
+	for(BasicBlock* bb : body){
+		if(bb->term == NULL){
+			continue;
+		}
+		bb->term->successors(bb->succs);
+		for(BlockId succ : bb->succs){
+			body[succ]->preds.push_back(bb->id);
+		}
 	}
 }
 
@@ -1103,26 +1135,29 @@ void LIR_Program::toString(){
 	cout << endl;
 };
 
+// the function whose variable names the instructions print
+static thread_local LIR_Function* print_func;
+
 void LIR_Function::toString(){
+	print_func = this;
 	cout << endl << "Function " << name << "(";
-	auto it = params.begin();
-	if(params.size() != 0){
-		for(long unsigned int i = 0; i < params.size()-1; i++){
-			cout << it->first << ":" << it->second->type_string() << ", ";
-			it++;
+	vector<VarId> params = params_by_name();
+	for(size_t i = 0; i < params.size(); i++){
+		if(i > 0){
+			cout << ", ";
 		}
-		cout << it->first << ":" << it->second->type_string();
+		cout << var_name(params[i]) << ":" << param_type(params[i])->type_string();
 	}
 	cout << ") -> " << rettyp->type_string() << " {" << endl;
 
 	// locals
 	cout << "  Locals" << endl;
-	for(auto e : locals){
-		cout << "    " << e.first << " : " << e.second->type_string() << endl;
+	for(VarId id : locals_by_name()){
+		cout << "    " << var_name(id) << " : " << local_type(id)->type_string() << endl;
 	}
 
-	for(auto e : body){
-		e.second->toString();
+	for(BlockId id : blocks_by_label()){
+		body[id]->toString();
 	}
 	
 	cout << "}" << endl;
@@ -1134,16 +1169,36 @@ void BasicBlock::toString(){
 	if(reachable == false)
 		return;
 	cout << endl << "  " << label << ":" << endl;
-	// vector<LirInst*> insts; //The translational vector
-	for (LirInst* e : insts){
+	for(const LirPhi& phi : phis){
+		cout << "    Phi(" << print_func->var_name(phi.lhs) << ", [";
+		for(size_t i = 0; i < phi.args.size(); i++){
+			if(i > 0){
+				cout << ", ";
+			}
+			cout << print_func->var_name(phi.args[i]);
+		}
+		cout << "])" << endl;
+	}
+	// vector<LirInst> insts
+	for (const LirInst& e : insts){
 		cout << "    ";
-		e->toString();
+		e.toString();
 	}
 	// Terminal* term
 	cout << "    ";
 	term->toString();
 };
 
+// a constant or the name of a variable, like Operand::toString
+static void print_slot(const LirInst& inst, int i){
+	if(inst.is_var(i)){
+		cout << print_func->var_name(inst.var(i));
+	}
+	else{
+		cout << inst.num(i);
+	}
+}
+
 // | Alloc { lhs: VarId, num: Operand }
 // | Arith { lhs: VarId, aop: ArithmeticOp, left: Operand, right: Operand }
 // | CallExt { lhs: option<VarId>, callee: FuncId, args: vector<Operand> }
@@ -1151,89 +1206,95 @@ void BasicBlock::toString(){
 // | Copy { lhs: VarId, op: Operand }
 // | Gep { lhs: VarId, src: VarId, idx: Operand }
 // | Gfp { lhs: VarId, src: VarId, field: string }
+// | Len { lhs: VarId, src: VarId }
 // | Load { lhs: VarId, src: VarId }
 // | Store { dst: VarId, op: Operand }
 
-// enum type{Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Load, Store} type;
-void LirInst::toString(){
+// enum type{Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Len, Load, Store} type;
+void LirInst::toString() const {
 	if(type == LirInst::Alloc){
-		cout << "Alloc(" << value.Alloc.lhs << ", ";
-		value.Alloc.num->toString();
+		cout << "Alloc(" << print_func->var_name(lhs) << ", ";
+		print_slot(*this, 0);
 		cout << ")" << endl;
 	}
 	else if(type == LirInst::Arith){
-		cout << "Arith(" << value.Arith.lhs << ", ";
-		value.Arith.aop->toString();
+		cout << "Arith(" << print_func->var_name(lhs) << ", ";
+		ArithmeticOp((enum ArithmeticOp::type)op).toString();
 		cout << ", ";
-		value.Arith.left->toString();
+		print_slot(*this, 0);
 		cout << ", ";
-		value.Arith.right->toString();
+		print_slot(*this, 1);
 		cout << ")" << endl;
 	}
 	else if(type == LirInst::CallExt){
 		cout << "CallExt(";
-		if(value.CallExt.lhs != ""){
-			cout << value.CallExt.lhs << ", ";
+		if(lhs != NO_VAR){
+			cout << print_func->var_name(lhs) << ", ";
 		}
 		else{
 			cout << "_, ";
 		}
-		cout << value.CallExt.callee << ", [";
-		if(value.CallExt.args.size() != 0){
-			for(long unsigned int i = 0; i < value.CallExt.args.size() - 1; i++){
-				value.CallExt.args[i]->toString();
+		const LirCall& c = print_func->call(*this);
+		cout << c.callee << ", [";
+		for(size_t i = 0; i < c.args.size(); i++){
+			if(i > 0){
 				cout << ", ";
 			}
-			value.CallExt.args[value.CallExt.args.size() - 1]->toString();
+			c.args[i]->toString();
 		}
 		cout << "])" << endl;
 	}
 	else if(type == LirInst::Cmp){
-		cout << "Cmp(" << value.Cmp.lhs << ", ";
-		value.Cmp.aop->toString();
+		cout << "Cmp(" << print_func->var_name(lhs) << ", ";
+		ComparisonOp((enum ComparisonOp::type)op).toString();
 		cout << ", ";
-		value.Cmp.left->toString();
+		print_slot(*this, 0);
 		cout << ", ";
-		value.Cmp.right->toString();
+		print_slot(*this, 1);
 		cout << ")" << endl;
 	}
 	else if(type == LirInst::Copy){
-		cout << "Copy(" << value.Copy.lhs << ", ";
-		value.Copy.op->toString();
+		cout << "Copy(" << print_func->var_name(lhs) << ", ";
+		print_slot(*this, 0);
 		cout << ")" << endl;
 	}
 	else if(type == LirInst::Gep){
-		cout << "Gep(" << value.Gep.lhs << ", ";
-		cout << value.Gep.src << ", ";
-		value.Gep.idx->toString();
-		cout << ")" << endl;
+		cout << "Gep(" << print_func->var_name(lhs) << ", ";
+		cout << print_func->var_name(var(0)) << ", ";
+		print_slot(*this, 1);
+		cout << (op == LirInst::InBounds ? ", in_bounds)" : ")") << endl;
 	}
 	else if(type == LirInst::Gfp){
-		cout << "Gfp(" << value.Gfp.lhs << ", ";
-		cout << value.Gfp.src << ", ";
-		cout << value.Gfp.field << ")" << endl;
+		cout << "Gfp(" << print_func->var_name(lhs) << ", ";
+		cout << print_func->var_name(var(0)) << ", ";
+		cout << print_func->field(*this) << ")" << endl;
+	}
+	else if(type == LirInst::Len){
+		cout << "Len(" << print_func->var_name(lhs) << ", ";
+		cout << print_func->var_name(var(0)) << ")" << endl;
 	}
 	else if(type == LirInst::Load){
-		cout << "Load(" << value.Load.lhs << ", ";
-		cout << value.Load.src << ")" << endl;
+		cout << "Load(" << print_func->var_name(lhs) << ", ";
+		cout << print_func->var_name(var(0)) << ")" << endl;
 	}
 	else if(type == LirInst::Store){
-		cout << "Store(" << value.Store.dst << ", ";
-		value.Store.op->toString();
+		cout << "Store(" << print_func->var_name(var(0)) << ", ";
+		print_slot(*this, 1);
 		cout << ")" << endl;
 	}
 };
+
 	// enum type{Branch, CallDirect, CallIndirect, Jump, Ret} type;
 void Terminal::toString(){
 	if(type == Terminal::Branch){
 		cout << "Branch(";
 		value.Branch.guard->toString();
-		cout << ", " << value.Branch.tt << ", " << value.Branch.ff << ")" << endl;
+		cout << ", " << print_func->block_label(value.Branch.tt) << ", " << print_func->block_label(value.Branch.ff) << ")" << endl;
 	}
 	else if(type == Terminal::CallDirect){
 		cout << "CallDirect(";
-		if(value.CallDirect.lhs != ""){
-			cout << value.CallDirect.lhs << ", ";
+		if(value.CallDirect.lhs != NO_VAR){
+			cout << print_func->var_name(value.CallDirect.lhs) << ", ";
 		}
 		else{
 			cout << "_, ";
@@ -1246,17 +1307,17 @@ void Terminal::toString(){
 			}
 			value.CallDirect.args[value.CallDirect.args.size() - 1]->toString();
 		}
-		cout << "], " << value.CallDirect.next_bb << ")" << endl;
+		cout << "], " << print_func->block_label(value.CallDirect.next_bb) << ")" << endl;
 	}
 	else if(type == Terminal::CallIndirect){
 		cout << "CallIndirect(";
-		if(value.CallIndirect.lhs != ""){
-			cout << value.CallIndirect.lhs << ", ";
+		if(value.CallIndirect.lhs != NO_VAR){
+			cout << print_func->var_name(value.CallIndirect.lhs) << ", ";
 		}
 		else{
 			cout << "_, ";
 		}
-		cout << value.CallIndirect.callee << ", [";
+		cout << print_func->var_name(value.CallIndirect.callee) << ", [";
 		if(value.CallIndirect.args.size() != 0){
 			for(long unsigned int i = 0; i < value.CallIndirect.args.size() - 1; i++){
 				value.CallIndirect.args[i]->toString();
@@ -1264,10 +1325,10 @@ void Terminal::toString(){
 			}
 			value.CallIndirect.args[value.CallIndirect.args.size() - 1]->toString();
 		}
-		cout << "], " << value.CallIndirect.next_bb << ")" << endl;
+		cout << "], " << print_func->block_label(value.CallIndirect.next_bb) << ")" << endl;
 	}
 	else if(type == Terminal::Jump){
-		cout << "Jump(" << value.Jump.next_bb << ")" << endl;
+		cout << "Jump(" << print_func->block_label(value.Jump.next_bb) << ")" << endl;
 	}
 	else if(type == Terminal::Ret){
 		cout << "Ret("; 
@@ -1284,7 +1345,7 @@ void Operand::toString(){
 		cout << value.Const.num;
 	}
 	else if(type == Operand::Var){
-		cout << value.Var.id;
+		cout << print_func->var_name(value.Var.id);
 	}
 };
 
@@ -1324,8 +1385,4 @@ void ComparisonOp::toString(){
 	else if(type == ComparisonOp::Gte){
 		cout << "gte";
 	}
-};
-
-void Label::toString(){
-	cout << "gen was here. not good";
 };
\ No newline at end of file
@@ -6,23 +6,27 @@
 #include <vector>
 #include <cstring>
 #include <map>
+#include <unordered_map>
+#include <cstdint>
 
 #include "ast.hpp"
 #include "parse.hpp"
 
 using namespace std;
 
+// Variables are numbered densely per function, see LIR_Function::intern_var
+typedef int32_t VarId;
+const VarId NO_VAR = -1;
+
+// Basic blocks too, see LIR_Function::intern_block
+typedef int32_t BlockId;
+const BlockId NO_BLOCK = -1;
+
 struct LIR{
 	virtual void toString() = 0;
+	virtual ~LIR(){};
 };
 
-typedef struct Label: LIR{
-	string name;
-	void toString();
-	Label(){};
-	Label(string name):name(name){};
-} Label;
-
 // ArithmeticOp
 // | Add
 // | Sub
@@ -68,7 +72,7 @@ typedef struct Operand: LIR{
 	} Const;
 
 	struct {
-		string id;
+		VarId id;
 	} Var;
 		
     Value(){memset(this, 0, sizeof(Value));}
@@ -77,7 +81,7 @@ typedef struct Operand: LIR{
 
 	void toString();
 	
-	Operand(){};
+	Operand():type(Const){};
 	Operand(enum type t):type(t){};
 	string codeGenString(string funcName);
 } Operand;
@@ -91,76 +95,64 @@ typedef struct Operand: LIR{
 // | Copy { lhs: VarId, op: Operand }
 // | Gep { lhs: VarId, src: VarId, idx: Operand }
 // | Gfp { lhs: VarId, src: VarId, field: string }
+// | Len { lhs: VarId, src: VarId }
 // | Load { lhs: VarId, src: VarId }
 // | Store { dst: VarId, op: Operand }
-
-typedef struct LirInst : LIR{
-	enum type{Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Load, Store} type;
-
-	union Value{
-
-	struct {
-		string lhs;
-		Operand* num;
-	} Alloc;
-
-	struct {
-		string lhs;
-		ArithmeticOp* aop;
-		Operand* left;
-		Operand* right;
-	} Arith;
-
-	struct {
-		string lhs = "";
-		string callee;
-		vector<Operand*> args;
-	} CallExt;
-
-	struct {
-		string lhs;
-		ComparisonOp* aop;
-		Operand* left;
-		Operand* right;
-	} Cmp;
-		
-	struct {
-		string lhs;
-		Operand* op;
-	} Copy;
-		
-	struct {
-		string lhs;
-		string src;
-		Operand* idx;
-	} Gep;
-		
-	struct {
-		string lhs;
-		string src;
-		string field;
-	} Gfp;
-
-	struct {
-		string lhs;
-		string src; 
-	} Load;
-
-	struct {
-		string dst; 
-		Operand* op;
-	} Store;
-
-	Value(){memset(this, 0, sizeof(Value));}
-	~Value(){}
-	} value;
-
-	void toString();
-	LirInst(){};
-	LirInst(enum type t):type(t){};
-	void codeGenString(string funcName);
+//
+// An instruction is a fixed-size record kept by value in its block. The
+// operands go in two slots that each hold a constant or a VarId, and the
+// field names and extern calls live in tables of the function, found
+// through aux. Len, the length of the array src points to, is never
+// lowered; only -O adds it.
+//
+//   Alloc    lhs, slot 0: num
+//   Arith    lhs, op: aop, slot 0: left, slot 1: right
+//   CallExt  lhs (NO_VAR if absent), aux: LIR_Function::calls
+//   Cmp      lhs, op: aop, slot 0: left, slot 1: right
+//   Copy     lhs, slot 0: op
+//   Gep      lhs, slot 0: src, slot 1: idx, op: Checked or InBounds
+//   Gfp      lhs, slot 0: src, aux: LIR_Function::fields
+//   Len      lhs, slot 0: src
+//   Load     lhs, slot 0: src
+//   Store    slot 0: dst, slot 1: op
+
+struct LIR_Function;
+
+typedef struct LirInst {
+	enum type : uint8_t {Alloc, Arith, CallExt, Cmp, Copy, Gep, Gfp, Len, Load, Store} type;
+	// the op of a Gep: InBounds once idx is known to be in bounds, so the
+	// check can be left out
+	enum bounds : uint8_t {Checked, InBounds};
+	uint8_t op;        // ArithmeticOp::type or ComparisonOp::type
+	uint8_t var_slots; // bit i is set when slot i holds a VarId
+	VarId lhs;
+	int32_t slot[2];
+	int32_t aux;
+
+	LirInst(enum type t = Copy, VarId lhs = NO_VAR):type(t), op(0), var_slots(0), lhs(lhs), aux(-1){
+		slot[0] = slot[1] = 0;
+	};
+
+	bool is_var(int i) const { return (var_slots >> i) & 1; }
+	VarId var(int i) const { return is_var(i) ? slot[i] : NO_VAR; }
+	int32_t num(int i) const { return slot[i]; }
+	void set_var(int i, VarId id){ slot[i] = id; var_slots |= 1 << i; }
+	void set_const(int i, int32_t num){ slot[i] = num; var_slots &= ~(1 << i); }
+	void set(int i, const Operand* op){
+		if(op->type == Operand::Var) set_var(i, op->value.Var.id);
+		else set_const(i, op->value.Const.num);
+	}
+
+	void toString() const;
+	void codeGenString(const LIR_Function* func) const;
 } LirInst;
 
+// The callee and arguments of a CallExt, see LirInst::aux
+struct LirCall {
+	string callee;
+	vector<Operand*> args;
+};
+
 // Terminal
 // | Branch { guard: Operand, tt: BbId, ff: BbId }
 // | CallDirect { lhs: option<VarId>, callee: FuncId, args: vector<Operands>, next_bb: BbId }
@@ -174,27 +166,27 @@ typedef struct Terminal: LIR{
 	union Value{
 	struct {
 		Operand* guard;
-		string tt; // BbId
-		string ff; // BbId
+		BlockId tt;
+		BlockId ff;
 	} Branch;
 
 	// CHANGED THIS
 	struct {
-		string lhs = ""; //optional
+		VarId lhs; //optional, NO_VAR if absent
 		string callee; //FuncId
 		vector<Operand*> args;
-		string next_bb;
+		BlockId next_bb;
 	} CallDirect;
         
 	struct {
-		string lhs = ""; //optional
-		string callee; //VarId
+		VarId lhs; //optional, NO_VAR if absent
+		VarId callee;
 		vector<Operand*> args;
-		string next_bb;
+		BlockId next_bb;
 	} CallIndirect;
 
   struct {
-		string next_bb; //Uses the basic block id
+		BlockId next_bb;
 	} Jump;
         
   struct {
@@ -206,41 +198,110 @@ typedef struct Terminal: LIR{
 	} value;
 
 	void toString();
-	Terminal(){};
-	Terminal(enum type t):type(t){};
+	// the blocks this terminal can jump to, appended to out
+	void successors(vector<BlockId>& out);
+	Terminal():type(Jump){};
+	Terminal(enum type t):type(t){
+		if(t == CallDirect) value.CallDirect.lhs = NO_VAR;
+		if(t == CallIndirect) value.CallIndirect.lhs = NO_VAR;
+	};
+	~Terminal();
 	void codeGenString(string funcName);
 } Terminal;
 
+// A phi at the top of a block, only there while the function is in SSA
+// form (see opt.hpp): lhs gets args[i] when control comes from preds[i].
+struct LirPhi {
+	VarId lhs;
+	VarId var; // the variable lhs is a version of
+	vector<VarId> args;
+};
+
 // BasicBlock
 // - label: BbId
-// - insts: vector<LirInst>
+// - insts: vector<LirInst>, by value
 // - term: Terminal
 
 typedef struct BasicBlock : LIR{
-	string label; //Will store BbId
-	vector<LirInst*> insts; //The translational vector
-	Terminal* term;
+	string label; // only used for printing
+	BlockId id = NO_BLOCK;
+	vector<LirPhi> phis;
+	vector<LirInst> insts;
+	Terminal* term = NULL;
+	// the CFG edges, filled in by LIR_Function::link_blocks
+	vector<BlockId> succs;
+	vector<BlockId> preds;
 	void toString();
 	bool reachable = false;
-	void set_reachable(map<string, BasicBlock*>& body);
-	void codeGenString(string funcName);
+	void codeGenString(const LIR_Function* func);
 } BasicBlock;
 
+// A variable of a function: a parameter, a local, or a global it refers to
+struct LirVar {
+	string name;
+	Type* param_type = NULL;
+	Type* local_type = NULL;
+	bool is_param = false;
+	bool is_local = false;
+};
+
 // Function
 // - name: FuncId
-// - params: vector<(VarId, Type)> <-- this is a map now
+// - params: VarId -> Type
 // - rettyp: option<Type>
 // - locals: VarId -> Type
 // - body: BbId -> BasicBlock
+//
+// Every variable name used in the function is interned into a VarId the
+// first time it is seen; vars is indexed by VarId and the names are only
+// needed for printing and for finding globals. Blocks are interned the same
+// way: body is indexed by BlockId and terminals refer to blocks by id.
 
 typedef struct LIR_Function : LIR{
 	string name; // stores FuncId
-	map<string, Type*> params;
+	vector<LirVar> vars;
+	unordered_map<string, VarId> var_ids;
+	size_t num_params = 0;
+	size_t num_locals = 0;
 	Type* rettyp = NULL; //optional
-	map<string, Type*> locals; 
-	map<string, BasicBlock*> body;
+	vector<BasicBlock*> body;
+	unordered_map<string, BlockId> block_ids;
+	// what the aux of a Gfp or CallExt instruction refers to
+	vector<string> fields;
+	unordered_map<string, int32_t> field_ids;
+	vector<LirCall> calls;
 	void toString();
 	void codeGenString();
+
+	// the block labelled label, added without a terminal if it is new
+	BlockId intern_block(const string& label);
+	BlockId find_block(const string& label) const; // NO_BLOCK if missing
+	const string& block_label(BlockId id) const { return body[id]->label; }
+	// blocks in label order, the order they are printed and emitted in
+	vector<BlockId> blocks_by_label() const;
+	// mark the blocks reachable from entry
+	void set_reachable();
+	// fill in succs and preds of every block from the terminals
+	void link_blocks();
+
+	VarId intern_var(const string& var);
+	VarId find_var(const string& var) const; // NO_VAR if never interned
+	const string& var_name(VarId id) const { return vars[id].name; }
+	bool is_param(VarId id) const { return id != NO_VAR && vars[id].is_param; }
+	bool is_local(VarId id) const { return id != NO_VAR && vars[id].is_local; }
+	Type* param_type(VarId id) const { return vars[id].param_type; }
+	Type* local_type(VarId id) const { return vars[id].local_type; }
+	void add_param(VarId id, Type* type);
+	void add_local(VarId id, Type* type);
+	void remove_local(VarId id); // drops its frame slot, it must be unused
+	// parameters or locals in name order, the order of the stack frame
+	vector<VarId> params_by_name() const;
+	vector<VarId> locals_by_name() const;
+
+	int32_t intern_field(const string& field);
+	int32_t add_call(const string& callee, const vector<Operand*>& args);
+	const string& field(const LirInst& inst) const { return fields[inst.aux]; }
+	const LirCall& call(const LirInst& inst) const { return calls[inst.aux]; }
 } LIR_Function;
 
 
@@ -257,52 +318,110 @@ typedef struct LIR_Program : LIR{
 	map<string, LIR_Function*> functions;
 	void toString();
 	void codeGenString();
+	void codeGenHeader();
+	void codeGenFooter();
 } LIR_Program;
 
 LIR_Program* lower(Program* prog);
+LIR_Program* lower_toplevel(Program* prog);
+void lower_function(LIR_Function* lir_func, Function* func);
+
+// Clearing the per-thread state between compilations
+void reset_lower();
+void reset_codegen();
+
+// Where codegen writes the assembly, cout unless redirected
+extern thread_local ostream* asm_out;
+
+// Reading the human readable LIR format back in
+LIR_Program* read_lir(const char* data, size_t size);
+
+/*
+ * LIR objects live in a per-thread arena next to the AST one. A compile
+ * releases everything it lowered when it is done, the streaming compiler
+ * releases each function body right after its code has been generated so
+ * the next function reuses the same memory.
+ */
+extern thread_local Arena lir_arena;
+
+template<class T, class... Args>
+T* lir_new(Args&&... args){
+	return lir_arena.make<T>(std::forward<Args>(args)...);
+}
+
+template<> struct ArenaNoDestroy<ArithmeticOp> : true_type {};
+template<> struct ArenaNoDestroy<ComparisonOp> : true_type {};
+template<> struct ArenaNoDestroy<Operand> : true_type {};
+
+// Forget the body and locals of a function before its arena memory goes
+void release_function(LIR_Function* lir_func);
+
+/*
+ * Builds the blocks of one function while it is lowered. start() makes a
+ * block current, instructions are appended to it and terminate() closes
+ * it. Anything emitted between a terminal and the next start() can never
+ * run and is dropped.
+ */
+struct BlockBuilder {
+	LIR_Function* func;
+	BlockId cur;
+	BlockBuilder(LIR_Function* func):func(func), cur(NO_BLOCK){};
+	void start(BlockId block){ cur = block; }
+	void append(const LirInst& inst){
+		if(cur != NO_BLOCK){
+			func->body[cur]->insts.push_back(inst);
+		}
+	}
+	void terminate(Terminal* term){
+		if(cur != NO_BLOCK){
+			func->body[cur]->term = term;
+			cur = NO_BLOCK;
+		}
+	}
+};
 
 // Overarching lowering methods
-void stmt_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-Operand* exp_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* lval_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
-Operand* lval_exp_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
+void stmt_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+Operand* exp_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* lval_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
+Operand* lval_exp_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
 
 // for stmts
-void if_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void while_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void assign_exp_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void assign_new_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void call_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void continue_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void break_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void return_none_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
-void return_one_lower(LIR_Function* lir_func, Stmt* stmt, vector<LIR*>& translation_vector);
+void if_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void while_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void assign_exp_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void assign_new_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void call_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void continue_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void break_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void return_none_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
+void return_one_lower(LIR_Function* lir_func, Stmt* stmt, BlockBuilder& blocks);
 
 // for exps
-Operand* num_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* id_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* nil_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* unop_neg_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* unop_deref_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* binop_arith_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* binop_compare_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* arrayaccess_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* fieldaccess_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
-Operand* call_lower(LIR_Function* lir_func, Exp* exp, vector<LIR*>& translation_vector);
+Operand* num_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* id_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* nil_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* unop_neg_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* unop_deref_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* binop_arith_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* binop_compare_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* arrayaccess_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* fieldaccess_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
+Operand* call_lower(LIR_Function* lir_func, Exp* exp, BlockBuilder& blocks);
 
 // for lvals
-Operand* deref_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
-Operand* arrayaccess_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
-Operand* fieldaccess_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
+Operand* deref_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
+Operand* arrayaccess_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
+Operand* fieldaccess_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
 
 // for lval as expressions
-Operand* id_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
-Operand* not_id_lower(LIR_Function* lir_func, Lval* lval, vector<LIR*>& translation_vector);
+Operand* id_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
+Operand* not_id_lower(LIR_Function* lir_func, Lval* lval, BlockBuilder& blocks);
 
-string create_fresh_var(LIR_Function* lir_func, Type* type);
+VarId create_fresh_var(LIR_Function* lir_func, Type* type);
 
-string create_fresh_label(LIR_Function* lir_func);
+BlockId create_fresh_label(LIR_Function* lir_func);
 
-string get_var_stack(string var, string funcName);
+const string& get_var_stack(VarId var);
 
 #endif
\ No newline at end of file
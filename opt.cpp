@@ -0,0 +1,44 @@
+/**
+ * The -O pipeline, see opt.hpp.
+ */
+
+#include "opt.hpp"
+
+using namespace std;
+
+int opt_level = 0;
+
+void optimize_function(LIR_Function* func){
+	if(opt_level == 0){
+		return;
+	}
+	func->link_blocks();
+	CFG cfg(func);
+	if(!to_ssa(func, cfg)){
+		return;
+	}
+	sccp(func, cfg);
+	// sccp drops the edges it finds are never taken
+	cfg = CFG(func);
+	propagate_copies(func, cfg);
+	gvn(func, cfg);
+	vector<LoopVersion> versions;
+	eliminate_bounds_checks(func, cfg, versions);
+	eliminate_dead_code(func, cfg);
+	from_ssa(func);
+	if(!versions.empty()){
+		// from_ssa splits edges to place its copies
+		cfg = CFG(func);
+		version_loops(func, cfg, versions);
+	}
+	drop_unused_locals(func);
+}
+
+void optimize(LIR_Program* lir){
+	if(opt_level == 0){
+		return;
+	}
+	for(auto& f : lir->functions){
+		optimize_function(f.second);
+	}
+}
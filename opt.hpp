@@ -0,0 +1,159 @@
+#ifndef OPT_HPP
+#define OPT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "lower.hpp"
+#include "cfg.hpp"
+
+using namespace std;
+
+/*
+ * Optimizations over the LIR of one function, run between lowering and
+ * code generation when -O is given. Cached LIR images are saved before
+ * they run, so they hold the LIR as lowered whatever the options.
+ *
+ * The passes work on SSA form. to_ssa() gives every assignment of a
+ * parameter or local its own variable, with phis where control flow
+ * joins; from_ssa() turns the phis back into copies so codegen never
+ * sees them.
+ *
+ * optimize_function() builds the CFG of the function once and passes it
+ * to every pass that needs it; it is only built again after a pass that
+ * changes the edges between blocks.
+ */
+
+// 0 leaves the LIR as lowered. Set by main before any compile starts.
+extern int opt_level;
+
+void optimize(LIR_Program* lir);
+void optimize_function(LIR_Function* func);
+
+// SSA construction and destruction (ssa.cpp). to_ssa() returns false and
+// leaves the function alone if it cannot be put in SSA form.
+bool to_ssa(LIR_Function* func, const CFG& cfg);
+void from_ssa(LIR_Function* func);
+
+// Recompute succs and preds after terminals changed, keeping every phi's
+// arguments lined up with the new preds
+void relink_blocks(LIR_Function* func);
+
+// The passes, each on a function in SSA form with its blocks linked and
+// cfg built from them
+void sccp(LIR_Function* func, const CFG& cfg);
+void propagate_copies(LIR_Function* func, const CFG& cfg);
+void gvn(LIR_Function* func, const CFG& cfg);
+void eliminate_dead_code(LIR_Function* func, const CFG& cfg);
+
+// A loop to also have without the bounds checks of some Geps, taken when
+// all of conds (Cmps, lhs not set yet) hold on the way in. The conds may
+// read lengths, each a local to set to the length of its array (Len) once
+// that is known not to be nil
+struct LoopVersion {
+	BlockId header;
+	vector<LirInst> conds;
+	vector<VarId> geps;
+	vector<pair<VarId, VarId>> lengths;
+};
+
+// Marks the Geps known to be in bounds, and plans the versions of loops
+// that would make more of them so; version_loops() makes those after
+// from_ssa(), building cfg again after each
+void eliminate_bounds_checks(LIR_Function* func, const CFG& cfg, vector<LoopVersion>& versions);
+void version_loops(LIR_Function* func, CFG& cfg, const vector<LoopVersion>& versions);
+
+// Drop the locals no reachable block refers to, after from_ssa()
+void drop_unused_locals(LIR_Function* func);
+
+// A new local of the given type, named base.N for the first free N
+VarId fresh_local(LIR_Function* func, string base, Type* type, int& counter);
+
+// The type of a parameter or local
+inline Type* var_type(const LIR_Function* func, VarId id){
+	return func->is_local(id) ? func->local_type(id) : func->param_type(id);
+}
+
+// Whether slot i of inst may hold a constant instead of a variable; the
+// slots holding the pointer of a memory access may not
+inline bool slot_takes_const(const LirInst& inst, int i){
+	switch(inst.type){
+		case LirInst::Gep:
+		case LirInst::Store:
+			return i == 1;
+		case LirInst::Gfp:
+		case LirInst::Len:
+		case LirInst::Load:
+		case LirInst::CallExt:
+			return false;
+		default:
+			return true;
+	}
+}
+
+// Where a terminal assigns its result (instructions use lhs), NULL if it
+// cannot have one
+inline VarId* term_def(Terminal* term){
+	if(term->type == Terminal::CallDirect){
+		return &term->value.CallDirect.lhs;
+	}
+	if(term->type == Terminal::CallIndirect){
+		return &term->value.CallIndirect.lhs;
+	}
+	return NULL;
+}
+
+/*
+ * Visit the variables an instruction or terminal reads; f returns the
+ * variable to read instead (the same one to leave it). Operands of calls
+ * and terminals are replaced rather than changed, they may be shared.
+ */
+template<class F>
+void map_operand(Operand*& op, F f){
+	if(op == NULL || op->type != Operand::Var){
+		return;
+	}
+	VarId id = f(op->value.Var.id);
+	if(id != op->value.Var.id){
+		op = lir_new<Operand>(Operand::Var);
+		op->value.Var.id = id;
+	}
+}
+
+template<class F>
+void map_uses(LIR_Function* func, LirInst& inst, F f){
+	for(int i = 0; i < 2; i++){
+		if(inst.is_var(i)){
+			inst.set_var(i, f(inst.var(i)));
+		}
+	}
+	if(inst.type == LirInst::CallExt){
+		for(Operand*& arg : func->calls[inst.aux].args){
+			map_operand(arg, f);
+		}
+	}
+}
+
+template<class F>
+void map_uses(Terminal* term, F f){
+	if(term->type == Terminal::Branch){
+		map_operand(term->value.Branch.guard, f);
+	}
+	else if(term->type == Terminal::Ret){
+		map_operand(term->value.Ret.op, f);
+	}
+	else if(term->type == Terminal::CallDirect){
+		for(Operand*& arg : term->value.CallDirect.args){
+			map_operand(arg, f);
+		}
+	}
+	else if(term->type == Terminal::CallIndirect){
+		term->value.CallIndirect.callee = f(term->value.CallIndirect.callee);
+		for(Operand*& arg : term->value.CallIndirect.args){
+			map_operand(arg, f);
+		}
+	}
+}
+
+#endif
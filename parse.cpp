@@ -56,77 +56,450 @@ CloseBrace
 #include <utility>
 #include <string>
 #include <vector>
-#include <fstream>
-#include <sstream>
+#include <map>
+#include <unordered_map>
 #include <typeinfo>
 #include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "parse.hpp"
 #include "ast.hpp"
 #include "lower.hpp"
+#include "cache.hpp"
+#include "opt.hpp"
 
 using namespace std;
 
-string* tokens;
+// Parser state is per thread so programs can be parsed concurrently,
+// reset_parser() clears it between programs.
+thread_local Token* tokens;
+thread_local vector<string> token_ids;
 
 bool DEBUG_MODE = false;
-int token_index = 0;
+thread_local int token_index = 0;
 
 int main(int argc, char* argv[]) {
-    
+
+    // Options come before the three input files
+    //   -src     the second file is cflat source instead of a token stream
+    //   -stream  parse, lower and emit one function at a time (not with -cache,
+    //            which stores images of the whole program)
+    //   -lir     read the LIR from the first file and only run codegen
+    //   -ast     read the AST JSON from the third file, then lower it
+    //   -cache <dir>  reuse the AST / LIR images in dir for an input seen before
+    //   -batch <manifest> [-j N]  compile every `input output` pair listed in
+    //            the manifest on N threads, instead of the three files
+    //   -j N     without -batch: type check function bodies on N threads
+    //   -O       optimize the LIR before generating code
+    bool from_source = false;
+    bool streaming = false;
+    bool from_lir = false;
+    bool from_ast = false;
+    const char* cache_dir = NULL;
+    const char* manifest = NULL;
+    int jobs = 0;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++){
+        if(strcmp(argv[arg], "-src") == 0){
+            from_source = true;
+        }
+        else if(strcmp(argv[arg], "-stream") == 0){
+            streaming = true;
+        }
+        else if(strcmp(argv[arg], "-lir") == 0){
+            from_lir = true;
+        }
+        else if(strcmp(argv[arg], "-ast") == 0){
+            from_ast = true;
+        }
+        else if(strcmp(argv[arg], "-cache") == 0 && arg + 1 < argc){
+            cache_dir = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-batch") == 0 && arg + 1 < argc){
+            manifest = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc){
+            jobs = atoi(argv[++arg]);
+        }
+        else if(strcmp(argv[arg], "-O") == 0){
+            opt_level = 1;
+        }
+        else{
+            arg = argc;
+        }
+    }
+
+    // the cache holds whole-program images that -stream never builds, so
+    // -stream with -cache falls through to the usage message
+    bool bad_flags = streaming && cache_dir != NULL;
+
+    // a manifest pair has one input, so there is no LIR or AST file to pick;
+    // -batch with -lir or -ast falls through to the usage message
+    if(manifest != NULL && arg == argc && !from_lir && !from_ast && !bad_flags){
+        return run_batch(manifest, jobs, from_source, streaming, cache_dir);
+    }
+    check_jobs = jobs;
+
     // Read in the file
-    if(argc != 4){
-        cout << "Usage: ./codegen <file_lir> <file_toks> <file_ast>" << endl;
+    if(argc - arg != 3 || bad_flags){
+        cout << "Usage: ./codegen [-src] [-stream | -cache <dir>] [-lir] [-ast] [-j N] [-O] <file_lir> <file_toks> <file_ast>" << endl;
+        cout << "       ./codegen [-src] [-stream | -cache <dir>] [-O] -batch <manifest> [-j N]" << endl;
         return 1;
     }
-    string filename = argv[2];
+    char** files = argv + arg;
 
-    ifstream file(filename);
-    if(!file.is_open()){
+    // map the whole file instead of copying it into a string
+    const char* input;
+    size_t input_size;
+    int input_file = from_lir ? 0 : from_ast ? 2 : 1;
+    if(!map_file(files[input_file], input, input_size)){
         cout << "Error: could not open file" << endl;
         return 1;
     }
-    // convert whole file to string
-    stringstream buffer;
-    buffer << file.rdbuf(); // learned from https://stackoverflow.com/questions/2602013/read-whole-ascii-file-into-c-stdstring
-    string input = buffer.str();
-
-    //cout << input << endl;
 
     // Begin parsing the file
 
-    tokens = new string[1000000];
-    long unsigned int pos = 0;
-    int index = 0;
-    while(pos < input.size()){
-        pos = input.find("\n");
-        tokens[index] = input.substr(0,pos);
-        input.erase(0,pos+1); // To ignore the \n
-        index++;
-    }
-    tokens[index] = "\0";
-
-    // string* temp = tokens;
-    // while(*temp != "\0"){
+    // Token* temp = tokens;
+    // while(temp->kind != Token::End){
     //     cout << "token: " << *temp << endl;
     //     temp++;
     // }
     // cout << endl;
     try{
+        if(from_lir){
+            // the front end already ran, go straight to codegen
+            LIR_Program* lir = read_lir(input, input_size);
+            optimize(lir);
+            lir->codeGenString();
+            unmap_file(input, input_size);
+            return 0;
+        }
+        if(from_ast){
+            // the AST is already there, skip lexing and parsing
+            Program* prog = read_ast(input, input_size);
+            throw_type_errors(validate(prog));
+            LIR_Program* lir = lower(prog);
+            optimize(lir);
+            lir->codeGenString();
+            unmap_file(input, input_size);
+            return 0;
+        }
+        compile(input, input_size, from_source, streaming, cache_dir);
+    }
+    catch(const type_error& e){
+        cout << e.what();
+        unmap_file(input, input_size);
+        return 1;
+    }
+    catch(const runtime_error& e){
+        if(from_lir){
+            cout << "lir error at line " << token_index << ": " << e.what() << endl;
+            unmap_file(input, input_size);
+            return 1;
+        }
+        if(from_ast){
+            cout << "ast error at offset " << token_index << ": " << e.what() << endl;
+            unmap_file(input, input_size);
+            return 1;
+        }
+        token_index--;
+        cout << "parse error at token " << token_index << endl;
+    }
+
+    unmap_file(input, input_size);
+    return 0;
+}
+
+/*
+ * Compile one token file (or source file, with from_source) to *asm_out.
+ * Throws a runtime error on a parse error, with token_index one past the
+ * offending token, and a type_error if the program does not type check.
+ */
+void compile(const char* input, size_t size, bool from_source, bool streaming, const char* cache_dir){
+    // every node made for this input is freed on the way out
+    ArenaScope nodes(ast_arena);
+    ArenaScope lir_nodes(lir_arena);
+    vector<Token> token_list;
+
+    // images are keyed on the tokens / source file, not the file name
+    uint64_t hash = 0;
+    string cached;
+    if(cache_dir != NULL){
+        hash = hash_input(input, size, from_source ? 1 : 0);
+        cached = cache_path(cache_dir, hash);
+        LIR_Program* lir = load_lir_image(cached + ".lir", hash);
+        if(lir == NULL){
+            // an AST image still saves lexing and parsing
+            Program* prog = load_ast_image(cached + ".ast", hash);
+            if(prog != NULL){
+                // it checked when it was saved; this fills in the types lowering reads
+                throw_type_errors(validate(prog));
+                lir = lower(prog);
+                save_lir_image(cached + ".lir", lir, hash);
+            }
+        }
+        if(lir != NULL){
+            optimize(lir);
+            lir->codeGenString();
+            return;
+        }
+    }
+    if(from_source){
+        // lex the source in process, straight into token records
+        lex(input, size, token_list);
+    }
+    else{
+        // one linear pass over the mapped file, the array grows with the input
+        vector<TokenLine> token_lines;
+        read_tokens(input, size, token_lines);
+        // turn every line into a {kind, payload} record before parsing
+        classify_tokens(token_lines, token_list);
+    }
+    tokens = token_list.data();
+    if(streaming && cache_dir == NULL){
+        compile_streaming(token_list.data());
+    }
+    else{
         Program* prog  = program();
+        throw_type_errors(validate(prog));
+        if(cache_dir != NULL){
+            save_ast_image(cached + ".ast", prog, hash);
+        }
         // prog->toString();
         // cout << endl;
         LIR_Program* lir = lower(prog);
-        // validate(prog);
+        if(cache_dir != NULL){
+            save_lir_image(cached + ".lir", lir, hash);
+        }
         // lir->toString();
+        optimize(lir);
         lir->codeGenString();
     }
-    catch(const runtime_error& e){
-        token_index--;
-        cout << "parse error at token " << token_index << endl;
+}
+
+/*
+ * Compile one function at a time so only a single function body is held
+ * as AST and LIR at once. Each body is parsed from its recorded position
+ * and freed again, three times over:
+ *   1. the outline parses every body in source order, so a parse error is
+ *      the first one in the file, as for program()
+ *   2. every body is type checked in source order and all the errors are
+ *      thrown together, as validate() does
+ *   3. only then is anything written: each body is checked again for the
+ *      types lowering needs, lowered and emitted in name order, the order
+ *      codeGenString() uses
+ * so the output, and the error for a bad program, is the same as for a
+ * whole-program compile.
+ */
+void compile_streaming(Token* first){
+    vector<Token*> starts;
+    Program* prog = program_outline(starts);
+    GlobalScope global;
+    build_global_scope(prog, global);
+
+    vector<string> errors;
+    for(Token* start : starts){
+        tokens = start;
+        token_index = tokens - first;
+        ArenaScope body(ast_arena);
+        check_function(fundef(), global, errors);
+    }
+    throw_type_errors(errors);
+
+    map<string, Token*> by_name;
+    for(size_t i = 0; i < starts.size(); i++){
+        by_name[prog->functions[i]->name] = starts[i];
+    }
+    LIR_Program* lir = lower_toplevel(prog);
+    lir->codeGenHeader();
+    for(auto it = by_name.begin(); it != by_name.end(); it++){
+        tokens = it->second;
+        token_index = tokens - first;
+        ArenaScope body(ast_arena);
+        ArenaScope lir_body(lir_arena);
+        Function* func = fundef();
+        // lowering reads the types checking leaves on this fresh AST
+        vector<string> no_errors;
+        check_function(func, global, no_errors);
+        LIR_Function* lir_func = lir->functions[it->first];
+        lower_function(lir_func, func);
+        optimize_function(lir_func);
+        *asm_out << ".globl " << it->first << endl;
+        lir_func->codeGenString();
+        release_function(lir_func);
+    }
+    lir->codeGenFooter();
+}
+
+/*
+ * Map a file read-only into memory. Empty files are not mapped,
+ * data points to an empty string instead.
+ */
+bool map_file(const char* filename, const char*& data, size_t& size){
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        return false;
+    }
+    size = st.st_size;
+    if(size == 0){
+        data = "";
+        close(fd);
+        return true;
+    }
+    void* addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED){
+        return false;
+    }
+    data = (const char*)addr;
+    return true;
+}
+
+void unmap_file(const char* data, size_t size){
+    if(size != 0){
+        munmap((void*)data, size);
+    }
+}
+
+/*
+ * Split the mapped file into one token line per line of the file.
+ */
+void read_tokens(const char* data, size_t size, vector<TokenLine>& out){
+    const char* pos = data;
+    const char* end = data + size;
+    while(pos < end){
+        const char* nl = (const char*)memchr(pos, '\n', end - pos);
+        if(nl == NULL){
+            nl = end;
+        }
+        out.push_back(TokenLine{pos, (size_t)(nl - pos)});
+        pos = nl + 1;
     }
+}
 
-    return 0;
+bool TokenLine::operator==(const char* s) const {
+    return strncmp(str, s, len) == 0 && s[len] == '\0';
+}
+
+bool TokenLine::starts_with(const char* prefix) const {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(str, prefix, n) == 0;
+}
+
+bool TokenLine::ends_with(char c) const {
+    return len > 0 && str[len - 1] == c;
+}
+
+string TokenLine::to_string() const {
+    return string(str, len);
+}
+
+// Token names, indexed by Token::kind
+const char* token_names[] = {"", "Num", "Id", "Int", "Struct", "Nil", "Break",
+    "Continue", "Return", "If", "Else", "While", "New", "Let", "Extern", "Fn",
+    "Address", "Colon", "Semicolon", "Comma", "Underscore", "Arrow", "Plus",
+    "Dash", "Star", "Slash", "Equal", "NotEq", "Lt", "Lte", "Gt", "Gte", "Dot",
+    "Gets", "OpenParen", "CloseParen", "OpenBracket", "CloseBracket",
+    "OpenBrace", "CloseBrace"};
+
+const int num_token_kinds = sizeof(token_names) / sizeof(token_names[0]);
+
+thread_local unordered_map<string, int> token_id_table;
+
+// clear the parser state before the next program on this thread
+void reset_parser(){
+    tokens = NULL;
+    token_index = 0;
+    token_ids.clear();
+    token_id_table.clear();
+    reset_types();
+}
+
+// intern an identifier, returning its index in token_ids
+int32_t intern_id(const char* str, size_t len){
+    string name(str, len);
+    auto it = token_id_table.find(name);
+    if(it != token_id_table.end()){
+        return it->second;
+    }
+    int32_t id = token_ids.size();
+    token_ids.push_back(name);
+    token_id_table[name] = id;
+    return id;
+}
+
+/*
+ * Classify every token line into a Token record. Keywords and punctuation
+ * are matched against token_names, Id(..) payloads are interned and Num(..)
+ * payloads are converted to their value. The last record is always End.
+ * On a malformed line token_index is left one past that line.
+ */
+void classify_tokens(const vector<TokenLine>& lines, vector<Token>& out){
+    out.reserve(lines.size() + 1);
+    for(const TokenLine& line : lines){
+        token_index = out.size() + 1;
+        // an empty line ends the input
+        if(line.len == 0){
+            break;
+        }
+        Token t;
+        if(line.starts_with("Id(") && line.ends_with(')')){
+            t.kind = Token::Id;
+            t.payload = intern_id(line.str + 3, line.len - 4);
+        }
+        else if(line.starts_with("Num(") && line.ends_with(')') && line.len > 5){
+            // read the digits straight out of the slice
+            int64_t num = 0;
+            for(const char* c = line.str + 4; c < line.str + line.len - 1; c++){
+                if(*c < '0' || *c > '9' || num > INT32_MAX){
+                    throw runtime_error{"Expected Num got " + line.to_string()};
+                }
+                num = num * 10 + (*c - '0');
+            }
+            if(num > INT32_MAX){
+                throw runtime_error{"Expected Num got " + line.to_string()};
+            }
+            t.kind = Token::Num;
+            t.payload = (int32_t)num;
+        }
+        else{
+            int k = 1;
+            while(k < num_token_kinds && !(line == token_names[k])){
+                k++;
+            }
+            if(k == num_token_kinds){
+                throw runtime_error{"Unknown token " + line.to_string()};
+            }
+            t.kind = (enum Token::kind)k;
+            t.payload = 0;
+        }
+        out.push_back(t);
+    }
+    token_index = 0;
+    out.push_back(Token{Token::End, 0});
+}
+
+string token_string(const Token& t){
+    if(t.kind == Token::Id){
+        return "Id(" + token_ids[t.payload] + ")";
+    }
+    if(t.kind == Token::Num){
+        return "Num(" + to_string(t.payload) + ")";
+    }
+    return token_names[t.kind];
+}
+
+ostream& operator<<(ostream& os, const Token& t){
+    return os << token_string(t);
 }
 
 /*
@@ -135,12 +508,9 @@ type ::= `&`* type_ad
 
 Type* type(){
     if(DEBUG_MODE) cout << "type: " << *tokens << endl;
-    if(*tokens == "Address"){ 
-        consume("Address");
-        Type* t = new Type;
-        t->type = Type::Ptr;
-        t->value.Ptr.ref = type();
-        return t;
+    if(tokens->kind == Token::Address){ 
+        consume(Token::Address);
+        return ptr_type(type());
     }
     Type* t = type_ad();
     return t;
@@ -155,24 +525,23 @@ type_ad ::= `int`
 Type* type_ad(){
     if(DEBUG_MODE) cout << "type_ad: " << *tokens << endl;
     Type* t;
-    if(*tokens == "Int"){
-        t = new Type;
-        t->type = Type::Int;
-        consume("Int");
-    }
-    else if(tokens->substr(0,3) == "Id("){
-        t = new Type;
-        t->type = Type::Struct;
-        string id = consume_id();
-        t->value.Struct.name = id;
-    }
-    else if(*tokens == "OpenParen"){
-        consume("OpenParen");
-        t = type_op();
-    }
-    else{
-        token_index++;
-        throw runtime_error{"Unexpected type_ad"};
+    switch(tokens->kind){
+        case Token::Int:
+            t = int_type();
+            consume(Token::Int);
+            break;
+        case Token::Id: {
+            string id = consume_id();
+            t = struct_type(id);
+            break;
+        }
+        case Token::OpenParen:
+            consume(Token::OpenParen);
+            t = type_op();
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Unexpected type_ad"};
     }
     return t;
 }
@@ -183,54 +552,39 @@ type_op ::= `)` type_ar
 */
 Type* type_op(){
     if(DEBUG_MODE) cout << "type_op: " << *tokens << endl;
-    Type* t = new Type;
-    t->type = Type::Fn;
+    vector<Type*> prms;
     //Case where there are no parameters and one return
-    if(*tokens == "CloseParen"){
-        consume("CloseParen");
-        t->value.Fn.ret = type_ar();
+    if(tokens->kind == Token::CloseParen){
+        consume(Token::CloseParen);
+        return fn_type(prms, type_ar());
     }
     //Case where 1+ params and one return
-    else{
-        t->value.Fn.prms.push_back(type());
-        Type* temp = type_fp();
-        for(long unsigned int i = 0; i < temp->value.Fn.prms.size(); i++){
-            t->value.Fn.prms.push_back(temp->value.Fn.prms[i]);
-        }
-        t->value.Fn.ret = temp->value.Fn.ret;
-    }
-    return t;
+    prms.push_back(type());
+    return type_fp(prms);
 }
 
 /*
 type_fp ::= `)` type_ar?
           | (`,` type)+ `)` type_ar
+
+prms holds the parameters read so far, the rest are added to it
 */
 
-Type* type_fp(){
+Type* type_fp(vector<Type*>& prms){
     if(DEBUG_MODE) cout << "type_fp: " << *tokens << endl;
-    Type* t = new Type;
-    t->type = Type::Fn;
-    if(*tokens == "CloseParen"){
-        consume("CloseParen");
-        t->value.Fn.ret = type_ar();
+    while(tokens->kind == Token::Comma){
+        consume(Token::Comma);
+        prms.push_back(type());
     }
-    else{
-        while(*tokens == "Comma"){
-            consume("Comma");
-            t->value.Fn.prms.push_back(type());
-        }
-        consume("CloseParen");
-        t->value.Fn.ret = type_ar();
-    }
-    return t;
+    consume(Token::CloseParen);
+    return fn_type(prms, type_ar());
 }
 
 // type_ar ::= `->` rettyp
 
 Type* type_ar(){
     if(DEBUG_MODE) cout << "type_ar: " << *tokens << endl;
-    consume("Arrow");
+    consume(Token::Arrow);
     Type* t = rettyp();
     return t;
 }
@@ -238,25 +592,18 @@ Type* type_ar(){
 // funtype ::= `(` (type (`,` type)*)? `)` `->` rettyp
 
 Type* funtype(){
-    consume("OpenParen");
-    Type* t = new Type;
-    t->type = Type::Fn;
-    if(*tokens != "CloseParen"){
-        t->value.Fn.prms.push_back(type());
-        while(*tokens == "Comma"){
-            consume("Comma");
-            t->value.Fn.prms.push_back(type());
-        }
-        consume("CloseParen");
-        consume("Arrow");
-        t->value.Fn.ret = rettyp();
-    }
-    else{
-        consume("CloseParen");
-        consume("Arrow");
-        t->value.Fn.ret = rettyp();
+    consume(Token::OpenParen);
+    vector<Type*> prms;
+    if(tokens->kind != Token::CloseParen){
+        prms.push_back(type());
+        while(tokens->kind == Token::Comma){
+            consume(Token::Comma);
+            prms.push_back(type());
+        }
     }
-    return t;
+    consume(Token::CloseParen);
+    consume(Token::Arrow);
+    return fn_type(prms, rettyp());
 }
 
 /*
@@ -265,8 +612,8 @@ Type* funtype(){
 */
 
 Type* rettyp(){
-    if(*tokens == "Underscore"){
-        consume("Underscore");
+    if(tokens->kind == Token::Underscore){
+        consume(Token::Underscore);
         return NULL;
     }
     return type();
@@ -280,36 +627,82 @@ Type* rettyp(){
 Program* program() {
     if(DEBUG_MODE) cout << "program: " << *tokens << endl;
 
-    Program* p = new Program;
-
-    while(*tokens != "\0"){ 
-        if(*tokens == "Let"){
-            //Call glob function 
-            vector<Decl*> d = glob();
-            //We need to merge both vectors (p and d)
-            for(long unsigned int i = 0; i < d.size(); i++){
-                p->globals.push_back(d[i]);
-                // Adding the declarations to the global
+    Program* p = ast_new<Program>();
+
+    while(tokens->kind != Token::End){ 
+        switch(tokens->kind){
+            case Token::Let: {
+                //Call glob function 
+                vector<Decl*> d = glob();
+                //We need to merge both vectors (p and d)
+                for(long unsigned int i = 0; i < d.size(); i++){
+                    p->globals.push_back(d[i]);
+                    // Adding the declarations to the global
+                }
+                break;
             }
+            case Token::Struct:
+                //Call typedef function
+                p->structs.push_back(typdef());
+                break;
+            case Token::Extern:
+                //Call extern function
+                p->externs.push_back(extrn());
+                break;
+            case Token::Fn:
+                //Call fundef function
+                p->functions.push_back(fundef());
+                break;
+            default:
+                token_index++;
+                throw runtime_error{"Expected toplevel"};
         }
-        else if(*tokens == "Struct"){
-            //Call typedef function
-            Struct* s = typdef();  
-            p->structs.push_back(s);
-        }
-        else if(*tokens == "Extern"){
-            //Call extern function
-            Decl* d = extrn();
-            p->externs.push_back(d);
-        }
-        else if(*tokens == "Fn"){
-            //Call fundef function
-            Function* f = fundef();
-            p->functions.push_back(f);
-        }
-        else{
-            token_index++;
-            throw runtime_error{"Expected toplevel"};
+    }
+    return p;
+}
+
+/*
+ * Like program(), but only the headers of functions are kept. Bodies are
+ * parsed to find their errors and then dropped; the position of every
+ * fundef is recorded in starts, in source order, so its body can be
+ * parsed again on its own later, one function at a time.
+ */
+Program* program_outline(vector<Token*>& starts) {
+    if(DEBUG_MODE) cout << "program_outline: " << *tokens << endl;
+
+    Program* p = ast_new<Program>();
+
+    while(tokens->kind != Token::End){
+        switch(tokens->kind){
+            case Token::Let: {
+                vector<Decl*> d = glob();
+                for(long unsigned int i = 0; i < d.size(); i++){
+                    p->globals.push_back(d[i]);
+                }
+                break;
+            }
+            case Token::Struct:
+                p->structs.push_back(typdef());
+                break;
+            case Token::Extern:
+                p->externs.push_back(extrn());
+                break;
+            case Token::Fn: {
+                Token* start = tokens;
+                int start_index = token_index;
+                Function* f = fundef_header();
+                starts.push_back(start);
+                p->functions.push_back(f);
+                // the header is kept, the body goes back to the arena
+                ArenaScope body(ast_arena);
+                tokens = start;
+                token_index = start_index;
+                fundef();
+                break;
+            }
+            default:
+                token_index++;
+                throw runtime_error{"Expected toplevel"};
         }
     }
     return p;
@@ -321,9 +714,9 @@ glob ::= `let` decls `;`
 */
 vector<Decl*> glob(){
     if(DEBUG_MODE) cout << "glob: " << *tokens << endl;
-    consume("Let");
+    consume(Token::Let);
     vector<Decl*> temps = decls();
-    consume("Semicolon");
+    consume(Token::Semicolon);
     return temps;
 }
 
@@ -336,8 +729,8 @@ vector<Decl*> decls(){
     if(DEBUG_MODE) cout << "decls: " << *tokens << endl;
     vector<Decl*> d;
     d.push_back(decl());
-    while(*tokens == "Comma"){
-        consume("Comma");
+    while(tokens->kind == Token::Comma){
+        consume(Token::Comma);
         d.push_back(decl());
     }
     return d;
@@ -348,10 +741,10 @@ vector<Decl*> decls(){
 */
 Decl* decl(){
     if(DEBUG_MODE) cout << "decl: " << *tokens << endl;
-    Decl* d = new Decl;
+    Decl* d = ast_new<Decl>();
     string id = consume_id();
     d->name = id;
-    consume("Colon");
+    consume(Token::Colon);
     d->type = type();
     return d;
 }
@@ -359,14 +752,14 @@ Decl* decl(){
 // typdef ::= `struct` id `{` decls `}`
 Struct* typdef(){
     if(DEBUG_MODE) cout << "typdef: " << *tokens << endl;
-    Struct* s = new Struct;
+    Struct* s = ast_new<Struct>();
     
-    consume("Struct");
+    consume(Token::Struct);
     string id = consume_id();
     s->name = id;
-    consume("OpenBrace");
+    consume(Token::OpenBrace);
     s->fields = decls(); //returns vector<Decl*>
-    consume("CloseBrace");
+    consume(Token::CloseBrace);
     return s;
 }
 
@@ -374,13 +767,13 @@ Struct* typdef(){
 
 Decl* extrn(){
     if(DEBUG_MODE) cout << "extrn: " << *tokens << endl;
-    Decl* d = new Decl;
-    consume("Extern");
+    Decl* d = ast_new<Decl>();
+    consume(Token::Extern);
     string id =consume_id();
     d->name = id;
-    consume("Colon");
+    consume(Token::Colon);
     d->type  = funtype();
-    consume("Semicolon");
+    consume(Token::Semicolon);
     return d;
 }
 
@@ -396,25 +789,11 @@ Decl* extrn(){
 
 Function* fundef(){
     if(DEBUG_MODE) cout << "fundef: " << *tokens << endl;
-    Function* f = new Function;
-    
-    
-    consume("Fn");
-    string id = consume_id();
-    f->name = id;
-
-    consume("OpenParen");
-
-    if(*tokens != "CloseParen"){
-        f->params = decls();
-    }
-    consume("CloseParen");
-    consume("Arrow");
-    f->rettyp = rettyp();
-    consume("OpenBrace");
+    Function* f = fundef_header();
+    consume(Token::OpenBrace);
 
     // let*
-    while(*tokens == "Let"){
+    while(tokens->kind == Token::Let){
         vector<pair<Decl*, Exp*>> temp = let();
         for(long unsigned int i = 0; i < temp.size(); i++){
             f->locals.push_back(temp[i]);
@@ -422,10 +801,30 @@ Function* fundef(){
     }
     // stmt+
     f->stmts.push_back(stmt()); // ensure at least 1 stmt
-    while(*tokens != "CloseBrace"){
+    while(tokens->kind != Token::CloseBrace){
         f->stmts.push_back(stmt());
     }
-    consume("CloseBrace");
+    consume(Token::CloseBrace);
+    return f;
+}
+
+// everything in fundef up to the `{` of the body: name, params and rettyp
+Function* fundef_header(){
+    if(DEBUG_MODE) cout << "fundef_header: " << *tokens << endl;
+    Function* f = ast_new<Function>();
+
+    consume(Token::Fn);
+    string id = consume_id();
+    f->name = id;
+
+    consume(Token::OpenParen);
+
+    if(tokens->kind != Token::CloseParen){
+        f->params = decls();
+    }
+    consume(Token::CloseParen);
+    consume(Token::Arrow);
+    f->rettyp = rettyp();
     return f;
 }
 
@@ -435,11 +834,11 @@ Function* fundef(){
 vector<pair<Decl*, Exp*>> let(){
     if(DEBUG_MODE) cout << "let: " << *tokens << endl;
     vector<pair<Decl*, Exp*>> d;
-    consume("Let");
+    consume(Token::Let);
     pair<Decl*, Exp*> temp = {decl(), NULL};
     //If statement if there is 1 equals sign so 1 expression
-    if(*tokens == "Gets"){
-        consume("Gets");
+    if(tokens->kind == Token::Gets){
+        consume(Token::Gets);
         temp.second = exp();
         d.push_back(temp);
     }
@@ -448,11 +847,11 @@ vector<pair<Decl*, Exp*>> let(){
         d.push_back(temp);
     }
     //While loop is to handle all the comma cases
-    while(*tokens == "Comma"){
-        consume("Comma");
+    while(tokens->kind == Token::Comma){
+        consume(Token::Comma);
         temp = {decl(), NULL};
-        if(*tokens == "Gets"){
-            consume("Gets");
+        if(tokens->kind == Token::Gets){
+            consume(Token::Gets);
             temp.second = exp();
             d.push_back(temp);
         }
@@ -461,7 +860,7 @@ vector<pair<Decl*, Exp*>> let(){
             d.push_back(temp);
         }
     }
-    consume("Semicolon");
+    consume(Token::Semicolon);
     return d;
 }
 
@@ -477,40 +876,42 @@ stmt ::= cond               # conditional
 Stmt* stmt(){
     if(DEBUG_MODE) cout << "stmt: " << *tokens << endl;
     Stmt* s;
-    if(*tokens == "If"){
-        s = cond();
-    }
-    else if(*tokens == "While"){
-        s = loop();
-    }
-    else if(tokens->substr(0,3) == "Id(" || *tokens == "Star"){
-        s = assign_or_call();
-        consume("Semicolon");
-    }
-    else if(*tokens == "Break"){
-        s = new Stmt;
-        s->type = Stmt::Break;
-        consume("Break");
-        consume("Semicolon");
-    }
-    else if(*tokens == "Continue"){
-        s = new Stmt;
-        s->type = Stmt::Continue;
-        consume("Continue");
-        consume("Semicolon");
-    }
-    else if(*tokens == "Return"){
-        s = new Stmt;
-        s->type = Stmt::Return;
-        consume("Return");
-        if(*tokens != "Semicolon"){
-            s->value.Return.exp = exp();
-        }
-        consume("Semicolon");
-    }
-    else{
-        token_index++;
-        throw runtime_error{"Expected stmt"};
+    switch(tokens->kind){
+        case Token::If:
+            s = cond();
+            break;
+        case Token::While:
+            s = loop();
+            break;
+        case Token::Id:
+        case Token::Star:
+            s = assign_or_call();
+            consume(Token::Semicolon);
+            break;
+        case Token::Break:
+            s = ast_new<Stmt>();
+            s->type = Stmt::Break;
+            consume(Token::Break);
+            consume(Token::Semicolon);
+            break;
+        case Token::Continue:
+            s = ast_new<Stmt>();
+            s->type = Stmt::Continue;
+            consume(Token::Continue);
+            consume(Token::Semicolon);
+            break;
+        case Token::Return:
+            s = ast_new<Stmt>();
+            s->type = Stmt::Return;
+            consume(Token::Return);
+            if(tokens->kind != Token::Semicolon){
+                s->value.Return.exp = exp();
+            }
+            consume(Token::Semicolon);
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Expected stmt"};
     }
     return s;
 }
@@ -518,15 +919,15 @@ Stmt* stmt(){
 // cond ::= `if` exp block (`else` block)?
 Stmt* cond(){
     if(DEBUG_MODE) cout << "cond: " << *tokens << endl;
-    Stmt* s = new Stmt;
+    Stmt* s = ast_new<Stmt>();
     s->type = Stmt::If;
 
-    consume("If");
+    consume(Token::If);
     
     s->value.If.guard = exp();
     s->value.If.tt = block();
-    if(*tokens == "Else"){
-        consume("Else");
+    if(tokens->kind == Token::Else){
+        consume(Token::Else);
         s->value.If.ff = block();
     }
     return s;
@@ -535,10 +936,10 @@ Stmt* cond(){
 // loop ::= `while` exp block 
 Stmt* loop(){
     if(DEBUG_MODE) cout << "loop: " << *tokens << endl;
-    Stmt* s = new Stmt;
+    Stmt* s = ast_new<Stmt>();
     s->type = Stmt::While;
 
-    consume("While");
+    consume(Token::While);
     s->value.While.guard = exp();
     s->value.While.body = block();
     return s;
@@ -549,11 +950,11 @@ Stmt* loop(){
 vector<Stmt*> block(){
     if(DEBUG_MODE) cout << "block: " << *tokens << endl;
     vector<Stmt*> b;
-    consume("OpenBrace");
-    while(*tokens != "CloseBrace"){
+    consume(Token::OpenBrace);
+    while(tokens->kind != Token::CloseBrace){
         b.push_back(stmt());
     }
-    consume("CloseBrace");
+    consume(Token::CloseBrace);
     
     return b;
 }
@@ -564,26 +965,26 @@ vector<Stmt*> block(){
 
 Stmt* assign_or_call(){
     if(DEBUG_MODE) cout << "assign_or_call: " << *tokens << endl;
-    Stmt* s = new Stmt;
+    Stmt* s = ast_new<Stmt>();
     
     Lval* l = lval();
 
     // Here we assign the right hand sign
-    if(*tokens == "Gets"){
+    if(tokens->kind == Token::Gets){
         s->type = Stmt::Assign;
-        consume("Gets");
+        consume(Token::Gets);
         s->value.Assign.lhs = l;
         s->value.Assign.rhs = rhs();
     }
     //Here we call a function
-    else if(*tokens == "OpenParen"){
+    else if(tokens->kind == Token::OpenParen){
         s->type = Stmt::Call;
-        consume("OpenParen");
+        consume(Token::OpenParen);
         s->value.Call.callee = l;
-        if(*tokens != "CloseParen"){
+        if(tokens->kind != Token::CloseParen){
             s->value.Call.args = args();
         }
-        consume("CloseParen");
+        consume(Token::CloseParen);
     }
     else{
         token_index++;
@@ -597,16 +998,16 @@ Stmt* assign_or_call(){
 //         | `new` type exp?
 Rhs* rhs(){
     if(DEBUG_MODE) cout << "rhs: " << *tokens << endl;
-    Rhs* r = new Rhs;
+    Rhs* r = ast_new<Rhs>();
 
-    if (*tokens == "New"){
+    if (tokens->kind == Token::New){
         r->type = Rhs::New;
-        consume("New");
+        consume(Token::New);
         r->value.New.type = type();
-        if(*tokens != "Semicolon")
+        if(tokens->kind != Token::Semicolon)
             r->value.New.amount = exp();
         else{
-            Exp* e = new Exp;
+            Exp* e = ast_new<Exp>();
             e->type = Exp::Num;
             e->value.Num.n = 1;
             r->value.New.amount = e;
@@ -626,18 +1027,18 @@ Rhs* rhs(){
 
 Lval* lval(){
     if(DEBUG_MODE) cout << "lval: " << *tokens << endl;
-    if(*tokens == "Star"){
-        Lval* l = new Lval;
-        consume("Star");
+    if(tokens->kind == Token::Star){
+        Lval* l = ast_new<Lval>();
+        consume(Token::Star);
         l->type = Lval::Deref;
         l->value.Deref.lval = lval();
         return l;
     }
     string id = consume_id();
-    Lval* l = new Lval;
+    Lval* l = ast_new<Lval>();
     l->type = Lval::Id;
     l->value.Id.name = id;
-    while(*tokens == "OpenBracket" || *tokens == "Dot"){
+    while(tokens->kind == Token::OpenBracket || tokens->kind == Token::Dot){
         l = access(l);
     }
     return l;
@@ -648,18 +1049,18 @@ Lval* lval(){
 Lval* access(Lval* l_temp){
     if(DEBUG_MODE) cout << "access: " << *tokens << endl;
     //Last step of the recursion where we pass up the access
-    Lval* l = new Lval;
+    Lval* l = ast_new<Lval>();
     //Array access like arr[0][2]
-    if(*tokens == "OpenBracket"){
-        consume("OpenBracket");
+    if(tokens->kind == Token::OpenBracket){
+        consume(Token::OpenBracket);
         l->type = Lval::ArrayAccess;
         l->value.ArrayAccess.index = exp();
         l->value.ArrayAccess.ptr = l_temp;
-        consume("CloseBracket");
+        consume(Token::CloseBracket);
     }
     //Field access like arr.id
-    else if(*tokens == "Dot"){
-        consume("Dot");
+    else if(tokens->kind == Token::Dot){
+        consume(Token::Dot);
         l->type = Lval::FieldAccess;
         string id = consume_id();
         l->value.FieldAccess.field = id;
@@ -676,8 +1077,8 @@ vector<Exp*> args(){
 
     b.push_back(exp());
 
-    while(*tokens == "Comma"){
-        consume("Comma");
+    while(tokens->kind == Token::Comma){
+        consume(Token::Comma);
         b.push_back(exp());
     }
     return b;
@@ -688,166 +1089,235 @@ vector<Exp*> args(){
 # operators are right-associative. exp_ac binds tighter than `*`, e.g.,
 # `*id[2]` means `*(id[2])`; to get `(*id)[2]` we need to write `id[0][2]`.
    exp ::= exp_p4 (binop_p3 exp_p4)*
+   exp_p4 ::= exp_p3 (binop_p2 exp_p3)*
+   exp_p3 ::= exp_p2 (binop_p1 exp_p2)*
+   exp_p2 ::= unop* exp_p1
+   exp_p1 ::= num | `nil` | `(` exp `)` | id exp_ac*
+   exp_ac ::= `[` exp `]` | `.` id | `(` args? `)`
 */
 
-// exp ::= exp_p4 (binop_p3 exp_p4)*
-Exp* exp(){
-    if(DEBUG_MODE) cout << "exp: " << *tokens << endl;
-    Exp* e = exp_p4();
-    while (*tokens == "Equal"
-        || *tokens == "NotEq"
-        || *tokens == "Lt"
-        || *tokens == "Lte"
-        || *tokens == "Gt"
-        || *tokens == "Gte"
-    ){
-        Exp* temp = new Exp;
-        temp->type = Exp::BinOp;
-        temp->value.BinOp.left = e;
-        temp->value.BinOp.op = binop_p3();
-        temp->value.BinOp.right = exp_p4();
-        e = temp;
-    }
-    return e;
-}
-
-
-// exp_p4 ::= exp_p3 (binop_p2 exp_p3)*
-
-Exp* exp_p4(){
-    if(DEBUG_MODE) cout << "exp_p4: " << *tokens << endl;
-    Exp* e = exp_p3();
-    while (*tokens == "Plus" || *tokens=="Dash"){
-        Exp* temp = new Exp;
-        temp->type = Exp::BinOp;
-        temp->value.BinOp.left = e;
-        temp->value.BinOp.op = binop_p2();
-        temp->value.BinOp.right = exp_p3();
-        e = temp;
-    }
-    return e;
-}
-
-// exp_p3 ::= exp_p2 (binop_p1 exp_p2)*
-
-Exp* exp_p3(){
-    if(DEBUG_MODE) cout << "exp_p3: " << *tokens << endl;
-    Exp* e = exp_p2();
-    while(*tokens == "Star" || *tokens == "Slash"){
-        Exp* temp = new Exp;
-        temp->type = Exp::BinOp;
-        temp->value.BinOp.left = e;
-        temp->value.BinOp.op = binop_p1();
-        temp->value.BinOp.right = exp_p2();
-        e = temp;
-    }
-    return e;
-}
-
-
-// exp_p2 ::= unop* exp_p1
-Exp* exp_p2(){
-    if(DEBUG_MODE) cout << "exp_p2: " << *tokens << endl;
-    Exp* e = new Exp;
-    if(*tokens=="Star" || *tokens=="Dash"){
-        e = new Exp;
-        e->type = Exp::UnOp;
-        e->value.UnOp.op = unop();
-        e->value.UnOp.operand = exp_p2();
-        return e;
-    }
-    e = exp_p1();
-    return e;
-}
-
+/*
+ * The grammar above is parsed without recursion: operands and pending
+ * operators live on explicit stacks, and every `(`, `[` or call argument
+ * list opens a frame on a third stack instead of a nested call. Binary
+ * operators are reduced by precedence climbing, lowest level first, which
+ * gives the same left-associative trees as the grammar.
+ */
 
-// exp_p1 ::= num | `nil` | `(` exp `)` | id exp_ac*
-Exp* exp_p1(){
-    if(DEBUG_MODE) cout << "exp_p1: " << *tokens << endl;
-    Exp* e;
-    if(*tokens == "Nil"){
-        consume("Nil");
-        e = new Exp;
-        e->type = Exp::Nil;
-    }
-    else if(*tokens == "OpenParen"){
-        consume("OpenParen");
-        e = exp();
-        consume("CloseParen");
+// An operator waiting for its right operand
+struct PendingOp {
+    int prec;
+    UnaryOp* unop;   // set for unary operators
+    BinaryOp* binop; // set for binary operators
+};
+
+// A nested expression: the whole exp, or one inside (), [] or call args
+struct ExpFrame {
+    enum {Top, Paren, Index, Args} kind;
+    Exp* node;            // the ArrayAccess / Call being filled in
+    size_t operand_base;  // stack heights when the frame was opened
+    size_t operator_base;
+};
+
+const int UNOP_PREC = 4;
+
+// binop_p1 binds tightest, 0 means not a binary operator
+static inline int binop_prec(enum Token::kind kind){
+    switch(kind){
+        case Token::Star: case Token::Slash:
+            return 3;
+        case Token::Plus: case Token::Dash:
+            return 2;
+        case Token::Equal: case Token::NotEq: case Token::Lt:
+        case Token::Lte: case Token::Gt: case Token::Gte:
+            return 1;
+        default:
+            return 0;
     }
-    else if(tokens->substr(0, 4) == "Num("){
-        int32_t num = consume_num();
-        e = new Exp;
-        e->type = Exp::Num;
-        e->value.Num.n = num;
-    }
-    else if(tokens->substr(0, 3) == "Id(" && tokens->substr(tokens->length() - 1, 1) == ")"){
-        string id = consume_id();
-        e = new Exp;
-        e->type = Exp::Id;
-        e->value.Id.name = id;
+}
 
-        while(*tokens == "OpenBracket" || *tokens == "Dot" || *tokens == "OpenParen"){
-            e = exp_ac(e);
-        }   
+// pop the top operator and its operands, push the node they make
+static void reduce(vector<Exp*>& operands, vector<PendingOp>& operators){
+    PendingOp op = operators.back();
+    operators.pop_back();
+    Exp* e = ast_new<Exp>();
+    if(op.unop != NULL){
+        e->type = Exp::UnOp;
+        e->value.UnOp.op = op.unop;
+        e->value.UnOp.operand = operands.back();
     }
     else{
-        token_index++;
-        throw runtime_error{"Expected exp_p1"};
+        e->type = Exp::BinOp;
+        e->value.BinOp.op = op.binop;
+        e->value.BinOp.right = operands.back();
+        operands.pop_back();
+        e->value.BinOp.left = operands.back();
     }
-    return e;
+    operands.back() = e;
 }
 
-// exp_ac ::= `[` exp `]` | `.` id | `(` args? `)`
-Exp* exp_ac(Exp* e_temp){
-    if(DEBUG_MODE) cout << "exp_ac: " << *tokens << endl;
-    Exp* e = new Exp;
-    if(*tokens == "OpenBracket"){
-        consume("OpenBracket");
-        e->type = Exp::ArrayAccess;
-        e->value.ArrayAccess.index = exp();
-        e->value.ArrayAccess.ptr = e_temp;
-        consume("CloseBracket");
-    } 
-    else if(*tokens == "Dot"){
-        consume("Dot");
-        e->type = Exp::FieldAccess;
-        string id = consume_id();
-        e->value.FieldAccess.field = id;
-        e->value.FieldAccess.ptr = e_temp;
-    } 
-    else if(*tokens == "OpenParen"){
-        consume("OpenParen");
-        e->type = Exp::Call;
-        e->value.Call.callee = e_temp;
-        if(*tokens != "CloseParen"){
-            e->value.Call.args = args();
+Exp* exp(){
+    if(DEBUG_MODE) cout << "exp: " << *tokens << endl;
+    vector<Exp*> operands;
+    vector<PendingOp> operators;
+    vector<ExpFrame> frames;
+    frames.push_back(ExpFrame{ExpFrame::Top, NULL, 0, 0});
+
+    // where we are within the current frame
+    enum {Operand, Postfix, Operator} state = Operand;
+    while(true){
+        if(state == Operand){
+            // unop* followed by exp_p1
+            switch(tokens->kind){
+                case Token::Star:
+                case Token::Dash:
+                    operators.push_back(PendingOp{UNOP_PREC, unop(), NULL});
+                    continue;
+                case Token::Nil: {
+                    consume(Token::Nil);
+                    Exp* e = ast_new<Exp>();
+                    e->type = Exp::Nil;
+                    operands.push_back(e);
+                    state = Operator;
+                    continue;
+                }
+                case Token::Num: {
+                    Exp* e = ast_new<Exp>();
+                    e->type = Exp::Num;
+                    e->value.Num.n = consume_num();
+                    operands.push_back(e);
+                    state = Operator;
+                    continue;
+                }
+                case Token::Id: {
+                    Exp* e = ast_new<Exp>();
+                    e->type = Exp::Id;
+                    string id = consume_id();
+                    e->value.Id.name = id;
+                    operands.push_back(e);
+                    state = Postfix;
+                    continue;
+                }
+                case Token::OpenParen:
+                    consume(Token::OpenParen);
+                    frames.push_back(ExpFrame{ExpFrame::Paren, NULL, operands.size(), operators.size()});
+                    continue;
+                default:
+                    token_index++;
+                    throw runtime_error{"Expected exp_p1"};
+            }
+        }
+
+        if(state == Postfix){
+            // exp_ac*, applied to the operand on top of the stack
+            Exp* e;
+            switch(tokens->kind){
+                case Token::OpenBracket:
+                    consume(Token::OpenBracket);
+                    e = ast_new<Exp>();
+                    e->type = Exp::ArrayAccess;
+                    e->value.ArrayAccess.ptr = operands.back();
+                    operands.pop_back();
+                    frames.push_back(ExpFrame{ExpFrame::Index, e, operands.size(), operators.size()});
+                    state = Operand;
+                    continue;
+                case Token::Dot: {
+                    consume(Token::Dot);
+                    e = ast_new<Exp>();
+                    e->type = Exp::FieldAccess;
+                    string id = consume_id();
+                    e->value.FieldAccess.field = id;
+                    e->value.FieldAccess.ptr = operands.back();
+                    operands.back() = e;
+                    continue;
+                }
+                case Token::OpenParen:
+                    consume(Token::OpenParen);
+                    e = ast_new<Exp>();
+                    e->type = Exp::Call;
+                    e->value.Call.callee = operands.back();
+                    if(tokens->kind == Token::CloseParen){
+                        consume(Token::CloseParen);
+                        operands.back() = e;
+                        continue;
+                    }
+                    operands.pop_back();
+                    frames.push_back(ExpFrame{ExpFrame::Args, e, operands.size(), operators.size()});
+                    state = Operand;
+                    continue;
+                default:
+                    state = Operator;
+                    break;
+            }
+        }
+
+        // state == Operator: either a binary operator follows, or the frame ends
+        int prec = binop_prec(tokens->kind);
+        ExpFrame& frame = frames.back();
+        if(prec > 0){
+            while(operators.size() > frame.operator_base && operators.back().prec >= prec){
+                reduce(operands, operators);
+            }
+            BinaryOp* b = prec == 3 ? binop_p1() : prec == 2 ? binop_p2() : binop_p3();
+            operators.push_back(PendingOp{prec, NULL, b});
+            state = Operand;
+            continue;
+        }
+        while(operators.size() > frame.operator_base){
+            reduce(operands, operators);
+        }
+        Exp* result = operands.back();
+        operands.pop_back();
+
+        switch(frame.kind){
+            case ExpFrame::Top:
+                return result;
+            case ExpFrame::Paren:
+                consume(Token::CloseParen);
+                operands.push_back(result);
+                frames.pop_back();
+                // no exp_ac after a parenthesized exp
+                state = Operator;
+                break;
+            case ExpFrame::Index:
+                frame.node->value.ArrayAccess.index = result;
+                consume(Token::CloseBracket);
+                operands.push_back(frame.node);
+                frames.pop_back();
+                state = Postfix;
+                break;
+            case ExpFrame::Args:
+                frame.node->value.Call.args.push_back(result);
+                if(tokens->kind == Token::Comma){
+                    consume(Token::Comma);
+                    state = Operand;
+                    break;
+                }
+                consume(Token::CloseParen);
+                operands.push_back(frame.node);
+                frames.pop_back();
+                state = Postfix;
+                break;
         }
-        consume("CloseParen");
-    }
-    else { 
-        token_index++;
-        throw runtime_error{"Expected exp_ac"};
     }
-    return e;
 }
 
 // unop ::= `*` | `-`
 UnaryOp* unop(){
     if(DEBUG_MODE) cout << "unop: " << *tokens << endl;
-    UnaryOp* u = new UnaryOp;
-    if (*tokens=="Star"){
-        u->type = UnaryOp::Deref;   
-        consume("Star");
-    } 
-    else if (*tokens == "Dash"){ 
-        u->type = UnaryOp::Neg;
-        consume("Dash");
-    }
-    else {
-        token_index++;
-        throw runtime_error{"Expected unop"};
+    UnaryOp* u = ast_new<UnaryOp>();
+    switch(tokens->kind){
+        case Token::Star:
+            u->type = UnaryOp::Deref;
+            break;
+        case Token::Dash:
+            u->type = UnaryOp::Neg;
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Expected unop"};
     }
+    consume(tokens->kind);
     return u;
 }
 
@@ -859,83 +1329,73 @@ UnaryOp* unop(){
 // binop_p1 ::= `*` | `/`
 BinaryOp* binop_p1 (){
     if(DEBUG_MODE) cout << "binop_p1: " << *tokens << endl;
-    BinaryOp* b1 = new BinaryOp;
-    // `*`
-    if (*tokens == "Star"){ 
-        b1->type = BinaryOp::Mul;
-        consume("Star");
-    } 
-    // `/`
-    else if(*tokens == "Slash"){ 
-        b1->type = BinaryOp::Div;
-        consume("Slash");
-    }
-    else {
-        token_index++;
-        throw runtime_error{"Expected binop_p1"};
+    BinaryOp* b1 = ast_new<BinaryOp>();
+    switch(tokens->kind){
+        // `*`
+        case Token::Star:
+            b1->type = BinaryOp::Mul;
+            break;
+        // `/`
+        case Token::Slash:
+            b1->type = BinaryOp::Div;
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Expected binop_p1"};
     }
+    consume(tokens->kind);
     return b1;
 }
 
 // binop_p2 ::= `+` | `-`
 BinaryOp* binop_p2(){
     if(DEBUG_MODE) cout << "binop_p2: " << *tokens << endl;
-    BinaryOp* b2 = new BinaryOp;
-    // `+`
-    if (*tokens=="Plus"){ 
-        b2->type = BinaryOp::Add;
-        consume("Plus");
-    } 
-    // `-`
-    else if (*tokens == "Dash"){ 
-        b2->type = BinaryOp::Sub;
-        consume("Dash");
-    }
-    else {
-        token_index++;
-        throw runtime_error{"Expected binop_p2"};
+    BinaryOp* b2 = ast_new<BinaryOp>();
+    switch(tokens->kind){
+        // `+`
+        case Token::Plus:
+            b2->type = BinaryOp::Add;
+            break;
+        // `-`
+        case Token::Dash:
+            b2->type = BinaryOp::Sub;
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Expected binop_p2"};
     }
+    consume(tokens->kind);
     return b2;
 }
 
 // binop_p3 ::= `==` | `!=` | `<` | `<=` | `>` | `>=`
 BinaryOp* binop_p3(){
     if(DEBUG_MODE) cout << "binop_p3: " << *tokens << endl;
-    BinaryOp* b3 = new BinaryOp;
-    // `==`
-    if (*tokens == "Equal"){ 
-        b3->type = BinaryOp::Equal;
-        consume("Equal");
-    }
-    // `!=`
-    else if (*tokens == "NotEq"){ 
-        b3->type = BinaryOp::NotEq;
-        consume("NotEq");
-    } 
-    // `<`
-    else if (*tokens == "Lt"){ 
-        b3->type = BinaryOp::Lt;
-        consume("Lt");
-    } 
-    // `<=`
-    else if (*tokens == "Lte"){ 
-        b3->type = BinaryOp::Lte;
-        consume("Lte");
-    } 
-    // `>`
-    else if (*tokens == "Gt"){ 
-        b3->type = BinaryOp::Gt;
-        consume("Gt");
-    } 
-    // `>=`
-    else if (*tokens == "Gte"){ 
-        b3->type = BinaryOp::Gte;
-        consume("Gte");
-    } 
-    else {
-        token_index++;
-        throw runtime_error{"Expected binop_p3"};
+    BinaryOp* b3 = ast_new<BinaryOp>();
+    switch(tokens->kind){
+        case Token::Equal:
+            b3->type = BinaryOp::Equal;
+            break;
+        case Token::NotEq:
+            b3->type = BinaryOp::NotEq;
+            break;
+        case Token::Lt:
+            b3->type = BinaryOp::Lt;
+            break;
+        case Token::Lte:
+            b3->type = BinaryOp::Lte;
+            break;
+        case Token::Gt:
+            b3->type = BinaryOp::Gt;
+            break;
+        case Token::Gte:
+            b3->type = BinaryOp::Gte;
+            break;
+        default:
+            token_index++;
+            throw runtime_error{"Expected binop_p3"};
     }
+    consume(tokens->kind);
     return b3;
 }
 
@@ -947,11 +1407,11 @@ BinaryOp* binop_p3(){
  *
  * Returns input + 1.
  */
-void consume(string expected) {
+void consume(enum Token::kind expected) {
     token_index++;
-    if(DEBUG_MODE) cout << token_index << ": consume: " << expected << ", token: " << *tokens;
-    if(*tokens != expected){
-        throw runtime_error{"consume Expected " + expected + " got " + *tokens};
+    if(DEBUG_MODE) cout << token_index << ": consume: " << token_names[expected] << ", token: " << *tokens;
+    if(tokens->kind != expected){
+        throw runtime_error{"consume Expected " + string(token_names[expected]) + " got " + token_string(*tokens)};
     }
     tokens++;
     if(DEBUG_MODE) cout << ", next token: " << *tokens << endl;
@@ -962,10 +1422,10 @@ string consume_id(){ // tokens = reference to tokens array
     token_index++;
     if(DEBUG_MODE) cout << token_index << ": consume_id: " << *tokens << endl;
     // Handles the case where user inputted wrong id format in token
-    if(tokens->substr(0,3) != "Id("|| tokens->substr(tokens->length() - 1, 1) != ")"){
-        throw runtime_error{"Expected ID got " + *tokens};
+    if(tokens->kind != Token::Id){
+        throw runtime_error{"Expected ID got " + token_string(*tokens)};
     }
-    string id_name = tokens->substr(3, tokens->length() - 4);
+    const string& id_name = token_ids[tokens->payload];
     if(DEBUG_MODE) cout << "id_name: " << id_name << endl;
     tokens++;
     return id_name;
@@ -975,10 +1435,10 @@ int32_t consume_num(){ // tokens = reference to tokens array
     token_index++;
     if(DEBUG_MODE) cout << token_index << ": consume_num: " << *tokens << endl;
     // Handles the case where user inputted wrong num format in token
-    if(tokens->substr(0,4) != "Num(" || tokens->substr(tokens->length() - 1, 1) != ")"){
-        throw runtime_error{"Expected Num got " + *tokens};
+    if(tokens->kind != Token::Num){
+        throw runtime_error{"Expected Num got " + token_string(*tokens)};
     }
-    string num_name = tokens->substr(4, tokens->length() - 5);
+    int32_t num = tokens->payload;
     tokens++;
-    return (int32_t)stoi(num_name);
-}
\ No newline at end of file
+    return num;
+}
@@ -4,11 +4,54 @@
 #include <vector>
 #include <utility>
 #include <iostream>
+#include <cstddef>
+#include <cstdint>
 #include "ast.hpp"
 using namespace std;
 
 // can function have multiple return types?
 
+// A token line is a slice of the mapped token file, one line per token.
+// The text is never copied; comparisons work directly on the slice.
+typedef struct TokenLine {
+  const char* str;
+  size_t len;
+  bool operator==(const char* s) const;
+  bool starts_with(const char* prefix) const;
+  bool ends_with(char c) const;
+  string to_string() const;
+} TokenLine;
+
+// A classified token. Id payloads index into token_ids,
+// Num payloads hold the value itself.
+typedef struct Token {
+  enum kind {End, Num, Id, Int, Struct, Nil, Break, Continue, Return, If, Else,
+    While, New, Let, Extern, Fn, Address, Colon, Semicolon, Comma, Underscore,
+    Arrow, Plus, Dash, Star, Slash, Equal, NotEq, Lt, Lte, Gt, Gte, Dot, Gets,
+    OpenParen, CloseParen, OpenBracket, CloseBracket, OpenBrace, CloseBrace} kind;
+  int32_t payload;
+} Token;
+
+extern thread_local vector<string> token_ids;
+
+extern thread_local int token_index;
+
+int32_t intern_id(const char* str, size_t len);
+
+string token_string(const Token& t);
+
+ostream& operator<<(ostream& os, const Token& t);
+
+bool map_file(const char* filename, const char*& data, size_t& size);
+
+void unmap_file(const char* data, size_t size);
+
+void read_tokens(const char* data, size_t size, vector<TokenLine>& out);
+
+void classify_tokens(const vector<TokenLine>& lines, vector<Token>& out);
+
+void lex(const char* data, size_t size, vector<Token>& out);
+
 int main(int argc, char* argv[]);
 
 Type* type();
@@ -17,7 +60,7 @@ Type* type_ad();
 
 Type* type_op();
 
-Type* type_fp();
+Type* type_fp(vector<Type*>& prms);
 
 Type* type_ar();
 
@@ -27,6 +70,16 @@ Type* rettyp();
 
 Program* program();
 
+Program* program_outline(vector<Token*>& starts);
+
+void compile_streaming(Token* first);
+
+void compile(const char* input, size_t size, bool from_source, bool streaming, const char* cache_dir);
+
+void reset_parser();
+
+int run_batch(const char* manifest, int jobs, bool from_source, bool streaming, const char* cache_dir);
+
 vector<Decl*> glob();
 
 vector<Decl*> decls();
@@ -39,6 +92,8 @@ Decl* extrn();
 
 Function* fundef();
 
+Function* fundef_header();
+
 vector<pair<Decl*, Exp*>> let();
 
 Stmt* stmt();
@@ -61,16 +116,6 @@ vector<Exp*> args();
 
 Exp* exp();
 
-Exp* exp_p4();
-
-Exp* exp_p3();
-
-Exp* exp_p2();
-
-Exp* exp_p1();
-
-Exp* exp_ac(Exp* e_temp);
-
 UnaryOp* unop();
 
 BinaryOp* binop_p1 ();
@@ -80,7 +125,7 @@ BinaryOp* binop_p2();
 BinaryOp* binop_p3();
 
 
-void consume(string expected);
+void consume(enum Token::kind expected);
 
 string consume_id();
 
@@ -0,0 +1,329 @@
+/**
+ * Sparse conditional constant propagation (Wegman and Zadeck, "Constant
+ * Propagation with Conditional Branches") over a function in SSA form.
+ *
+ * Every variable starts out undefined (top) and can only go down to a
+ * constant and then to unknown (bottom); a block is only looked at once
+ * an edge into it is known to be taken, and a phi only meets the values
+ * coming in along such edges. Blocks are revisited when a variable they
+ * read goes down, which happens at most twice per variable.
+ *
+ * Folding follows what the generated code computes: 64-bit two's
+ * complement arithmetic, truncating division, and 0 / 1 for comparisons.
+ * A division that would trap is left to trap at run time.
+ *
+ * Afterwards, instructions with a constant result become copies of it,
+ * constant operands are written into the slots that take constants,
+ * branches with a known direction become jumps and the blocks no edge
+ * reaches are dropped.
+ */
+
+#include <vector>
+#include <cstdint>
+#include <climits>
+
+#include "opt.hpp"
+
+using namespace std;
+
+struct LatticeValue {
+	enum {Top, Const, Bottom} state;
+	int64_t num;
+};
+
+static LatticeValue top(){
+	return LatticeValue{LatticeValue::Top, 0};
+}
+
+static LatticeValue bottom(){
+	return LatticeValue{LatticeValue::Bottom, 0};
+}
+
+static LatticeValue constant(int64_t num){
+	return LatticeValue{LatticeValue::Const, num};
+}
+
+static LatticeValue meet(LatticeValue a, LatticeValue b){
+	if(a.state == LatticeValue::Top){
+		return b;
+	}
+	if(b.state == LatticeValue::Top){
+		return a;
+	}
+	if(a.state == LatticeValue::Const && b.state == LatticeValue::Const && a.num == b.num){
+		return a;
+	}
+	return bottom();
+}
+
+static LatticeValue fold(const LirInst& inst, int64_t a, int64_t b){
+	if(inst.type == LirInst::Arith){
+		// unsigned so overflow wraps like the machine instructions do
+		switch(inst.op){
+			case ArithmeticOp::Add:
+				return constant((int64_t)((uint64_t)a + (uint64_t)b));
+			case ArithmeticOp::Sub:
+				return constant((int64_t)((uint64_t)a - (uint64_t)b));
+			case ArithmeticOp::Mul:
+				return constant((int64_t)((uint64_t)a * (uint64_t)b));
+			case ArithmeticOp::Div:
+				if(b == 0 || (a == LLONG_MIN && b == -1)){
+					return bottom();
+				}
+				return constant(a / b);
+		}
+		return bottom();
+	}
+	switch(inst.op){
+		case ComparisonOp::Equal:
+			return constant(a == b);
+		case ComparisonOp::NotEq:
+			return constant(a != b);
+		case ComparisonOp::Lt:
+			return constant(a < b);
+		case ComparisonOp::Lte:
+			return constant(a <= b);
+		case ComparisonOp::Gt:
+			return constant(a > b);
+		case ComparisonOp::Gte:
+			return constant(a >= b);
+	}
+	return bottom();
+}
+
+// a constant an instruction slot or operand can hold
+static bool fits_slot(const LatticeValue& v){
+	return v.state == LatticeValue::Const && v.num >= INT32_MIN && v.num <= INT32_MAX;
+}
+
+void sccp(LIR_Function* func, const CFG& cfg){
+	VarId num_vars = func->vars.size();
+	size_t num_blocks = func->body.size();
+
+	// the variables assigned in the function start undefined; the others
+	// hold what they had on entry: 0 for a local, unknown for a parameter
+	// or a global
+	vector<bool> assigned(num_vars, false);
+	vector<vector<BlockId>> readers(num_vars);
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		auto read = [&](VarId v){
+			if(readers[v].empty() || readers[v].back() != id){
+				readers[v].push_back(id);
+			}
+			return v;
+		};
+		for(LirPhi& phi : bb->phis){
+			assigned[phi.lhs] = true;
+			for(VarId arg : phi.args){
+				read(arg);
+			}
+		}
+		for(LirInst& inst : bb->insts){
+			map_uses(func, inst, read);
+			if(inst.lhs != NO_VAR){
+				assigned[inst.lhs] = true;
+			}
+		}
+		map_uses(bb->term, read);
+		VarId* lhs = term_def(bb->term);
+		if(lhs != NULL && *lhs != NO_VAR){
+			assigned[*lhs] = true;
+		}
+	}
+	vector<LatticeValue> value(num_vars);
+	for(VarId v = 0; v < num_vars; v++){
+		if(func->is_param(v) || !func->is_local(v)){
+			value[v] = bottom();
+		}
+		else{
+			value[v] = assigned[v] ? top() : constant(0);
+		}
+	}
+
+	vector<bool> executable(num_blocks, false);
+	vector<vector<bool>> edge_taken(num_blocks);
+	for(BlockId id = 0; id < (BlockId)num_blocks; id++){
+		edge_taken[id].assign(func->body[id]->preds.size(), false);
+	}
+	vector<BlockId> work;
+	vector<bool> queued(num_blocks, false);
+	auto visit_later = [&](BlockId id){
+		if(!queued[id]){
+			queued[id] = true;
+			work.push_back(id);
+		}
+	};
+	auto lower = [&](VarId v, LatticeValue to){
+		if(v == NO_VAR){
+			return;
+		}
+		LatticeValue next = meet(value[v], to);
+		if(next.state == value[v].state && next.num == value[v].num){
+			return;
+		}
+		value[v] = next;
+		for(BlockId reader : readers[v]){
+			if(executable[reader]){
+				visit_later(reader);
+			}
+		}
+	};
+	auto take_edge = [&](BlockId from, BlockId to){
+		BasicBlock* bb = func->body[to];
+		bool taken = false;
+		for(size_t j = 0; j < bb->preds.size(); j++){
+			if(bb->preds[j] == from && !edge_taken[to][j]){
+				edge_taken[to][j] = true;
+				taken = true;
+			}
+		}
+		if(taken){
+			executable[to] = true;
+			visit_later(to);
+		}
+	};
+	auto slot_value = [&](const LirInst& inst, int i){
+		return inst.is_var(i) ? value[inst.var(i)] : constant(inst.num(i));
+	};
+
+	executable[cfg.entry] = true;
+	visit_later(cfg.entry);
+	while(!work.empty()){
+		BlockId id = work.back();
+		work.pop_back();
+		queued[id] = false;
+		BasicBlock* bb = func->body[id];
+		for(LirPhi& phi : bb->phis){
+			LatticeValue v = top();
+			for(size_t j = 0; j < phi.args.size(); j++){
+				if(edge_taken[id][j]){
+					v = meet(v, value[phi.args[j]]);
+				}
+			}
+			lower(phi.lhs, v);
+		}
+		for(LirInst& inst : bb->insts){
+			LatticeValue v = bottom();
+			if(inst.type == LirInst::Copy){
+				v = slot_value(inst, 0);
+			}
+			else if(inst.type == LirInst::Arith || inst.type == LirInst::Cmp){
+				LatticeValue a = slot_value(inst, 0);
+				LatticeValue b = slot_value(inst, 1);
+				if(a.state == LatticeValue::Bottom || b.state == LatticeValue::Bottom){
+					v = bottom();
+				}
+				else if(a.state == LatticeValue::Top || b.state == LatticeValue::Top){
+					v = top();
+				}
+				else{
+					v = fold(inst, a.num, b.num);
+				}
+			}
+			lower(inst.lhs, v);
+		}
+		Terminal* term = bb->term;
+		if(term->type == Terminal::Branch){
+			Operand* guard = term->value.Branch.guard;
+			LatticeValue g = guard->type == Operand::Var ? value[guard->value.Var.id] : constant(guard->value.Const.num);
+			if(g.state == LatticeValue::Const){
+				take_edge(id, g.num != 0 ? term->value.Branch.tt : term->value.Branch.ff);
+			}
+			else if(g.state == LatticeValue::Bottom){
+				take_edge(id, term->value.Branch.tt);
+				take_edge(id, term->value.Branch.ff);
+			}
+		}
+		else if(term->type == Terminal::Jump){
+			take_edge(id, term->value.Jump.next_bb);
+		}
+		else if(term->type == Terminal::CallDirect){
+			lower(term->value.CallDirect.lhs, bottom());
+			take_edge(id, term->value.CallDirect.next_bb);
+		}
+		else if(term->type == Terminal::CallIndirect){
+			lower(term->value.CallIndirect.lhs, bottom());
+			take_edge(id, term->value.CallIndirect.next_bb);
+		}
+	}
+
+	// rewrite with what is known
+	auto known_operand = [&](VarId v){
+		if(fits_slot(value[v])){
+			Operand* op = lir_new<Operand>(Operand::Const);
+			op->value.Const.num = value[v].num;
+			return op;
+		}
+		return (Operand*)NULL;
+	};
+	auto fold_operand = [&](Operand*& op){
+		if(op != NULL && op->type == Operand::Var){
+			Operand* num = known_operand(op->value.Var.id);
+			if(num != NULL){
+				op = num;
+			}
+		}
+	};
+	for(BlockId id = 0; id < (BlockId)num_blocks; id++){
+		BasicBlock* bb = func->body[id];
+		if(!executable[id]){
+			bb->reachable = false;
+			bb->phis.clear();
+			bb->insts.clear();
+			bb->term = NULL;
+			continue;
+		}
+		for(LirInst& inst : bb->insts){
+			if((inst.type == LirInst::Arith || inst.type == LirInst::Cmp) && fits_slot(value[inst.lhs])){
+				inst = LirInst(LirInst::Copy, inst.lhs);
+				inst.set_const(0, value[inst.lhs].num);
+				continue;
+			}
+			for(int i = 0; i < 2; i++){
+				if(inst.is_var(i) && slot_takes_const(inst, i) && fits_slot(value[inst.var(i)])){
+					inst.set_const(i, value[inst.var(i)].num);
+				}
+			}
+			if(inst.type == LirInst::CallExt){
+				for(Operand*& arg : func->calls[inst.aux].args){
+					fold_operand(arg);
+				}
+			}
+		}
+		Terminal* term = bb->term;
+		if(term->type == Terminal::Branch){
+			BlockId tt = term->value.Branch.tt;
+			BlockId ff = term->value.Branch.ff;
+			bool to_tt = false;
+			bool to_ff = false;
+			for(size_t j = 0; j < func->body[tt]->preds.size(); j++){
+				to_tt = to_tt || (func->body[tt]->preds[j] == id && edge_taken[tt][j]);
+			}
+			for(size_t j = 0; j < func->body[ff]->preds.size(); j++){
+				to_ff = to_ff || (func->body[ff]->preds[j] == id && edge_taken[ff][j]);
+			}
+			if(to_tt != to_ff || tt == ff){
+				bb->term = lir_new<Terminal>(Terminal::Jump);
+				bb->term->value.Jump.next_bb = to_tt ? tt : ff;
+			}
+			else{
+				fold_operand(term->value.Branch.guard);
+			}
+		}
+		else if(term->type == Terminal::Ret){
+			fold_operand(term->value.Ret.op);
+		}
+		else if(term->type == Terminal::CallDirect){
+			for(Operand*& arg : term->value.CallDirect.args){
+				fold_operand(arg);
+			}
+		}
+		else if(term->type == Terminal::CallIndirect){
+			for(Operand*& arg : term->value.CallIndirect.args){
+				fold_operand(arg);
+			}
+		}
+	}
+	relink_blocks(func);
+}
@@ -0,0 +1,275 @@
+/**
+ * Putting a LIR function into SSA form and taking it out again.
+ *
+ * Parameters and locals are promoted: nothing can take their address, so
+ * every read and write of them is explicit in the LIR. Globals stay as
+ * they are. Phis go on the iterated dominance frontier of the blocks
+ * that assign a variable, for the variables some block reads before
+ * assigning them (semi-pruned SSA); temporaries that live within one
+ * block get none. Renaming then walks the dominator tree. Every
+ * assignment gets a fresh local "name.N" of the same type, and the
+ * variable itself stands for its value on entry: the argument of a
+ * parameter, 0 for a local, which codegen zeroes in the prologue.
+ *
+ * Out of SSA, every phi gets a fresh "name.in.N" that each predecessor
+ * sets last thing and the block copies into the phi at its top. As no
+ * two phis share one, the copies cannot clobber each other however the
+ * phis of a block refer to each other. A predecessor ending in a call
+ * assigns the call's result after anything it could copy, so the edge
+ * out of it gets a block of its own for the copies.
+ */
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "opt.hpp"
+
+using namespace std;
+
+VarId fresh_local(LIR_Function* func, string base, Type* type, int& counter){
+	string name;
+	do{
+		name = base + "." + to_string(++counter);
+	} while(func->find_var(name) != NO_VAR);
+	VarId id = func->intern_var(name);
+	func->add_local(id, type);
+	return id;
+}
+
+bool to_ssa(LIR_Function* func, const CFG& cfg){
+	if(cfg.entry == NO_BLOCK){
+		return false;
+	}
+	// a phi in entry would need a value for "before the function"
+	for(BlockId pred : func->body[cfg.entry]->preds){
+		if(cfg.reachable(pred)){
+			return false;
+		}
+	}
+	VarId num_vars = func->vars.size();
+	auto promoted = [&](VarId id){
+		return id != NO_VAR && id < num_vars && (func->is_local(id) || func->is_param(id));
+	};
+
+	// the blocks assigning each variable, and whether some block reads it
+	// before assigning it
+	vector<vector<BlockId>> def_blocks(num_vars);
+	vector<bool> live_in(num_vars, false);
+	vector<BlockId> defined_in(num_vars, NO_BLOCK);
+	for(BlockId id : cfg.rpo){
+		BasicBlock* bb = func->body[id];
+		auto use = [&](VarId v){
+			if(promoted(v) && defined_in[v] != id){
+				live_in[v] = true;
+			}
+			return v;
+		};
+		auto def = [&](VarId v){
+			if(promoted(v) && defined_in[v] != id){
+				defined_in[v] = id;
+				def_blocks[v].push_back(id);
+			}
+		};
+		for(LirInst& inst : bb->insts){
+			map_uses(func, inst, use);
+			def(inst.lhs);
+		}
+		map_uses(bb->term, use);
+		VarId* lhs = term_def(bb->term);
+		if(lhs != NULL){
+			def(*lhs);
+		}
+	}
+
+	// place the phis, every block gets at most one per variable
+	vector<VarId> has_phi(func->body.size(), NO_VAR);
+	vector<VarId> queued(func->body.size(), NO_VAR);
+	for(VarId v = 0; v < num_vars; v++){
+		if(!live_in[v] || def_blocks[v].empty()){
+			continue;
+		}
+		vector<BlockId> work = def_blocks[v];
+		for(BlockId id : work){
+			queued[id] = v;
+		}
+		while(!work.empty()){
+			BlockId id = work.back();
+			work.pop_back();
+			for(BlockId join : cfg.frontier[id]){
+				if(has_phi[join] == v){
+					continue;
+				}
+				has_phi[join] = v;
+				LirPhi phi;
+				phi.lhs = v;
+				phi.var = v;
+				phi.args.assign(func->body[join]->preds.size(), v);
+				func->body[join]->phis.push_back(phi);
+				if(queued[join] != v){
+					queued[join] = v;
+					work.push_back(join);
+				}
+			}
+		}
+	}
+
+	// rename along the dominator tree; current[v] is the stack of versions
+	// of v in scope, an empty one means v itself
+	vector<vector<VarId>> current(num_vars);
+	vector<VarId> pushed;
+	int counter = 0;
+	auto top = [&](VarId v){
+		return promoted(v) && !current[v].empty() ? current[v].back() : v;
+	};
+	auto define = [&](VarId v){
+		if(!promoted(v)){
+			return v;
+		}
+		VarId version = fresh_local(func, func->var_name(v), var_type(func, v), counter);
+		current[v].push_back(version);
+		pushed.push_back(v);
+		return version;
+	};
+	auto rename = [&](BlockId id){
+		BasicBlock* bb = func->body[id];
+		for(LirPhi& phi : bb->phis){
+			phi.lhs = define(phi.var);
+		}
+		for(LirInst& inst : bb->insts){
+			map_uses(func, inst, top);
+			inst.lhs = define(inst.lhs);
+		}
+		map_uses(bb->term, top);
+		VarId* lhs = term_def(bb->term);
+		if(lhs != NULL){
+			*lhs = define(*lhs);
+		}
+		for(BlockId succ : bb->succs){
+			BasicBlock* sb = func->body[succ];
+			for(size_t j = 0; j < sb->preds.size(); j++){
+				if(sb->preds[j] != id){
+					continue;
+				}
+				for(LirPhi& phi : sb->phis){
+					phi.args[j] = top(phi.var);
+				}
+			}
+		}
+	};
+
+	// each entry is a block, the next dominator tree child to visit, and
+	// how many versions were pushed before the block
+	vector<pair<BlockId, size_t>> stack;
+	vector<size_t> marks;
+	rename(cfg.entry);
+	stack.push_back(make_pair(cfg.entry, 0));
+	marks.push_back(0);
+	while(!stack.empty()){
+		BlockId id = stack.back().first;
+		if(stack.back().second < cfg.dom_children[id].size()){
+			BlockId child = cfg.dom_children[id][stack.back().second++];
+			marks.push_back(pushed.size());
+			rename(child);
+			stack.push_back(make_pair(child, 0));
+			continue;
+		}
+		while(pushed.size() > marks.back()){
+			current[pushed.back()].pop_back();
+			pushed.pop_back();
+		}
+		marks.pop_back();
+		stack.pop_back();
+	}
+	return true;
+}
+
+void relink_blocks(LIR_Function* func){
+	vector<vector<BlockId>> old_preds(func->body.size());
+	for(BasicBlock* bb : func->body){
+		if(!bb->phis.empty()){
+			old_preds[bb->id] = bb->preds;
+		}
+	}
+	func->link_blocks();
+	for(BasicBlock* bb : func->body){
+		for(LirPhi& phi : bb->phis){
+			vector<VarId> args(bb->preds.size(), phi.var);
+			for(size_t j = 0; j < bb->preds.size(); j++){
+				const vector<BlockId>& old = old_preds[bb->id];
+				for(size_t k = 0; k < old.size(); k++){
+					if(old[k] == bb->preds[j]){
+						args[j] = phi.args[k];
+						break;
+					}
+				}
+			}
+			phi.args.swap(args);
+		}
+	}
+}
+
+void from_ssa(LIR_Function* func){
+	int counter = 0;
+	size_t num_blocks = func->body.size();
+	// the block holding the copies for the edge out of a block ending in a call
+	vector<BlockId> split(num_blocks, NO_BLOCK);
+	auto copies_for = [&](BlockId pred){
+		Terminal* term = func->body[pred]->term;
+		BlockId* next = NULL;
+		if(term->type == Terminal::CallDirect){
+			next = &term->value.CallDirect.next_bb;
+		}
+		else if(term->type == Terminal::CallIndirect){
+			next = &term->value.CallIndirect.next_bb;
+		}
+		if(next == NULL){
+			return func->body[pred];
+		}
+		if(split[pred] == NO_BLOCK){
+			string label;
+			do{
+				label = "ssa" + to_string(++counter);
+			} while(func->find_block(label) != NO_BLOCK);
+			BlockId id = func->intern_block(label);
+			BasicBlock* bb = func->body[id];
+			bb->term = lir_new<Terminal>(Terminal::Jump);
+			bb->term->value.Jump.next_bb = *next;
+			bb->reachable = true;
+			*next = id;
+			split[pred] = id;
+		}
+		return func->body[split[pred]];
+	};
+
+	for(BlockId id = 0; id < (BlockId)num_blocks; id++){
+		BasicBlock* bb = func->body[id];
+		if(bb->phis.empty()){
+			continue;
+		}
+		vector<LirInst> entry_copies;
+		for(LirPhi& phi : bb->phis){
+			VarId in = fresh_local(func, func->var_name(phi.var) + ".in", var_type(func, phi.lhs), counter);
+			for(size_t j = 0; j < bb->preds.size(); j++){
+				BlockId pred = bb->preds[j];
+				// a branch with both targets here is one edge
+				bool seen = false;
+				for(size_t k = 0; k < j; k++){
+					seen = seen || bb->preds[k] == pred;
+				}
+				if(seen || !func->body[pred]->reachable){
+					continue;
+				}
+				LirInst copy(LirInst::Copy, in);
+				copy.set_var(0, phi.args[j]);
+				copies_for(pred)->insts.push_back(copy);
+			}
+			LirInst copy(LirInst::Copy, phi.lhs);
+			copy.set_var(0, in);
+			entry_copies.push_back(copy);
+		}
+		bb->insts.insert(bb->insts.begin(), entry_copies.begin(), entry_copies.end());
+		bb->phis.clear();
+	}
+	func->link_blocks();
+}
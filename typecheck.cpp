@@ -0,0 +1,401 @@
+/**
+ * Type checker for the AST.
+ *
+ * Every function is checked against a FunctionScope: its parameters and
+ * locals on top of the GlobalScope shared by the whole program. Types are
+ * interned, so checking two types for equality is a pointer compare, and
+ * every Exp and Lval keeps the type found for it for lowering. The
+ * checker is permissive where the language leaves room: an expression
+ * whose type could not be found reports once and is then left alone, so
+ * one mistake does not cascade into many diagnostics.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include "ast.hpp"
+
+using namespace std;
+
+FunctionScope::FunctionScope(const GlobalScope& global, Function* func, vector<string>& errors)
+  : global(global), func_name(func->name), ret_type(func->rettyp), errors(errors){
+  for(Decl* d : func->params){
+    names[d->name] = d->type;
+  }
+  for(auto& local : func->locals){
+    names[local.first->name] = local.first->type;
+  }
+}
+
+Type* FunctionScope::lookup(const string& name) const {
+  auto it = names.find(name);
+  if(it != names.end()){
+    return it->second;
+  }
+  auto git = global.names.find(name);
+  return git == global.names.end() ? NULL : git->second;
+}
+
+void FunctionScope::error(const string& msg){
+  errors.push_back("in function " + func_name + ": " + msg);
+}
+
+// nil has type Any; lowering makes it a 0, so it goes wherever a pointer
+// or an Int does
+static bool holds_nil(Type* t){
+  return t->type == Type::Int || t->type == Type::Ptr || t->type == Type::Any;
+}
+
+static bool compatible(Type* want, Type* got){
+  if(want == got){
+    return true;
+  }
+  if(got->type == Type::Any){
+    return holds_nil(want);
+  }
+  return want->type == Type::Any && holds_nil(got);
+}
+
+static Type* expect_int(FunctionScope& scope, Type* t, const char* what){
+  if(t != NULL && t->type != Type::Int && t->type != Type::Any){
+    scope.error(string(what) + " must be Int, not " + t->type_string());
+  }
+  return int_type();
+}
+
+// the element type of a pointer, NULL (after a diagnostic) for anything else
+static Type* pointee(FunctionScope& scope, Type* t, const char* what){
+  if(t == NULL){
+    return NULL;
+  }
+  if(t->type != Type::Ptr){
+    scope.error(string(what) + " needs a pointer, not " + t->type_string());
+    return NULL;
+  }
+  return t->value.Ptr.ref;
+}
+
+static Type* field_type(FunctionScope& scope, Type* ptr, const string& field){
+  Type* s = pointee(scope, ptr, "field access");
+  if(s == NULL){
+    return NULL;
+  }
+  if(s->type != Type::Struct){
+    scope.error("field access needs a struct pointer, not " + ptr->type_string());
+    return NULL;
+  }
+  auto it = scope.global.structs.find(s->value.Struct.name);
+  if(it == scope.global.structs.end()){
+    scope.error("unknown struct " + s->value.Struct.name);
+    return NULL;
+  }
+  auto fit = it->second.find(field);
+  if(fit == it->second.end()){
+    scope.error("struct " + s->value.Struct.name + " has no field " + field);
+    return NULL;
+  }
+  return fit->second;
+}
+
+/*
+ * A call through callee, which has type callee_type: an extern (a Fn) or
+ * a function pointer (a &Fn). Returns the Fn type, NULL if it is not one.
+ */
+static Type* check_call(FunctionScope& scope, Type* callee_type, vector<Exp*>& args){
+  vector<Type*> arg_types;
+  for(Exp* arg : args){
+    arg_types.push_back(arg->to_type(scope));
+  }
+  if(callee_type == NULL){
+    return NULL;
+  }
+  Type* fn = callee_type;
+  if(fn->type == Type::Ptr){
+    fn = fn->value.Ptr.ref;
+  }
+  if(fn->type != Type::Fn){
+    scope.error("call of a non-function of type " + callee_type->type_string());
+    return NULL;
+  }
+  if(fn->value.Fn.prms.size() != args.size()){
+    scope.error("call with " + to_string(args.size()) + " arguments to " + fn->type_string());
+    return fn;
+  }
+  for(size_t i = 0; i < args.size(); i++){
+    if(arg_types[i] != NULL && !compatible(fn->value.Fn.prms[i], arg_types[i])){
+      scope.error("argument " + to_string(i + 1) + " is " + arg_types[i]->type_string()
+        + ", expected " + fn->value.Fn.prms[i]->type_string());
+    }
+  }
+  return fn;
+}
+
+/*
+ * The type of the expression, or NULL if it has none that the checker
+ * could find; the reason has already been reported then. It is kept on
+ * the node so lowering does not have to work it out again.
+ */
+Type* Exp::to_type(FunctionScope& scope){
+  typ = infer_type(scope);
+  return typ;
+}
+
+Type* Exp::infer_type(FunctionScope& scope){
+  switch(type){
+    case Num:
+      return int_type();
+    case Id: {
+      Type* t = scope.lookup(value.Id.name);
+      if(t == NULL){
+        scope.error("unbound identifier " + value.Id.name);
+      }
+      return t;
+    }
+    case Nil:
+      return any_type();
+    case UnOp: {
+      Type* t = value.UnOp.operand->to_type(scope);
+      if(value.UnOp.op->type == UnaryOp::Neg){
+        return expect_int(scope, t, "operand of -");
+      }
+      return pointee(scope, t, "dereference");
+    }
+    case BinOp: {
+      Type* left = value.BinOp.left->to_type(scope);
+      Type* right = value.BinOp.right->to_type(scope);
+      enum BinaryOp::type op = value.BinOp.op->type;
+      if(op == BinaryOp::Equal || op == BinaryOp::NotEq){
+        if(left != NULL && right != NULL && !compatible(left, right) && !compatible(right, left)){
+          scope.error("comparing " + left->type_string() + " with " + right->type_string());
+        }
+        return int_type();
+      }
+      expect_int(scope, left, "left operand");
+      return expect_int(scope, right, "right operand");
+    }
+    case ArrayAccess: {
+      Type* elem = pointee(scope, value.ArrayAccess.ptr->to_type(scope), "array access");
+      expect_int(scope, value.ArrayAccess.index->to_type(scope), "array index");
+      return elem;
+    }
+    case FieldAccess:
+      return field_type(scope, value.FieldAccess.ptr->to_type(scope), value.FieldAccess.field);
+    case Call: {
+      Type* fn = check_call(scope, value.Call.callee->to_type(scope), value.Call.args);
+      if(fn != NULL && fn->value.Fn.ret == NULL){
+        scope.error("the value of a call to " + fn->type_string() + " is used");
+      }
+      return fn == NULL ? NULL : fn->value.Fn.ret;
+    }
+  }
+  return NULL;
+}
+
+Type* Lval::to_type(FunctionScope& scope){
+  typ = infer_type(scope);
+  return typ;
+}
+
+Type* Lval::infer_type(FunctionScope& scope){
+  switch(type){
+    case Id: {
+      Type* t = scope.lookup(value.Id.name);
+      if(t == NULL){
+        scope.error("unbound identifier " + value.Id.name);
+      }
+      return t;
+    }
+    case Deref:
+      return pointee(scope, value.Deref.lval->to_type(scope), "dereference");
+    case ArrayAccess: {
+      Type* elem = pointee(scope, value.ArrayAccess.ptr->to_type(scope), "array access");
+      expect_int(scope, value.ArrayAccess.index->to_type(scope), "array index");
+      return elem;
+    }
+    case FieldAccess:
+      return field_type(scope, value.FieldAccess.ptr->to_type(scope), value.FieldAccess.field);
+  }
+  return NULL;
+}
+
+Type* Rhs::to_type(FunctionScope& scope){
+  if(type == RhsExp){
+    return value.RhsExp.exp->to_type(scope);
+  }
+  if(value.New.amount != NULL){
+    expect_int(scope, value.New.amount->to_type(scope), "allocation size");
+  }
+  return ptr_type(value.New.type);
+}
+
+void Stmt::to_verify(FunctionScope& scope){
+  switch(type){
+    case Break:
+    case Continue:
+      if(scope.loops == 0){
+        scope.error(string(type == Break ? "break" : "continue") + " outside of a loop");
+      }
+      break;
+    case Return:
+      if(value.Return.exp == NULL){
+        if(scope.ret_type != NULL){
+          scope.error("return without a value, expected " + scope.ret_type->type_string());
+        }
+      }
+      else{
+        Type* t = value.Return.exp->to_type(scope);
+        if(scope.ret_type == NULL){
+          scope.error("return with a value from a function without a return type");
+        }
+        else if(t != NULL && !compatible(scope.ret_type, t)){
+          scope.error("returning " + t->type_string() + ", expected " + scope.ret_type->type_string());
+        }
+      }
+      break;
+    case Assign: {
+      Type* lhs = value.Assign.lhs->to_type(scope);
+      Type* rhs = value.Assign.rhs->to_type(scope);
+      if(lhs != NULL && rhs != NULL && !compatible(lhs, rhs)){
+        scope.error("assigning " + rhs->type_string() + " to " + lhs->type_string());
+      }
+      break;
+    }
+    case Call:
+      check_call(scope, value.Call.callee->to_type(scope), value.Call.args);
+      break;
+    case If:
+      expect_int(scope, value.If.guard->to_type(scope), "if guard");
+      for(Stmt* s : value.If.tt){
+        s->to_verify(scope);
+      }
+      for(Stmt* s : value.If.ff){
+        s->to_verify(scope);
+      }
+      break;
+    case While:
+      expect_int(scope, value.While.guard->to_type(scope), "while guard");
+      scope.loops++;
+      for(Stmt* s : value.While.body){
+        s->to_verify(scope);
+      }
+      scope.loops--;
+      break;
+  }
+}
+
+/*
+ * The names every function sees. Functions are &Fn like in lowering, which
+ * also leaves out main; externs are plain Fn.
+ */
+void build_global_scope(Program* prog, GlobalScope& global){
+  for(Struct* s : prog->structs){
+    unordered_map<string, Type*>& fields = global.structs[s->name];
+    for(Decl* d : s->fields){
+      fields[d->name] = d->type;
+    }
+  }
+  for(Decl* d : prog->globals){
+    global.names[d->name] = d->type;
+  }
+  for(Decl* d : prog->externs){
+    global.names[d->name] = d->type;
+  }
+  for(Function* f : prog->functions){
+    if(f->name == "main"){
+      continue;
+    }
+    vector<Type*> prms;
+    for(Decl* d : f->params){
+      prms.push_back(d->type);
+    }
+    global.names[f->name] = ptr_type(fn_type(prms, f->rettyp));
+  }
+}
+
+void check_function(Function* func, const GlobalScope& global, vector<string>& errors){
+  FunctionScope scope(global, func, errors);
+  for(auto& local : func->locals){
+    if(local.second == NULL){
+      continue;
+    }
+    Type* t = local.second->to_type(scope);
+    if(t != NULL && !compatible(local.first->type, t)){
+      scope.error("local " + local.first->name + " of type " + local.first->type->type_string()
+        + " initialized with " + t->type_string());
+    }
+  }
+  for(Stmt* s : func->stmts){
+    s->to_verify(scope);
+  }
+}
+
+thread_local int check_jobs = 1;
+
+// fewer functions than this per thread are not worth starting one for
+const size_t FUNCTIONS_PER_JOB = 32;
+
+/*
+ * Check every function. Once the global scope is built the bodies are
+ * independent, so they are spread over check_jobs threads; each function
+ * keeps its own diagnostics and they are joined in source order.
+ */
+vector<string> validate(Program* prog){
+  GlobalScope global;
+  build_global_scope(prog, global);
+  size_t n = prog->functions.size();
+  vector<vector<string>> errors(n);
+
+  size_t jobs = check_jobs > 0 ? check_jobs : thread::hardware_concurrency();
+  jobs = min(jobs, n / FUNCTIONS_PER_JOB);
+  if(jobs <= 1){
+    for(size_t i = 0; i < n; i++){
+      check_function(prog->functions[i], global, errors[i]);
+    }
+  }
+  else{
+    // checking can intern types (new T is a &T), the helpers use our table
+    TypeTable* types = share_types();
+    atomic<size_t> next(0);
+    auto worker = [&](){
+      size_t i;
+      while((i = next++) < n){
+        check_function(prog->functions[i], global, errors[i]);
+      }
+    };
+    vector<thread> pool;
+    for(size_t t = 1; t < jobs; t++){
+      pool.push_back(thread([&](){
+        borrow_types(types);
+        worker();
+        borrow_types(NULL);
+      }));
+    }
+    worker();
+    for(thread& t : pool){
+      t.join();
+    }
+    unshare_types(types);
+  }
+
+  vector<string> all;
+  for(vector<string>& e : errors){
+    all.insert(all.end(), e.begin(), e.end());
+  }
+  return all;
+}
+
+void throw_type_errors(const vector<string>& errors){
+  if(errors.empty()){
+    return;
+  }
+  string what;
+  for(const string& e : errors){
+    what += "type error " + e + "\n";
+  }
+  throw type_error{what};
+}